@@ -2,73 +2,268 @@
 #include <algorithm>
 
 const std::unordered_map<int, int> op_precedence = {
-    {'=', 10},{'+', 20},{'-', 20},{'*', 30},{'/', 30}
+    {'=', 10},{TOKEN_OR, 12},{TOKEN_AND, 13},
+    {TOKEN_EQUAL, 15},{TOKEN_NOT_EQUAL, 15},{'<', 15},{'>', 15},{TOKEN_LESS_EQUAL, 15},{TOKEN_GREATER_EQUAL, 15},
+    {'+', 20},{'-', 20},{'*', 30},{'/', 30}
 };
 
+// keywords that close a block or start its next part
+static bool ends_block(int token)
+{
+    switch (token) {
+    case TOKEN_EOF:
+    case TOKEN_END:
+    case TOKEN_ELSE:
+    case TOKEN_ELSEIF:
+    case TOKEN_ENDIF:
+    case TOKEN_NEXT:
+    case TOKEN_WEND:
+    case TOKEN_UNTIL:
+    case TOKEN_FOREVER:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void AST::parse()
 {
-    global_symbols.insert({ "__main", SYMBOL_TYPE_FUNCTION });
-    auto signature = std::make_unique<FunctionSignatureAST>("__main", SYMBOL_TYPE_INT);
-    auto function = std::make_unique<FunctionAST>(std::move(signature));
-    while (true) {
-        //try {
+    auto function = create_main();
+    while (parse_top_level(*function).kind != TOP_LEVEL_NONE) {}
+    function_table.emplace(MAIN_SYMBOL, std::move(function));
+}
+
+std::unique_ptr<FunctionAST> AST::create_main()
+{
+    global_symbols.insert({ MAIN_SYMBOL, SYMBOL_TYPE_FUNCTION });
+    auto signature = std::make_unique<FunctionSignatureAST>(MAIN_SYMBOL, SYMBOL_TYPE_INT);
+    return std::make_unique<FunctionAST>(std::move(signature));
+}
+
+TopLevelItem AST::parse_top_level(FunctionAST& main)
+{
+    // left over if the previous item failed to parse
+    call_arguments.clear();
+    block_statements.clear();
+    in_condition = false;
+    do {
+        this->token = lex->get_token();
+    } while (token == TOKEN_END_OF_STMT);
+    TopLevelItem item = { TOP_LEVEL_NONE, lex->token_offset() };
+    if (token == TOKEN_EOF) return item;
+    if (token == TOKEN_FUNCTION) {
+        item.kind = TOP_LEVEL_FUNCTION;
+        item.function = parse_function_definition();
+        return item;
+    }
+    if (token == TOKEN_INCLUDE) {
+        this->token = lex->get_token();
+        if (token != TOKEN_STRING) throw ast_exception("expecting file name");
+        includes.push_back({ main.body.size(), std::string(lex->string_value) });
         this->token = lex->get_token();
-        if (token == TOKEN_EOF) break;
-        if (token == TOKEN_END_OF_STMT) continue;
-        if (token == TOKEN_FUNCTION) {
-            parse_function_definition();
-            continue;
+        if (token != TOKEN_END_OF_STMT && token != TOKEN_EOF) throw ast_exception("expecting end of statement");
+        item.kind = TOP_LEVEL_INCLUDE;
+        return item;
+    }
+    if (token == TOKEN_EXTERN) {
+        auto function = parse_function_signature();
+        auto inserted = extern_function_table.emplace(function->name, std::move(function));
+        item.kind = TOP_LEVEL_EXTERN;
+        if (inserted.second) item.extern_function = inserted.first->second.get();
+        return item;
+    }
+    // nothing is added to main unless the whole statement parses
+    ExprAST* statement = parse_statement(global_symbols);
+    expect_end_of_statement();
+    main.body.push_back(statement);
+    item.kind = TOP_LEVEL_STATEMENT;
+    item.statement = statement;
+    item.ends_at_eof = token == TOKEN_EOF;
+    return item;
+}
+
+ExprAST* AST::parse_statement(SymbolTable& symbol_table)
+{
+    switch (token) {
+    case TOKEN_IF:
+        return parse_if(symbol_table);
+    case TOKEN_FOR:
+        return parse_for(symbol_table);
+    case TOKEN_WHILE:
+    {
+        token = lex->get_token();
+        ExprAST* condition = parse_condition(symbol_table);
+        auto body = parse_block(symbol_table);
+        if (token != TOKEN_WEND) throw ast_exception("expecting Wend");
+        token = lex->get_token();
+        return arena.make<WhileExprAST>(condition, body);
+    }
+    case TOKEN_REPEAT:
+    {
+        token = lex->get_token();
+        auto body = parse_block(symbol_table);
+        ExprAST* condition = nullptr;
+        if (token == TOKEN_UNTIL) {
+            token = lex->get_token();
+            condition = parse_condition(symbol_table);
+        }
+        else if (token == TOKEN_FOREVER) {
+            token = lex->get_token();
+        }
+        else {
+            throw ast_exception("expecting Until or Forever");
+        }
+        return arena.make<RepeatExprAST>(body, condition);
+    }
+    default:
+        return parse_expression(parse_primary_expression(symbol_table), symbol_table);
+    }
+}
+
+std::span<ExprAST*> AST::parse_block(SymbolTable& symbol_table)
+{
+    // nested blocks stack their statements on top of ours
+    size_t first_statement = block_statements.size();
+    while (!ends_block(token)) {
+        if (token == TOKEN_END_OF_STMT) { token = lex->get_token(); continue; }
+        if (token == TOKEN_FUNCTION) throw ast_exception("cannot define function in a block");
+        if (token == TOKEN_EXTERN) throw ast_exception("cannot define extern function in a block");
+        if (token == TOKEN_INCLUDE) throw ast_exception("cannot include in a block");
+        block_statements.push_back(parse_statement(symbol_table));
+        expect_end_of_statement();
+    }
+    auto body = arena.copy(std::span<ExprAST* const>(block_statements.begin() + first_statement, block_statements.end()));
+    block_statements.resize(first_statement);
+    return body;
+}
+
+ExprAST* AST::parse_if(SymbolTable& symbol_table, bool chained)
+{
+    // `token` is If, or ElseIf and the If of Else If when `chained`, which are always blocks
+    token = lex->get_token();
+    ExprAST* condition = parse_condition(symbol_table);
+    if (token == TOKEN_THEN) token = lex->get_token();
+
+    if (!chained && token != TOKEN_END_OF_STMT && token != TOKEN_EOF) {
+        // If a Then b Else c, on one line
+        ExprAST* statement = parse_statement(symbol_table);
+        auto then_body = arena.copy(std::span<ExprAST* const>(&statement, 1));
+        std::span<ExprAST*> else_body;
+        if (token == TOKEN_ELSE) {
+            token = lex->get_token();
+            statement = parse_statement(symbol_table);
+            else_body = arena.copy(std::span<ExprAST* const>(&statement, 1));
         }
-        if (token == TOKEN_EXTERN) {
-            auto function = parse_function_signature();
-            extern_function_table.emplace(function->name, std::move(function));
-            continue;
+        return arena.make<IfExprAST>(condition, then_body, else_body);
+    }
+
+    auto then_body = parse_block(symbol_table);
+    if (token == TOKEN_ELSE) {
+        token = lex->get_token();
+        if (token != TOKEN_IF) {
+            auto else_body = parse_block(symbol_table);
+            if (token != TOKEN_ENDIF && !(token == TOKEN_END && lex->get_token() == TOKEN_IF)) throw ast_exception("expecting EndIf");
+            token = lex->get_token();
+            return arena.make<IfExprAST>(condition, then_body, else_body);
         }
-        std::unique_ptr<ExprAST> lhs = std::move(parse_primary_expression(global_symbols));
-        function->body.push_back(std::move(parse_expression(std::move(lhs), global_symbols)));
-        //}
-        //catch (ast_exception e) {
-        //    std::cerr << e.what() << '\n';
-        //    while (token != TOKEN_EOF && token != TOKEN_END_OF_STMT) { this->token = lex->get_token(); }
-        //}
     }
-    function_table.emplace("__main", std::move(function));
+    if (token == TOKEN_ELSEIF || token == TOKEN_IF) {
+        // the rest of the chain is an If of its own, which also takes the EndIf
+        ExprAST* statement = parse_if(symbol_table, true);
+        return arena.make<IfExprAST>(condition, then_body, arena.copy(std::span<ExprAST* const>(&statement, 1)));
+    }
+    if (token != TOKEN_ENDIF && !(token == TOKEN_END && lex->get_token() == TOKEN_IF)) throw ast_exception("expecting EndIf");
+    token = lex->get_token();
+    return arena.make<IfExprAST>(condition, then_body, std::span<ExprAST*>());
+}
+
+ExprAST* AST::parse_for(SymbolTable& symbol_table)
+{
+    token = lex->get_token();
+    if (token != TOKEN_IDENTIFIER) throw ast_exception("expecting loop variable");
+    ExprAST* variable = parse_primary_expression(symbol_table, false);
+    if (variable->kind != EXPR_VARIABLE || token != '=') throw ast_exception("expecting =");
+    token = lex->get_token();
+    ExprAST* start = parse_expression(parse_primary_expression(symbol_table, false), symbol_table, false);
+    if (token != TOKEN_TO) throw ast_exception("expecting To");
+    token = lex->get_token();
+    ExprAST* end = parse_expression(parse_primary_expression(symbol_table, false), symbol_table, false);
+
+    // the direction of the loop is decided at compile time, so the step has to be a literal
+    ExprAST* step = nullptr;
+    if (token == TOKEN_STEP) {
+        token = lex->get_token();
+        bool negative = token == '-';
+        if (negative) token = lex->get_token();
+        if (token == TOKEN_INTEGER && lex->int_value != 0) {
+            step = arena.make<IntegerExprAST>(negative ? -lex->int_value : lex->int_value);
+        }
+        else if (token == TOKEN_FLOAT && lex->float_value != 0.0f) {
+            step = arena.make<FloatExprAST>(negative ? -lex->float_value : lex->float_value);
+        }
+        else {
+            throw ast_exception("step must be a number other than 0");
+        }
+        token = lex->get_token();
+    }
+    else {
+        step = arena.make<IntegerExprAST>(1);
+    }
+
+    auto body = parse_block(symbol_table);
+    if (token != TOKEN_NEXT) throw ast_exception("expecting Next");
+    token = lex->get_token();
+    return arena.make<ForExprAST>(static_cast<VariableExprAST*>(variable), start, end, step, body);
+}
+
+ExprAST* AST::parse_condition(SymbolTable& symbol_table)
+{
+    // `If a = 1` compares, and a variable is not declared by appearing there
+    in_condition = true;
+    ExprAST* condition = parse_expression(parse_primary_expression(symbol_table, false), symbol_table, false);
+    in_condition = false;
+    return condition;
+}
+
+void AST::expect_end_of_statement()
+{
+    if (token != TOKEN_END_OF_STMT && token != TOKEN_EOF) throw ast_exception("expecting end of statement");
 }
 
-std::unique_ptr<ExprAST> AST::parse_primary_expression(SymbolTable& symbol_table, bool function_first)
+ExprAST* AST::parse_primary_expression(SymbolTable& symbol_table, bool function_first)
 {
-    std::unique_ptr<ExprAST> lhs = nullptr;
+    ExprAST* lhs = nullptr;
     switch (token) {
     case TOKEN_IDENTIFIER:
     {
-        std::string identifier = std::move(lex->identifier);
+        Symbol identifier = lex->symbol;
         Token type = TOKEN_TYPE_INT;
         token = lex->get_token();
         switch (token) {
         case TOKEN_TYPE_FLOAT:
             if (!is_variable(symbol_table, identifier)) {
-                symbol_table.insert({ identifier, SYMBOL_TYPE_FLOAT });
+                declare(symbol_table, identifier, SYMBOL_TYPE_FLOAT);
             }
             type = (Token)token;
             token = lex->get_token();
             break;
         case TOKEN_TYPE_STRING:
             if (!is_variable(symbol_table, identifier)) {
-                symbol_table.insert({ identifier, SYMBOL_TYPE_STRING });
+                declare(symbol_table, identifier, SYMBOL_TYPE_STRING);
             }
             type = (Token)token;
             token = lex->get_token();
             break;
         case TOKEN_TYPE_INT:
             if (!is_variable(symbol_table, identifier)) {
-                symbol_table.insert({ identifier, SYMBOL_TYPE_INT });
+                declare(symbol_table, identifier, SYMBOL_TYPE_INT);
             }
             token = lex->get_token();
         default:
-            if (token == '=') {
+            if (token == '=' && !in_condition) {
                 int symbol_type = is_variable(symbol_table, identifier);
                 if (symbol_type == 0) {
-                    symbol_table.insert({ identifier, SYMBOL_TYPE_INT });
+                    declare(symbol_table, identifier, SYMBOL_TYPE_INT);
                 }
                 else if (symbol_type != token_to_type(type)) {
                     throw ast_exception("mismatched variable type");
@@ -76,49 +271,47 @@ std::unique_ptr<ExprAST> AST::parse_primary_expression(SymbolTable& symbol_table
                 break;
             }
             if (token == '(' || function_first) { // must be function call
-                lhs = parse_call_expression(std::move(identifier), symbol_table);
-                token = lex->get_token();
-                return lhs;
+                return parse_call_expression(identifier, symbol_table);
             }
         }
 
         //if (!op_precedence.contains(token) && token != '(' && token != ')') throw ast_exception("unknown operator");
-        lhs = std::make_unique<VariableExprAST>(std::move(identifier));
+        lhs = arena.make<VariableExprAST>(identifier);
         break;
     }
     case TOKEN_INTEGER:
-        lhs = std::make_unique<IntegerExprAST>(lex->int_value);
+        lhs = arena.make<IntegerExprAST>(lex->int_value);
         token = lex->get_token();
         break;
     case TOKEN_FLOAT:
-        lhs = std::make_unique<FloatExprAST>(lex->float_value);
+        lhs = arena.make<FloatExprAST>(lex->float_value);
         token = lex->get_token();
         break;
     case TOKEN_STRING:
-        lhs = std::make_unique<StringExprAST>(std::move(lex->string_value));
+        lhs = arena.make<StringExprAST>(arena.copy(lex->string_value));
         token = lex->get_token();
         break;
     case '(':
         token = lex->get_token();
-        lhs = std::move(parse_expression(std::move(parse_primary_expression(symbol_table, function_first)), symbol_table, function_first));
+        lhs = parse_expression(parse_primary_expression(symbol_table, function_first), symbol_table, function_first);
         if (token != ')') throw ast_exception("expecting closing parenthesis");
         token = lex->get_token();
         break;
     case '-':
         token = lex->get_token();
-        lhs = std::make_unique<UnaryExprAST>('-', std::move(parse_primary_expression(symbol_table, function_first)));
+        lhs = arena.make<UnaryExprAST>('-', parse_primary_expression(symbol_table, function_first));
         break;
     case TOKEN_LOGIC_NOT:
         token = lex->get_token();
-        lhs = std::make_unique<UnaryExprAST>(TOKEN_LOGIC_NOT, std::move(parse_primary_expression(symbol_table, function_first)));
+        lhs = arena.make<UnaryExprAST>(TOKEN_LOGIC_NOT, parse_primary_expression(symbol_table, function_first));
         break;
     case TOKEN_RETURN:
         token = lex->get_token();
-        if (token == TOKEN_EOF || token == TOKEN_END_OF_STMT) {
-            lhs = std::make_unique<ReturnExprAST>(nullptr);
+        if (token == TOKEN_EOF || token == TOKEN_END_OF_STMT || token == TOKEN_ELSE) {
+            lhs = arena.make<ReturnExprAST>(nullptr);
             break;
         }
-        lhs = std::make_unique<ReturnExprAST>(std::move(parse_expression(std::move(parse_primary_expression(symbol_table, false)), symbol_table, false)));
+        lhs = arena.make<ReturnExprAST>(parse_expression(parse_primary_expression(symbol_table, false), symbol_table, false));
         break;
     default:
         throw ast_exception("expecting primary expression");
@@ -129,7 +322,7 @@ std::unique_ptr<ExprAST> AST::parse_primary_expression(SymbolTable& symbol_table
 std::unique_ptr<FunctionSignatureAST> AST::parse_function_signature() {
     this->token = lex->get_token();
     if (token != TOKEN_IDENTIFIER) throw ast_exception("expecting function name");
-    std::string name = std::move(lex->identifier);
+    Symbol name = lex->symbol;
     this->token = lex->get_token();
     SymbolType return_value_type = SYMBOL_TYPE_INT;
     if (token == TOKEN_TYPE_INT || token == TOKEN_TYPE_FLOAT || token == TOKEN_TYPE_STRING) {
@@ -138,99 +331,126 @@ std::unique_ptr<FunctionSignatureAST> AST::parse_function_signature() {
     }
     if (token != '(') throw ast_exception("expecting opening parenthesis");
     auto function = std::make_unique<FunctionSignatureAST>(name, return_value_type);
-    int mandatory_args = 0, optional_args = 0;
     do {
         this->token = lex->get_token();
         if (token == ')') break;
         if (token != TOKEN_IDENTIFIER) throw ast_exception("expecting argument name");
-        std::string arg_name = std::move(lex->identifier);
+        Symbol arg_name = lex->symbol;
         this->token = lex->get_token();
         SymbolType type = SYMBOL_TYPE_INT;
         if (token == TOKEN_TYPE_INT || token == TOKEN_TYPE_FLOAT || token == TOKEN_TYPE_STRING) {
             type = token_to_type((Token)token);
             this->token = lex->get_token();
         }
-        std::unique_ptr<ExprAST> default_value = nullptr;
+        ExprAST* default_value = nullptr;
         if (token == '=') {
             this->token = lex->get_token();
             default_value = parse_expression(parse_primary_expression(function->symbol_table, false), function->symbol_table, false);
-            optional_args++;
-        }
-        else {
-            mandatory_args++;
         }
         function->symbol_table.insert({ arg_name, type });
-        function->arguments.push_back(std::make_unique<FunctionArgument>(std::move(arg_name), type, std::move(default_value)));
+        function->arguments.push_back(arena.make<FunctionArgument>(arg_name, type, default_value));
     } while (token == ',');
     if (token != ')') throw ast_exception("expecting closing parenthesis");
-    global_symbols.insert({ name, SYMBOL_TYPE_FUNCTION });
+    declare(global_symbols, name, SYMBOL_TYPE_FUNCTION);
+    check_duplicate_signature(*function);
+    return function;
+}
+
+void AST::check_duplicate_signature(const FunctionSignatureAST& signature) {
+    auto is_mandatory = [](const FunctionArgument* arg) {
+        return arg->default_value == nullptr;
+    };
+    int mandatory_args = std::count_if(signature.arguments.begin(), signature.arguments.end(), is_mandatory);
+    int optional_args = signature.arguments.size() - mandatory_args;
 
     // looking for duplicate signatures...
-    auto defined = function_table.equal_range(function->name);
+    auto defined = function_table.equal_range(signature.name);
     for (auto& it = defined.first; it != defined.second; ++it) {
         int define_mandatory_args = std::count_if(it->second->signature->arguments.begin(),
-            it->second->signature->arguments.end(),
-            [](const std::unique_ptr<FunctionArgument>& arg) {
-                return arg->default_value == nullptr;
-            });
+            it->second->signature->arguments.end(), is_mandatory);
         int define_optional_args = it->second->signature->arguments.size() - define_mandatory_args;
         if (define_mandatory_args == mandatory_args && define_optional_args == optional_args) {
             throw ast_exception("duplicate function signature");
         }
     }
-
-    return function;
 }
 
-void AST::parse_function_definition() {
+FunctionAST* AST::parse_function_definition() {
     auto function = std::make_unique<FunctionAST>(std::move(parse_function_signature()));
+    function->order = ++defined_functions;
     this->token = lex->get_token();
     do {
         if (token == TOKEN_EOF) throw ast_exception("expecting end function");
         if (token == TOKEN_FUNCTION) throw ast_exception("cannot define function in function");
         if (token == TOKEN_EXTERN) throw ast_exception("cannot define extern function in function");
-        if (token == TOKEN_END && (this->token = lex->get_token()) == TOKEN_FUNCTION) { break; }
+        if (token == TOKEN_INCLUDE) throw ast_exception("cannot include in function");
+        if (token == TOKEN_END) {
+            if ((this->token = lex->get_token()) == TOKEN_FUNCTION) break;
+            throw ast_exception("expecting end function");
+        }
         if (token == TOKEN_END_OF_STMT) { this->token = lex->get_token(); continue; }
-        std::unique_ptr<ExprAST> lhs = std::move(parse_primary_expression(function->signature->symbol_table));
-        function->body.push_back(std::move(parse_expression(std::move(lhs), function->signature->symbol_table)));
+        function->body.push_back(parse_statement(function->signature->symbol_table));
+        expect_end_of_statement();
     } while (true);
-    function_table.emplace(function->signature->name, std::move(function));
+    return function_table.emplace(function->signature->name, std::move(function))->second.get();
 }
 
-std::unique_ptr<CallExprAST> AST::parse_call_expression(std::string callee, SymbolTable& symbol_table) {
-    std::vector<std::unique_ptr<ExprAST>> arguments = {};
-    if (token == ')') return std::make_unique<CallExprAST>(std::move(callee), std::move(arguments));
-    do {
-        if (token == ',' || token == '(') this->token = lex->get_token();
-        if (token == ')' || token == TOKEN_EOF || token == TOKEN_END_OF_STMT) { this->token = lex->get_token(); break; }
-        std::unique_ptr<ExprAST> lhs = std::move(parse_primary_expression(symbol_table, false));
-        arguments.push_back(std::move(parse_expression(std::move(lhs), symbol_table)));
-    } while (token == ',');
-    return std::make_unique<CallExprAST>(std::move(callee), std::move(arguments));
+CallExprAST* AST::parse_call_expression(Symbol callee, SymbolTable& symbol_table) {
+    if (log != nullptr) log->calls.push_back(callee);
+    // `f(a, b)` or `f a, b`, which runs to the end of the statement
+    bool parenthesized = token == '(';
+    if (parenthesized) this->token = lex->get_token();
+    bool has_arguments = parenthesized ? token != ')' :
+        token != TOKEN_END_OF_STMT && token != TOKEN_EOF && token != TOKEN_ELSE && token != ')' && token != ',';
+    // nested calls stack their arguments on top of ours
+    size_t first_argument = call_arguments.size();
+    while (has_arguments) {
+        ExprAST* lhs = parse_primary_expression(symbol_table, false);
+        call_arguments.push_back(parse_expression(lhs, symbol_table, false));
+        if (token != ',') break;
+        this->token = lex->get_token();
+    }
+    if (parenthesized) {
+        if (token != ')') throw ast_exception("expecting closing parenthesis");
+        this->token = lex->get_token();
+    }
+    auto arguments = arena.copy(std::span<ExprAST* const>(call_arguments.begin() + first_argument, call_arguments.end()));
+    call_arguments.resize(first_argument);
+    return arena.make<CallExprAST>(callee, arguments);
 }
 
-std::unique_ptr<ExprAST> AST::parse_expression(std::unique_ptr<ExprAST> lhs, SymbolTable& symbol_table, bool function_first)
+ExprAST* AST::parse_expression(ExprAST* lhs, SymbolTable& symbol_table, bool function_first, int min_precedence)
 {
     while (true) {
-        int op = token;
-        if (token == TOKEN_EOF || token == TOKEN_END_OF_STMT || token == ')' || token == ',') return lhs;
+        // anything that is not an operator ends the expression: the end of the statement, ')', ',' or keywords like Then and To
+        int op = binary_operator(token);
+        auto precedence = op_precedence.find(op);
+        if (precedence == op_precedence.end() || precedence->second < min_precedence) return lhs;
+        if (op == '=') function_first = false;
 
         token = lex->get_token();
-        std::unique_ptr<ExprAST> rhs = std::move(parse_primary_expression(symbol_table, op == '=' ? false : function_first));
+        ExprAST* rhs = parse_primary_expression(symbol_table, function_first);
 
-        while (token != TOKEN_EOF && token != TOKEN_END_OF_STMT && token != ')' &&
-            op_precedence.at(op) < op_precedence.at(token)) {
-            int next_op = token;
-            token = lex->get_token();
-            rhs = std::make_unique<BinaryExprAST>(next_op, std::move(rhs), parse_expression(std::move(parse_primary_expression(symbol_table, op == '=' ? false : function_first)), symbol_table, op == '=' ? false : function_first));
+        while (true) {
+            // operators binding tighter than `op` take the rhs first, assignments chain to the right
+            auto next = op_precedence.find(binary_operator(token));
+            if (next == op_precedence.end()) break;
+            if (next->second > precedence->second) rhs = parse_expression(rhs, symbol_table, function_first, precedence->second + 1);
+            else if (next->second == precedence->second && op == '=') rhs = parse_expression(rhs, symbol_table, function_first, precedence->second);
+            else break;
         }
 
-        lhs = std::make_unique<BinaryExprAST>(op, std::move(lhs), std::move(rhs));
+        lhs = arena.make<BinaryExprAST>(op, lhs, rhs);
     }
 }
 
-int AST::is_variable(SymbolTable& symbol_table, const std::string& name) {
-    if (symbol_table.contains(name)) {
+int AST::binary_operator(int token) const
+{
+    return token == '=' && in_condition ? TOKEN_EQUAL : token;
+}
+
+int AST::is_variable(SymbolTable& symbol_table, Symbol name) {
+    if (&symbol_table != &global_symbols && symbol_table.contains(name)) {
         auto range = symbol_table.equal_range(name);
         for (auto it = range.first; it != range.second; ++it) {
             if (is_variable_type(it->second)) return it->second;
@@ -239,7 +459,15 @@ int AST::is_variable(SymbolTable& symbol_table, const std::string& name) {
     if (!global_symbols.contains(name)) return 0;
     auto range = global_symbols.equal_range(name);
     for (auto it = range.first; it != range.second; ++it) {
-        if (is_variable_type(it->second)) return it->second;
+        if (is_variable_type(it->second)) {
+            if (log != nullptr) log->global_lookups.push_back(name);
+            return it->second;
+        }
     }
     return 0;
 }
+
+void AST::declare(SymbolTable& symbol_table, Symbol name, SymbolType type) {
+    symbol_table.insert({ name, type });
+    if (log != nullptr && &symbol_table == &global_symbols) log->declarations.push_back({ name, type });
+}
\ No newline at end of file
@@ -1,50 +1,83 @@
 #pragma once
 
+#include "Arena.h"
 #include "Lex.h"
 
-using SymbolTable = std::unordered_multimap<std::string, SymbolType>;
+using SymbolTable = std::unordered_multimap<Symbol, SymbolType>;
+
+class FunctionSignatureAST;
+
+enum ExprKind : uint8_t {
+    EXPR_CALL,
+    EXPR_VARIABLE,
+    EXPR_INTEGER,
+    EXPR_FLOAT,
+    EXPR_STRING,
+    EXPR_RETURN,
+    EXPR_UNARY,
+    EXPR_BINARY,
+    EXPR_IF,
+    EXPR_FOR,
+    EXPR_WHILE,
+    EXPR_REPEAT,
+    EXPR_FUNCTION_SIGNATURE,
+    EXPR_FUNCTION
+};
 
+// expression nodes and function arguments are allocated in the AST's arena and never destroyed one by one.
+// nodes are not polymorphic, use visit_expr or switch on `kind`
 class ExprAST {
 public:
-    virtual ~ExprAST() {}
+    const ExprKind kind;
+    // set by every pass of the semantic analyzer, CodeGen reads it instead of asking for the type again
+    mutable SymbolType type = SYMBOL_TYPE_UNRESOLVED;
+
+protected:
+    ExprAST(ExprKind kind) : kind(kind) {}
 };
 
 struct FunctionArgument {
 public:
-    const std::string name;
+    const Symbol name;
     const SymbolType type;
-    const std::unique_ptr<ExprAST> default_value;
+    ExprAST* const default_value;
 
-    FunctionArgument(std::string&& name, SymbolType type, std::unique_ptr<ExprAST> default_value) : name(std::move(name)), type(type), default_value(std::move(default_value)) {}
-    ~FunctionArgument() {}
+    FunctionArgument(Symbol name, SymbolType type, ExprAST* default_value) : name(name), type(type), default_value(default_value) {}
 };
 
 class CallExprAST : public ExprAST {
 public:
-    CallExprAST(std::string&& name, std::vector<std::unique_ptr<ExprAST>>&& arguments) : name(std::move(name)), arguments(std::move(arguments)) {}
+    CallExprAST(Symbol name, std::span<ExprAST*> arguments) : ExprAST(EXPR_CALL), name(name), arguments(arguments) {}
 
 private:
-    std::string name;
-    std::vector<std::unique_ptr<ExprAST>> arguments;
+    Symbol name;
+    std::span<ExprAST*> arguments;
+    mutable const FunctionSignatureAST* callee = nullptr; // the overload picked by the semantic analyzer
 
     friend class SemanticAnalyzer;
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
 class VariableExprAST : public ExprAST {
 public:
-    VariableExprAST(std::string&& name) : name(name) {}
+    VariableExprAST(Symbol name) : ExprAST(EXPR_VARIABLE), name(name) {}
 
 private:
-    std::string name;
+    Symbol name;
 
     friend class SemanticAnalyzer;
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
 class IntegerExprAST : public ExprAST {
 public:
-    IntegerExprAST(int value) : value(value) {
+    IntegerExprAST(int value) : ExprAST(EXPR_INTEGER), value(value) {
 
     }
 
@@ -52,11 +85,14 @@ private:
     const int value;
 
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
 class FloatExprAST : public ExprAST {
 public:
-    FloatExprAST(float value) : value(value) {
+    FloatExprAST(float value) : ExprAST(EXPR_FLOAT), value(value) {
 
     }
 
@@ -64,87 +100,230 @@ private:
     const float value;
 
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
 class StringExprAST : public ExprAST {
 public:
-    StringExprAST(std::string&& string) : string(string) {
+    StringExprAST(std::string_view string) : ExprAST(EXPR_STRING), string(string) {
 
     }
 
 private:
-    const std::string string;
+    const std::string_view string; // copied into the arena
 
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
 class ReturnExprAST : public ExprAST {
 public:
-    ReturnExprAST(std::unique_ptr<ExprAST> expr) : expr(std::move(expr)) {}
+    ReturnExprAST(ExprAST* expr) : ExprAST(EXPR_RETURN), expr(expr) {}
 
 private:
-    std::unique_ptr<ExprAST> expr;
+    ExprAST* expr;
 
     friend class SemanticAnalyzer;
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
 class UnaryExprAST : public ExprAST {
 public:
-    UnaryExprAST(int op, std::unique_ptr<ExprAST> expr) : op(op), expr(std::move(expr)) {}
+    UnaryExprAST(int op, ExprAST* expr) : ExprAST(EXPR_UNARY), op(op), expr(expr) {}
 
 private:
     int op;
-    std::unique_ptr<ExprAST> expr;
+    ExprAST* expr;
 
     friend class SemanticAnalyzer;
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
 class BinaryExprAST : public ExprAST {
 public:
-    BinaryExprAST(int op, std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs) : op(op), lhs(std::move(lhs)), rhs(std::move(rhs)) {
+    BinaryExprAST(int op, ExprAST* lhs, ExprAST* rhs) : ExprAST(EXPR_BINARY), op(op), lhs(lhs), rhs(rhs) {
 
     }
 
 private:
     int op;
-    std::unique_ptr<ExprAST> lhs;
-    std::unique_ptr<ExprAST> rhs;
+    ExprAST* lhs;
+    ExprAST* rhs;
+
+    friend class SemanticAnalyzer;
+    friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
+};
+
+// blocks are statement lists copied into the arena like call arguments.
+// an ElseIf is an If standing alone in the else body
+class IfExprAST : public ExprAST {
+public:
+    IfExprAST(ExprAST* condition, std::span<ExprAST*> then_body, std::span<ExprAST*> else_body) : ExprAST(EXPR_IF), condition(condition), then_body(then_body), else_body(else_body) {}
+
+private:
+    ExprAST* condition;
+    std::span<ExprAST*> then_body;
+    std::span<ExprAST*> else_body;
+
+    friend class SemanticAnalyzer;
+    friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
+};
+
+// the end is evaluated once before the first iteration, the step is an int or float literal
+class ForExprAST : public ExprAST {
+public:
+    ForExprAST(VariableExprAST* variable, ExprAST* start, ExprAST* end, ExprAST* step, std::span<ExprAST*> body) : ExprAST(EXPR_FOR), variable(variable), start(start), end(end), step(step), body(body) {}
+
+private:
+    VariableExprAST* variable;
+    ExprAST* start;
+    ExprAST* end;
+    ExprAST* step;
+    std::span<ExprAST*> body;
+
+    friend class SemanticAnalyzer;
+    friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
+};
+
+class WhileExprAST : public ExprAST {
+public:
+    WhileExprAST(ExprAST* condition, std::span<ExprAST*> body) : ExprAST(EXPR_WHILE), condition(condition), body(body) {}
+
+private:
+    ExprAST* condition;
+    std::span<ExprAST*> body;
+
+    friend class SemanticAnalyzer;
+    friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
+};
+
+// Repeat ... Until, the condition is null for Repeat ... Forever
+class RepeatExprAST : public ExprAST {
+public:
+    RepeatExprAST(std::span<ExprAST*> body, ExprAST* condition) : ExprAST(EXPR_REPEAT), body(body), condition(condition) {}
+
+private:
+    std::span<ExprAST*> body;
+    ExprAST* condition;
 
     friend class SemanticAnalyzer;
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
+// signatures and functions are few and own their tables, they stay on the heap
 class FunctionSignatureAST : public ExprAST {
 public:
-    FunctionSignatureAST(std::string name, SymbolType return_value_type) : name(name), return_value_type(return_value_type) {
+    FunctionSignatureAST(Symbol name, SymbolType return_value_type) : ExprAST(EXPR_FUNCTION_SIGNATURE), name(name), return_value_type(return_value_type) {
         this->symbol_table = {};
     }
 
-    std::string name;
+    Symbol name;
     SymbolType return_value_type;
-    std::vector<std::unique_ptr<FunctionArgument>> arguments;
+    std::vector<FunctionArgument*> arguments;
     SymbolTable symbol_table;
 
     friend class SemanticAnalyzer;
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
 
 class FunctionAST : public ExprAST {
 public:
-    FunctionAST(std::unique_ptr<FunctionSignatureAST> signature) : signature(std::move(signature)) {
+    FunctionAST(std::unique_ptr<FunctionSignatureAST> signature) : ExprAST(EXPR_FUNCTION), signature(std::move(signature)) {
     }
 
     std::unique_ptr<FunctionSignatureAST> signature;
-    std::vector<std::unique_ptr<ExprAST>> body;
+    std::vector<ExprAST*> body;
+    size_t order = 0; // definition order in the program, main is 0. diagnostics are reported in this order
 
     friend class SemanticAnalyzer;
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
+};
+
+// calls `visitor` with the node downcast to its concrete type, `visitor` is usually a generic lambda
+// forwarding to a set of overloads. all calls have to return the same type
+template<typename Visitor>
+decltype(auto) visit_expr(const ExprAST* expr, Visitor&& visitor) {
+    switch (expr->kind) {
+    case EXPR_CALL: return visitor(static_cast<const CallExprAST&>(*expr));
+    case EXPR_VARIABLE: return visitor(static_cast<const VariableExprAST&>(*expr));
+    case EXPR_INTEGER: return visitor(static_cast<const IntegerExprAST&>(*expr));
+    case EXPR_FLOAT: return visitor(static_cast<const FloatExprAST&>(*expr));
+    case EXPR_STRING: return visitor(static_cast<const StringExprAST&>(*expr));
+    case EXPR_RETURN: return visitor(static_cast<const ReturnExprAST&>(*expr));
+    case EXPR_UNARY: return visitor(static_cast<const UnaryExprAST&>(*expr));
+    case EXPR_BINARY: return visitor(static_cast<const BinaryExprAST&>(*expr));
+    case EXPR_IF: return visitor(static_cast<const IfExprAST&>(*expr));
+    case EXPR_FOR: return visitor(static_cast<const ForExprAST&>(*expr));
+    case EXPR_WHILE: return visitor(static_cast<const WhileExprAST&>(*expr));
+    case EXPR_REPEAT: return visitor(static_cast<const RepeatExprAST&>(*expr));
+    case EXPR_FUNCTION_SIGNATURE: return visitor(static_cast<const FunctionSignatureAST&>(*expr));
+    default: return visitor(static_cast<const FunctionAST&>(*expr));
+    }
+}
+
+using FunctionTable = std::unordered_multimap<Symbol, std::unique_ptr<FunctionAST>>;
+using ExternFunctionTable = std::unordered_map<Symbol, std::unique_ptr<FunctionSignatureAST>>;
+
+enum TopLevelKind {
+    TOP_LEVEL_NONE,
+    TOP_LEVEL_STATEMENT,
+    TOP_LEVEL_FUNCTION,
+    TOP_LEVEL_EXTERN,
+    TOP_LEVEL_INCLUDE
 };
 
-using FunctionTable = std::unordered_multimap<std::string, std::unique_ptr<FunctionAST>>;
-using ExternFunctionTable = std::unordered_map<std::string, std::unique_ptr<FunctionSignatureAST>>;
+struct TopLevelItem {
+    TopLevelKind kind;
+    size_t offset; // where the first token of the item starts in the lexer buffer
+    bool ends_at_eof = false; // the item was cut off by the end of the buffer instead of ending by itself
+    ExprAST* statement = nullptr;
+    FunctionAST* function = nullptr;
+    FunctionSignatureAST* extern_function = nullptr; // null if the name was already taken
+};
+
+// `Include "path"` at the top level, the included file's statements run where its Include stands
+struct Include {
+    size_t position; // index in the main body the included statements go before
+    std::string path; // as written, relative to the including file
+};
+
+// what a parse touched outside of its own function, lets Document tell which parts of a file depend on each other
+struct ParseLog {
+    std::vector<std::pair<Symbol, SymbolType>> declarations; // entries added to global_symbols
+    std::vector<Symbol> global_lookups;
+    std::vector<Symbol> calls;
+};
 
 class AST {
 public:
@@ -153,19 +332,44 @@ public:
     void parse();
 
 private:
-    std::unique_ptr<ExprAST> parse_expression(std::unique_ptr<ExprAST> lhs, SymbolTable& symbol_table, bool function_first = true);
-    std::unique_ptr<ExprAST> parse_primary_expression(SymbolTable& symbol_table, bool function_first = true);
-    std::unique_ptr<CallExprAST> parse_call_expression(const std::string callee, SymbolTable& symbol_table);
+    void check_duplicate_signature(const FunctionSignatureAST& signature);
+    std::unique_ptr<FunctionAST> create_main();
+    TopLevelItem parse_top_level(FunctionAST& main);
+    ExprAST* parse_statement(SymbolTable& symbol_table);
+    // statements up to the keyword that ends the block, which is left in `token`
+    std::span<ExprAST*> parse_block(SymbolTable& symbol_table);
+    ExprAST* parse_if(SymbolTable& symbol_table, bool chained = false);
+    ExprAST* parse_for(SymbolTable& symbol_table);
+    ExprAST* parse_condition(SymbolTable& symbol_table);
+    void expect_end_of_statement();
+    // stops at the first token that is not an operator binding at least as tight as `min_precedence`
+    ExprAST* parse_expression(ExprAST* lhs, SymbolTable& symbol_table, bool function_first = true, int min_precedence = 0);
+    int binary_operator(int token) const;
+    ExprAST* parse_primary_expression(SymbolTable& symbol_table, bool function_first = true);
+    CallExprAST* parse_call_expression(Symbol callee, SymbolTable& symbol_table);
     std::unique_ptr<FunctionSignatureAST> parse_function_signature();
-    void parse_function_definition();
-    int is_variable(SymbolTable& symbol_table, const std::string& name);
+    FunctionAST* parse_function_definition();
+    int is_variable(SymbolTable& symbol_table, Symbol name);
+    void declare(SymbolTable& symbol_table, Symbol name, SymbolType type);
 
     std::unique_ptr<Lex> lex;
+    Arena arena;
+    std::vector<ExprAST*> call_arguments; // arguments of the calls being parsed, copied into the arena once a call is complete
+    std::vector<ExprAST*> block_statements; // the same for the blocks being parsed
     SymbolTable global_symbols;
     FunctionTable function_table;
+    size_t defined_functions = 0; // the last FunctionAST::order handed out
     ExternFunctionTable extern_function_table;
+    std::vector<Include> includes;
     int token = 0;
+    bool in_condition = false; // '=' compares instead of assigning
+    ParseLog* log = nullptr;
 
     friend class SemanticAnalyzer;
     friend class CodeGen;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
+    friend class Document;
+    friend class Project;
 };
\ No newline at end of file
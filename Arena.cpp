@@ -0,0 +1,61 @@
+#include "Arena.h"
+#include <algorithm>
+
+size_t Arena::size() const
+{
+    if (chunks.empty()) return 0;
+    return chunks[current].filled_before + (cursor - (uintptr_t)chunks[current].data.get());
+}
+
+Arena::Mark Arena::mark() const
+{
+    if (chunks.empty()) return {};
+    return { current, cursor - (uintptr_t)chunks[current].data.get() };
+}
+
+void Arena::rewind(Mark mark)
+{
+    // chunks are kept, the next allocations reuse them
+    if (chunks.empty()) return;
+    current = mark.chunk;
+    cursor = (uintptr_t)chunks[current].data.get() + mark.offset;
+    limit = (uintptr_t)chunks[current].data.get() + chunks[current].size;
+}
+
+void Arena::merge(Arena&& other)
+{
+    if (other.chunks.empty()) return;
+    size_t merged = other.size();
+    // the merged chunks go in front of the current one so that they are never handed out again
+    size_t count = other.current + 1;
+    if (chunks.empty()) {
+        chunks = std::move(other.chunks);
+        current = other.current;
+        cursor = other.cursor;
+        limit = other.limit;
+    }
+    else {
+        chunks.insert(chunks.begin() + current, std::make_move_iterator(other.chunks.begin()), std::make_move_iterator(other.chunks.begin() + count));
+        current += count;
+        chunks[current].filled_before += merged;
+    }
+    other.chunks.clear();
+    other.current = 0;
+    other.cursor = other.limit = 0;
+}
+
+void* Arena::allocate_slow(size_t size, size_t alignment)
+{
+    size_t filled = this->size();
+    size_t next = chunks.empty() ? 0 : current + 1;
+    // chunks grow from 4 KiB up to 1 MiB so that tiny units stay tiny, larger requests get a chunk of their own
+    if (next == chunks.size() || chunks[next].size < size + alignment) {
+        size_t chunk_size = std::max(size + alignment, chunks.size() < 8 ? (size_t)4096 << chunks.size() : (size_t)1 << 20);
+        chunks.insert(chunks.begin() + next, { std::make_unique_for_overwrite<char[]>(chunk_size), chunk_size, 0 });
+    }
+    current = next;
+    chunks[current].filled_before = filled;
+    cursor = (uintptr_t)chunks[current].data.get();
+    limit = cursor + chunks[current].size;
+    return allocate(size, alignment);
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// bump-pointer storage for the nodes of a compilation unit, everything goes away at once with the arena.
+// destructors are never run, so what lives here may only refer to the arena itself or to interned symbols
+class Arena {
+public:
+    // a position to rewind to, everything allocated after it is dropped
+    struct Mark {
+        size_t chunk = 0;
+        size_t offset = 0;
+    };
+
+    Arena() = default;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template<typename T>
+    std::span<T> copy(std::span<const T> items) {
+        if (items.empty()) return {};
+        T* data = (T*)allocate(items.size_bytes(), alignof(T));
+        std::uninitialized_copy(items.begin(), items.end(), data);
+        return { data, items.size() };
+    }
+
+    std::string_view copy(std::string_view string) {
+        if (string.empty()) return {};
+        char* data = (char*)allocate(string.size(), 1);
+        std::memcpy(data, string.data(), string.size());
+        return { data, string.size() };
+    }
+
+    void* allocate(size_t size, size_t alignment) {
+        uintptr_t aligned = (cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (aligned + size > limit) return allocate_slow(size, alignment);
+        cursor = aligned + size;
+        return (void*)aligned;
+    }
+
+    // bytes taken from the chunks so far, alignment padding and abandoned chunk tails included
+    size_t size() const;
+    Mark mark() const;
+    void rewind(Mark mark);
+    // takes over the memory of `other`, marks taken before are no longer valid
+    void merge(Arena&& other);
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+        size_t filled_before; // size() at the start of this chunk
+    };
+
+    void* allocate_slow(size_t size, size_t alignment);
+
+    std::vector<Chunk> chunks;
+    size_t current = 0;
+    uintptr_t cursor = 0;
+    uintptr_t limit = 0;
+};
\ No newline at end of file
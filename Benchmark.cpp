@@ -0,0 +1,1009 @@
+#include "Benchmark.h"
+#include "CodeGen.h"
+#include "Interpreter.h"
+#include "Document.h"
+#include "ModuleCache.h"
+#include "Optimizer.h"
+#include "Lex.h"
+#include "LexScan.h"
+#include <llvm/IR/InstIterator.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Program.h>
+#include <algorithm>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// the native stdlib built to count its allocations, next to the one the interpreter loads
+#ifdef _WIN32
+constexpr const char* COUNTING_STDLIB = "ziyue4d_stdlib_counting.dll";
+#else
+constexpr const char* COUNTING_STDLIB = "libziyue4d_stdlib_counting.so";
+#endif
+
+static double peak_rss_megabytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// a mix of mixed-case identifiers, literals, comments and indentation resembling generated scripts
+static std::string generate_source(size_t lines) {
+    std::string source;
+    source.reserve(lines * 48);
+    for (size_t i = 0; i < lines; i++) {
+        std::string index = std::to_string(i);
+        switch (i % 6) {
+        case 0:
+            source += "Function ComputeValue" + index + "#(Alpha% = 1, beta# = 2.5, label$ = \"item\")\n";
+            break;
+        case 1:
+            source += "    intermediateResult" + index + "# = Alpha * 3.25 + beta / 1_000 - sqr(beta)\n";
+            break;
+        case 2:
+            source += "    message$ = label + \" produced a value of \" + intermediateResult" + index + "\n";
+            break;
+        case 3:
+            source += "    ; recompute the value so that the generated workload also exercises comments\n";
+            break;
+        case 4:
+            source += "    Return intermediateResult" + index + " : print(message)\n";
+            break;
+        default:
+            source += "End Function\n\n";
+            break;
+        }
+    }
+    return source;
+}
+
+void benchmark_lex(size_t lines)
+{
+    std::string source = generate_source(lines);
+    double megabytes = source.size() / (1024.0 * 1024.0);
+    std::cout << "lexing " << lines << " lines (" << megabytes << " MB)\n";
+    for (int kernel = SCAN_KERNEL_SCALAR; kernel <= best_scan_kernel(); kernel++) {
+        use_scan_kernel((ScanKernel)kernel);
+        double best_seconds = 0;
+        size_t token_count = 0;
+        for (int round = 0; round < 5; round++) {
+            Lex lex(llvm::MemoryBuffer::getMemBuffer(source, "benchmark", false));
+            token_count = 0;
+            auto start = std::chrono::steady_clock::now();
+            while (lex.get_token() != TOKEN_EOF) token_count++;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (round == 0 || seconds < best_seconds) best_seconds = seconds;
+        }
+        std::cout << scan_kernel_name((ScanKernel)kernel) << ": " << megabytes / best_seconds << " MB/s, "
+            << token_count << " tokens in " << best_seconds * 1000 << " ms\n";
+    }
+    use_scan_kernel(best_scan_kernel());
+}
+
+// `source` parsed, the source has to outlive the AST
+static std::unique_ptr<AST> parsed_program(std::string_view source) {
+    auto ast = std::make_unique<AST>(std::make_unique<Lex>(llvm::MemoryBuffer::getMemBuffer(source, "benchmark", false)));
+    ast->parse();
+    return ast;
+}
+
+// `source` parsed and analyzed, for the benchmarks that measure what comes after
+static std::unique_ptr<SemanticAnalyzer> analyzed_program(std::string_view source) {
+    auto semantic = std::make_unique<SemanticAnalyzer>(parsed_program(source));
+    semantic->analyze();
+    return semantic;
+}
+
+// analysis and code generation of `source`, timed separately
+struct FrontEndTimes {
+    double analysis_seconds;
+    double codegen_seconds;
+};
+
+static FrontEndTimes time_analysis_and_codegen(std::string_view source) {
+    auto semantic = std::make_unique<SemanticAnalyzer>(parsed_program(source));
+    auto start = std::chrono::steady_clock::now();
+    semantic->analyze();
+    double analysis_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CodeGen codegen(std::move(semantic));
+    codegen.print_ir = false;
+    start = std::chrono::steady_clock::now();
+    codegen.generate_functions();
+    double codegen_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return { analysis_seconds, codegen_seconds };
+}
+
+// small functions each followed by a global using it, unlike generate_source it has to pass the semantic analysis
+static std::string generate_program(size_t lines, const std::string& name = "Compute") {
+    std::string source;
+    for (size_t i = 0; i * 5 < lines; i++) {
+        std::string index = std::to_string(i);
+        source += "Function " + name + index + "#(alpha% = 1, beta# = 2.5)\n";
+        source += "    result# = alpha * 3.25 + beta / 1000\n";
+        source += "    Return result\n";
+        source += "End Function\n";
+        source += "total" + index + "# = " + name + index + "(2, 3.5)\n";
+    }
+    return source;
+}
+
+// an edit in the middle of the file should cost about the same whatever the file size is
+void benchmark_incremental(size_t lines)
+{
+    for (size_t size = std::max<size_t>(lines / 100, 5); ; size *= 10) {
+        std::string source = generate_program(size);
+        auto start = std::chrono::steady_clock::now();
+        Document document(source);
+        double full_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t offset = document.text().find("3.25", document.text().size() / 2);
+        double best_seconds = 0;
+        for (int round = 0; round < 20; round++) {
+            start = std::chrono::steady_clock::now();
+            document.edit({offset, 4, round % 2 ? "3.25" : "4.75"});
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (round == 0 || seconds < best_seconds) best_seconds = seconds;
+        }
+        std::cout << size << " lines: full check " << full_seconds * 1000 << " ms, edit " << best_seconds * 1000 << " ms\n";
+        if (size >= lines) break;
+    }
+}
+
+// run it in a fresh process, the peak RSS covers everything before the call too
+void benchmark_parse(size_t lines)
+{
+    std::string source = generate_program(lines);
+    double rss_before = peak_rss_megabytes();
+    auto start = std::chrono::steady_clock::now();
+    auto ast = parsed_program(source);
+    double parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double rss_after = peak_rss_megabytes();
+    start = std::chrono::steady_clock::now();
+    ast = nullptr;
+    double teardown_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << lines << " lines: parse " << parse_seconds * 1000 << " ms, teardown " << teardown_seconds * 1000
+        << " ms, peak RSS " << rss_after << " MB (" << rss_after - rss_before << " MB while parsing)\n";
+}
+
+// walks `nodes` expression nodes through the analyzer and the code generator
+void benchmark_nodes(size_t nodes)
+{
+    // each statement is 9 nodes: = value (+ (* alpha 3.25) (/ beta 1000)), each function adds 4 more
+    const size_t statements_per_function = 100;
+    std::string source;
+    size_t node_count = 0;
+    for (size_t i = 0; node_count < nodes; i++) {
+        source += "Function Compute" + std::to_string(i) + "#(alpha% = 1, beta# = 2.5)\n";
+        for (size_t j = 0; j < statements_per_function; j++) source += "    value# = alpha * 3.25 + beta / 1000\n";
+        source += "    Return value\nEnd Function\n";
+        node_count += statements_per_function * 9 + 4;
+    }
+    auto times = time_analysis_and_codegen(source);
+
+    double scale = 1000000.0 / node_count;
+    std::cout << node_count << " nodes: analysis " << times.analysis_seconds * 1000 << " ms, codegen " << times.codegen_seconds * 1000
+        << " ms, per 1M nodes " << times.analysis_seconds * scale * 1000 << " + " << times.codegen_seconds * scale * 1000 << " ms\n";
+}
+
+// single statements of 1000 up to `terms` additions each, the time per term should stay flat as the chain grows
+void benchmark_chain(size_t terms)
+{
+    for (size_t length = 1000; length <= terms; length *= 2) {
+        std::string source = "Function Chain#(alpha% = 1, beta# = 2.5)\n    value# = alpha";
+        for (size_t i = 1; i < length; i++) source += i % 2 ? " + beta" : " + alpha";
+        source += "\n    Return value\nEnd Function\n";
+        auto times = time_analysis_and_codegen(source);
+        double seconds = times.analysis_seconds + times.codegen_seconds;
+        std::cout << length << " terms: analysis and codegen " << seconds * 1000 << " ms, " << seconds * 1e6 / length << " us per term\n";
+    }
+}
+
+// `calls` call sites spread over four overloads of one name, most of the work is resolving and emitting the calls
+void benchmark_calls(size_t calls)
+{
+    std::string source =
+        "Function Blend#(alpha%)\n    Return alpha\nEnd Function\n"
+        "Function Blend#(alpha%, beta#, gamma# = 1.5)\n    Return alpha + beta * gamma\nEnd Function\n"
+        "Function Blend#(alpha%, beta%, gamma%, delta% = 2)\n    Return alpha + beta + gamma + delta\nEnd Function\n"
+        "Function Blend$(alpha$, beta$, gamma$, delta$, epsilon$)\n    Return alpha + epsilon\nEnd Function\n"
+        "Function Mix#(x%)\n";
+    const char* call_sites[] = { "Blend(x)", "Blend(x, 2.5)", "Blend(x, 2.5, 0.5)", "Blend(x, 1, 2)", "Blend(x, 1, 2, 3)" };
+    for (size_t i = 0; i < calls; i++) source += std::string("    value# = ") + call_sites[i % std::size(call_sites)] + "\n";
+    source += "    Return value\nEnd Function\n";
+    auto times = time_analysis_and_codegen(source);
+    std::cout << calls << " calls: analysis " << times.analysis_seconds * 1000 << " ms, codegen " << times.codegen_seconds * 1000 << " ms\n";
+}
+
+// `statements` statements full of literal arithmetic and concatenation, generated with and without the optimizer.
+// runtime calls are the string allocations and conversions the program would make
+void benchmark_optimizer(size_t statements)
+{
+    std::string source = "Function Describe$(count%)\n    unit$ = \"item\"\n    scale# = 2.5\n";
+    const char* lines[] = {
+        "    size% = 4 + 6 * (5 - (1))",
+        "    area# = size * scale + 1.0 / 4",
+        "    label$ = unit + \" \" + size + \" of \" + area",
+        "    1 + 1",
+        "    result$ = label + \"!\" + count"
+    };
+    for (size_t i = 0; i < statements; i++) source += std::string(lines[i % std::size(lines)]) + "\n";
+    source += "    Return result\nEnd Function\n";
+
+    for (bool optimize : { false, true }) {
+        auto semantic = analyzed_program(source);
+        auto start = std::chrono::steady_clock::now();
+        if (optimize) Optimizer(*semantic).optimize();
+        double optimize_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        CodeGen codegen(std::move(semantic));
+        codegen.print_ir = false;
+        start = std::chrono::steady_clock::now();
+        codegen.generate_functions();
+        double codegen_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t instructions = 0, runtime_calls = 0;
+        for (auto& function : codegen.generated_module()) {
+            for (auto& instruction : llvm::instructions(function)) {
+                instructions++;
+                auto call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+                if (call != nullptr && call->getCalledFunction() != nullptr && call->getCalledFunction()->isDeclaration()) runtime_calls++;
+            }
+        }
+        std::cout << statements << " statements, " << (optimize ? "optimized" : "unoptimized") << ": optimizer " << optimize_seconds * 1000
+            << " ms, codegen " << codegen_seconds * 1000 << " ms, " << instructions << " instructions, " << runtime_calls << " runtime calls\n";
+    }
+}
+
+// `calls` calls to a small float function from the top level. the accumulators carry over from one run to the
+// next, so the optimizer cannot compute the result ahead of time. there are several of them so that the calls are
+// not one long dependency chain
+static std::string mix_calls_program(size_t calls) {
+    std::string source = "Function Mix#(x#, y%)\n    t# = (x * 0.5) + y\n    Return (t * 0.25) - x\nEnd Function\n";
+    for (size_t i = 0; i < calls; i++) {
+        std::string acc = "acc" + std::to_string(i % 8);
+        source += acc + "# = Mix(" + acc + ", " + std::to_string(i % 7) + ")\n";
+    }
+    source += "Return 0\n";
+    return source;
+}
+
+// mix_calls_program compiled at -O0..-O3. the program is run many times once compiled so that what the
+// optimization level buys shows up next to what it costs
+void benchmark_jit(size_t calls)
+{
+    constexpr int RUNS = 1000;
+    std::string source = mix_calls_program(calls);
+
+    for (unsigned level = 0; level <= 3; level++) {
+        auto semantic = analyzed_program(source);
+
+        auto start = std::chrono::steady_clock::now();
+        if (level > 0) Optimizer(*semantic).optimize();
+        JIT jit(std::move(semantic));
+        jit.print_ir = false;
+        jit.optimization_level = level;
+        jit.generate_functions();
+        jit.init();
+        auto main = jit.compile();
+        double compile_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RUNS; i++) main();
+        double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << calls << " calls at -O" << level << ": compile " << compile_seconds * 1000 << " ms, run " << run_seconds * 1e6 / RUNS << " us\n";
+    }
+}
+
+// numeric loops of about `iterations` iterations each, compiled at -O0..-O3: a counted int reduction the vectorizer
+// can take, a float recurrence, a While loop full of branches and a nested loop
+void benchmark_loops(size_t iterations)
+{
+    constexpr int RUNS = 10;
+    std::string n = std::to_string(iterations);
+    std::string source =
+        "Function SumSquares%(n%)\n"
+        "    total% = 0\n"
+        "    For i% = 1 To n\n"
+        "        total = total + (i * i) - (i / 3)\n"
+        "    Next\n"
+        "    Return total\n"
+        "End Function\n"
+        "Function Harmonic#(n%)\n"
+        "    h# = 0.0\n"
+        "    For i% = 1 To n\n"
+        "        h# = h + (1.0 / i)\n"
+        "    Next\n"
+        "    Return h\n"
+        "End Function\n"
+        "Function Collatz%(n%)\n"
+        "    steps% = 0\n"
+        "    For start% = 1 To n\n"
+        "        x% = start\n"
+        "        While x > 1\n"
+        "            If x - ((x / 2) * 2) = 0 Then\n"
+        "                x = x / 2\n"
+        "            Else\n"
+        "                x = (x * 3) + 1\n"
+        "            EndIf\n"
+        "            steps = steps + 1\n"
+        "        Wend\n"
+        "    Next\n"
+        "    Return steps\n"
+        "End Function\n"
+        "Function Grid%(n%)\n"
+        "    count% = 0\n"
+        "    For y% = 0 To n - 1\n"
+        "        For x% = 0 To n - 1\n"
+        "            If (x * x) + (y * y) < n * n Then count = count + 1\n"
+        "        Next\n"
+        "    Next\n"
+        "    Return count\n"
+        "End Function\n"
+        "squares% = SumSquares(" + n + ")\n"
+        "harmonic# = Harmonic(" + n + ")\n"
+        "collatz% = Collatz(" + std::to_string(iterations / 100) + ")\n"
+        "grid% = Grid(" + std::to_string((size_t)std::sqrt((double)iterations)) + ")\n"
+        "Return 0\n";
+
+    for (unsigned level = 0; level <= 3; level++) {
+        auto semantic = analyzed_program(source);
+
+        auto start = std::chrono::steady_clock::now();
+        if (level > 0) Optimizer(*semantic).optimize();
+        JIT jit(std::move(semantic));
+        jit.print_ir = false;
+        jit.optimization_level = level;
+        jit.generate_functions();
+        jit.init();
+        auto main = jit.compile();
+        double compile_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RUNS; i++) main();
+        double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << iterations << " iterations at -O" << level << ": compile " << compile_seconds * 1000 << " ms, run " << run_seconds * 1000 / RUNS << " ms\n";
+    }
+}
+
+// what every analyzer pays before looking at the program: setting up the stdlib signatures
+void benchmark_startup(size_t runs)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; i++) SemanticAnalyzer analyzer(std::make_unique<AST>(nullptr));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << runs << " analyzers: " << seconds * 1000 << " ms, " << seconds * 1e6 / runs << " us each\n";
+}
+
+// analysis of a generated program with many functions, run with a growing number of threads
+void benchmark_analysis(size_t lines)
+{
+    std::string source = generate_program(lines);
+    auto ast = parsed_program(source);
+    SemanticAnalyzer analyzer(std::move(ast));
+
+    unsigned max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        auto start = std::chrono::steady_clock::now();
+        analyzer.analyze(threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << lines << " lines, " << threads << " threads: " << seconds * 1000 << " ms\n";
+        if (threads == max_threads) break;
+    }
+}
+
+// a root file including `files` generated files, parsed with a growing number of threads
+void benchmark_project(size_t files)
+{
+    auto directory = std::filesystem::temp_directory_path() / "ziyue4d_bench_project";
+    std::filesystem::create_directories(directory);
+    std::ofstream root(directory / "main.sb");
+    for (size_t i = 0; i < files; i++) {
+        std::string name = "part" + std::to_string(i) + ".sb";
+        root << "Include \"" << name << "\"\n";
+        std::ofstream(directory / name) << generate_program(20000, "Part" + std::to_string(i) + "x");
+    }
+    root.close();
+
+    unsigned max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        auto start = std::chrono::steady_clock::now();
+        auto ast = Project((directory / "main.sb").string()).parse(threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << files << " files, " << threads << " threads: " << seconds * 1000 << " ms\n";
+        if (threads == max_threads) break;
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// parsing and analyzing a file compared with loading it back from the cache
+void benchmark_cache(size_t lines)
+{
+    auto directory = std::filesystem::temp_directory_path() / "ziyue4d_bench_cache";
+    std::filesystem::create_directories(directory);
+    std::string root = (directory / "main.sb").string();
+    std::ofstream(root) << generate_program(lines);
+    ModuleCache cache(directory / "cache");
+
+    // the stdlib signatures are read by both paths, they are left out
+    auto start = std::chrono::steady_clock::now();
+    Project project(root);
+    auto parsed = project.parse();
+    double compile_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SemanticAnalyzer analyzer(std::move(parsed));
+    start = std::chrono::steady_clock::now();
+    analyzer.analyze();
+    compile_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    cache.store(root, analyzer, project.sources());
+    double store_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    auto ast = cache.load(root);
+    double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SemanticAnalyzer loaded(std::move(ast));
+    std::cout << lines << " lines: parse and analysis " << compile_seconds * 1000 << " ms, store " << store_seconds * 1000
+        << " ms, load " << load_seconds * 1000 << " ms\n";
+    std::filesystem::remove_all(directory);
+}
+
+// startup of a small program started `runs` times as a process: through the driver, which JIT compiles it on every
+// run, and as an executable compiled ahead of time. the output of both is discarded
+void benchmark_aot(size_t runs)
+{
+    std::string source =
+        "Function Fib%(n%)\n"
+        "    If n < 2 Then Return n\n"
+        "    Return Fib(n - 1) + Fib(n - 2)\n"
+        "End Function\n"
+        "print(\"fib \" + Fib(20))\n"
+        "Return 0\n";
+    auto directory = std::filesystem::temp_directory_path() / "ziyue4d_bench_aot";
+    std::filesystem::create_directories(directory);
+    auto script = directory / "main.sb", object = directory / "main.o";
+#ifdef _WIN32
+    auto executable = directory / "main.exe";
+#else
+    auto executable = directory / "main";
+#endif
+    std::ofstream(script) << source;
+
+    auto start = std::chrono::steady_clock::now();
+    auto semantic = analyzed_program(source);
+    Optimizer(*semantic).optimize();
+    AOT aot(std::move(semantic));
+    aot.print_ir = false;
+    aot.generate_functions();
+    aot.emit_object(object);
+    AOT::link_executable(object, executable);
+    double compile_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "ahead of time compilation and linking: " << compile_seconds * 1000 << " ms\n";
+
+    std::string driver = llvm::sys::fs::getMainExecutable(nullptr, nullptr), script_path = script.string(), executable_path = executable.string();
+    std::optional<llvm::StringRef> discard[] = { std::nullopt, llvm::StringRef(), llvm::StringRef() };
+    auto time_runs = [&](const char* name, llvm::ArrayRef<llvm::StringRef> arguments) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < runs; i++) {
+            if (llvm::sys::ExecuteAndWait(arguments[0], arguments, std::nullopt, discard) < 0) {
+                std::cout << name << ": failed to start " << arguments[0].str() << "\n";
+                return;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << runs << " runs " << name << ": " << seconds * 1000 / runs << " ms each\n";
+    };
+    time_runs("through the JIT", { driver, "--no-cache", script_path });
+    time_runs("compiled ahead of time", { executable_path });
+    std::filesystem::remove_all(directory);
+}
+
+// JIT compilation of mix_calls_program: without the object cache, into an empty one and from a warm one
+void benchmark_object_cache(size_t calls)
+{
+    std::string source = mix_calls_program(calls);
+    auto directory = std::filesystem::temp_directory_path() / "ziyue4d_bench_objects";
+    std::filesystem::remove_all(directory);
+
+    const char* runs[] = { "no cache", "cold cache", "warm cache" };
+    for (int run = 0; run < 3; run++) {
+        auto semantic = analyzed_program(source);
+        Optimizer(*semantic).optimize();
+
+        auto start = std::chrono::steady_clock::now();
+        JIT jit(std::move(semantic));
+        jit.print_ir = false;
+        if (run > 0) jit.object_cache_directory = directory;
+        jit.generate_functions();
+        jit.init();
+        jit.compile();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << calls << " calls, " << runs[run] << ": compile " << seconds * 1000 << " ms";
+        if (auto objects = jit.object_cache()) std::cout << ", " << objects->hits() << " hits, " << objects->misses() << " misses";
+        std::cout << '\n';
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// time to the first output of a program of `functions` functions of which only one is called, compiled up front and
+// lazily at -O2
+void benchmark_lazy(size_t functions)
+{
+    std::string source;
+    for (size_t i = 0; i < functions; i++) {
+        std::string n = std::to_string(i);
+        source +=
+            "Function Rare" + n + "%(n%)\n"
+            "    total% = 0\n"
+            "    For i% = 1 To n\n"
+            "        If i - ((i / 3) * 3) = 0 Then total = total + (i * " + n + ") Else total = total - i\n"
+            "    Next\n"
+            "    Return total\n"
+            "End Function\n";
+    }
+    source += "print(\"first \" + Rare0(10))\nReturn 0\n";
+
+    for (bool lazy : { false, true }) {
+        auto semantic = analyzed_program(source);
+        Optimizer(*semantic).optimize();
+
+        auto start = std::chrono::steady_clock::now();
+        JIT jit(std::move(semantic));
+        jit.print_ir = false;
+        jit.lazy = lazy;
+        jit.generate_functions();
+        jit.init();
+        jit.run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << '\n' << functions << " functions, " << (lazy ? "lazy" : "up front") << ": first output after " << seconds * 1000 << " ms\n";
+    }
+}
+
+// source to running code for a program of `functions` functions that are all called, at -O2 with a growing number of
+// partitions and compile threads
+void benchmark_partitions(size_t functions)
+{
+    std::string source;
+    for (size_t i = 0; i < functions; i++) {
+        std::string n = std::to_string(i);
+        source +=
+            "Function Part" + n + "%(n%)\n"
+            "    total% = 0\n"
+            "    For i% = 1 To n\n"
+            "        total = total + (i * " + n + ") - (i / 7)\n"
+            "    Next\n"
+            "    Return total\n"
+            "End Function\n"
+            "sum% = sum + Part" + n + "(" + std::to_string(i % 13) + ")\n";
+    }
+    source += "Return sum\n";
+
+    unsigned max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        auto start = std::chrono::steady_clock::now();
+        auto semantic = std::make_unique<SemanticAnalyzer>(parsed_program(source));
+        semantic->analyze(threads);
+        Optimizer(*semantic).optimize();
+        JIT jit(std::move(semantic));
+        jit.print_ir = false;
+        jit.partition_count = threads;
+        jit.compile_threads = threads > 1 ? threads : 0;
+        jit.generate_functions();
+        jit.init();
+        int result = jit.run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << functions << " functions, " << threads << " threads: " << seconds * 1000 << " ms, result " << result << '\n';
+        if (threads == max_threads) break;
+    }
+}
+
+// source to result of a program calling a small function a growing number of times, up to `calls`: compiled by the JIT
+// up front, interpreted only, and interpreted until the function gets hot. where the JIT starts to win is the crossover
+void benchmark_interpreter(size_t calls)
+{
+    enum Mode { MODE_JIT, MODE_INTERPRETER, MODE_TIERED };
+    auto time_run = [](size_t count, Mode mode, int& result) {
+        std::string source =
+            "Function Work%(n%)\n"
+            "    total% = 0\n"
+            "    For i% = 1 To 20\n"
+            "        total = total + (i * n) - (i / 7)\n"
+            "    Next\n"
+            "    Return total\n"
+            "End Function\n"
+            "sum% = 0\n"
+            "For k% = 1 To " + std::to_string(count) + "\n"
+            "    sum = sum + Work(k)\n"
+            "Next\n"
+            "Return sum\n";
+        std::shared_ptr<SemanticAnalyzer> semantic = analyzed_program(source);
+        Optimizer(*semantic).optimize();
+
+        auto start = std::chrono::steady_clock::now();
+        if (mode == MODE_JIT) {
+            JIT jit(semantic);
+            jit.print_ir = false;
+            jit.generate_functions();
+            jit.init();
+            result = jit.run();
+        }
+        else {
+            Interpreter interpreter(semantic);
+            interpreter.tier_up_threshold = mode == MODE_TIERED ? 1000 : 0;
+            result = interpreter.run();
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    size_t crossover = 0;
+    for (size_t count = 1; count <= calls; count *= 10) {
+        int results[3];
+        double jit_seconds = time_run(count, MODE_JIT, results[0]);
+        double interpreter_seconds = time_run(count, MODE_INTERPRETER, results[1]);
+        double tiered_seconds = time_run(count, MODE_TIERED, results[2]);
+        std::cout << count << " calls: JIT " << jit_seconds * 1000 << " ms, interpreter " << interpreter_seconds * 1000 <<
+            " ms, tiered " << tiered_seconds * 1000 << " ms" << (results[0] == results[1] && results[0] == results[2] ? "" : ", results differ!") << '\n';
+        if (crossover == 0 && jit_seconds < interpreter_seconds) crossover = count;
+    }
+    if (crossover != 0) std::cout << "the JIT pays off from about " << crossover << " calls on\n";
+    else std::cout << "the interpreter stays ahead up to " << calls << " calls\n";
+}
+
+void benchmark_literals(size_t iterations)
+{
+    // every iteration evaluates literals, assigns them, passes one back and compares them
+    std::string source =
+        "Function Label$(n%)\n"
+        "    If n < 10 Then\n"
+        "        Return \"small\"\n"
+        "    EndIf\n"
+        "    Return \"large\"\n"
+        "End Function\n"
+        "count% = 0\n"
+        "For i% = 1 To " + std::to_string(iterations) + "\n"
+        "    s$ = \"small\"\n"
+        "    t$ = Label(i)\n"
+        "    If s = t Then count = count + 1\n"
+        "    If t = \"large\" Then count = count + 1\n"
+        "Next\n"
+        "Return count\n";
+    std::shared_ptr<SemanticAnalyzer> semantic = analyzed_program(source);
+    Optimizer(*semantic).optimize();
+
+    JIT jit(semantic);
+    jit.print_ir = false;
+    jit.generate_functions();
+    jit.init();
+    auto main = jit.compile();
+    auto start = std::chrono::steady_clock::now();
+    int jit_result = main();
+    double jit_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Interpreter interpreter(semantic);
+    interpreter.tier_up_threshold = 0;
+    start = std::chrono::steady_clock::now();
+    int interpreter_result = interpreter.run();
+    double interpreter_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << iterations << " iterations: JIT " << jit_seconds * 1e9 / iterations << " ns, interpreter " <<
+        interpreter_seconds * 1e9 / iterations << " ns per iteration" << (jit_result == interpreter_result ? "" : ", results differ!") << '\n';
+}
+
+// a counter of the native stdlib built to count its strings, null without it. it is loaded before the native stdlib,
+// so that the interpreter and the JIT code call its functions
+static int (*string_counter(const char* name))() {
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(std::filesystem::absolute(COUNTING_STDLIB).string().c_str());
+    auto counter = reinterpret_cast<int (*)()>(llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(name));
+    if (counter == nullptr) std::cerr << "cannot load " << COUNTING_STDLIB << ", rebuild the stdlib target\n";
+    return counter;
+}
+
+void benchmark_strings(size_t iterations)
+{
+    auto string_allocations = string_counter("_ziyue4d_string_allocations__");
+    if (string_allocations == nullptr) return;
+    struct Workload {
+        const char* name;
+        const char* body;
+    };
+    const Workload workloads[] = {
+        { "append literal", "    s$ = s + \"x\"\n" },
+        { "append numbers", "    s$ = s + i + \",\"\n" },
+        { "assign and pass", "    t$ = Pass(s)\n    u$ = t\n" },
+        { "concatenate", "    t$ = \"<\" + s + \">\"\n" },
+    };
+    for (const Workload& workload : workloads) {
+        std::string source =
+            "Function Pass$(a$)\n"
+            "    Return a\n"
+            "End Function\n"
+            // not a constant the optimizer could fold the workload with
+            "s$ = Pass(\"start\")\n"
+            "For i% = 1 To " + std::to_string(iterations) + "\n" +
+            workload.body +
+            "Next\n"
+            "Return 0\n";
+        std::shared_ptr<SemanticAnalyzer> semantic = analyzed_program(source);
+        Optimizer(*semantic).optimize();
+
+        Interpreter interpreter(semantic);
+        interpreter.tier_up_threshold = 0;
+        JIT jit(semantic);
+        jit.print_ir = false;
+        jit.link_stdlib = false;
+        jit.generate_functions();
+        jit.init();
+        auto main = jit.compile();
+
+        int before = string_allocations();
+        auto start = std::chrono::steady_clock::now();
+        main();
+        double jit_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        int jit_allocations = string_allocations() - before;
+
+        before = string_allocations();
+        start = std::chrono::steady_clock::now();
+        interpreter.run();
+        double interpreter_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        int interpreter_allocations = string_allocations() - before;
+
+        std::cout << workload.name << ": JIT " << jit_seconds * 1e9 / iterations << " ns and " << double(jit_allocations) / iterations <<
+            " allocations, interpreter " << interpreter_seconds * 1e9 / iterations << " ns and " << double(interpreter_allocations) / iterations <<
+            " allocations per iteration\n";
+    }
+}
+
+// string variables own their strings: a loop making, passing and dropping strings leaves as many strings as there were
+// before it, and does not have more of them at once the longer it runs. in the JIT and in the interpreter alike
+bool check_strings()
+{
+    auto live_strings = string_counter("_ziyue4d_live_strings__");
+    auto peak_live_strings = string_counter("_ziyue4d_peak_live_strings__");
+    if (live_strings == nullptr || peak_live_strings == nullptr) return false;
+    struct Workload {
+        const char* name;
+        const char* body;
+    };
+    const Workload workloads[] = {
+        { "append", "    s$ = s + i + \",\"\n" },
+        { "assign and pass", "    t$ = Pass(s + i)\n    u$ = t\n    t$ = u + t\n" },
+        { "compare", "    If Pass(t + i) = u Then print(u)\n    u$ = t + i\n" },
+        { "self-append", "    t$ = s + i\n    t$ = t + t + t + t\n    u$ = t\n    t$ = t + u\n    t$ = t + t\n" },
+    };
+    const char* engines[] = { "JIT", "interpreter" };
+    const size_t iterations = 100;
+    bool passed = true;
+    for (const Workload& workload : workloads) {
+        int peaks[2][2]; // of each engine, running the loop `iterations << size` times
+        for (size_t size = 0; size < 2; size++) {
+            std::string source =
+                "Function Pass$(a$)\n"
+                "    Return a\n"
+                "End Function\n"
+                "s$ = Pass(\"start\")\n"
+                "t$ = \"\"\n"
+                "u$ = \"\"\n"
+                "For i% = 1 To " + std::to_string(iterations << size) + "\n" +
+                workload.body +
+                "Next\n"
+                "Return 0\n";
+            std::shared_ptr<SemanticAnalyzer> semantic = analyzed_program(source);
+            Optimizer(*semantic).optimize();
+
+            Interpreter interpreter(semantic);
+            interpreter.tier_up_threshold = 0;
+            JIT jit(semantic);
+            jit.print_ir = false;
+            jit.link_stdlib = false;
+            jit.generate_functions();
+            jit.init();
+            auto main = jit.compile();
+
+            auto measure = [&](int engine, auto&& run) {
+                int before = live_strings();
+                peak_live_strings();
+                run();
+                peaks[engine][size] = peak_live_strings() - before;
+                if (int left = live_strings() - before) {
+                    std::cout << workload.name << ": " << engines[engine] << " left " << left << " strings behind after " <<
+                        (iterations << size) << " iterations\n";
+                    passed = false;
+                }
+            };
+            measure(0, [&] { main(); });
+            measure(1, [&] { interpreter.run(); });
+        }
+        for (int engine = 0; engine < 2; engine++) {
+            // then it called a stdlib that does not count
+            if (peaks[engine][0] == 0) {
+                std::cout << workload.name << ": " << engines[engine] << " counted no strings\n";
+                passed = false;
+            }
+            else if (peaks[engine][1] > peaks[engine][0]) {
+                std::cout << workload.name << ": " << engines[engine] << " had " << peaks[engine][0] << " strings at once in " <<
+                    iterations << " iterations, " << peaks[engine][1] << " in " << iterations * 2 << "\n";
+                passed = false;
+            }
+        }
+    }
+    return passed;
+}
+
+// the IR generated from `semantic`, as lines in sorted order, so that the order the functions come in does not matter
+static std::vector<std::string> generated_lines(SemanticAnalyzer& semantic) {
+    CodeGen codegen(std::shared_ptr<SemanticAnalyzer>(std::shared_ptr<void>(), &semantic));
+    codegen.print_ir = false;
+    codegen.generate_functions();
+    std::string ir;
+    llvm::raw_string_ostream stream(ir);
+    codegen.generated_module().print(stream, nullptr);
+    stream.flush();
+    std::vector<std::string> lines;
+    for (size_t begin = 0, end; begin < ir.size(); begin = end + 1) {
+        end = ir.find('\n', begin);
+        if (end == std::string::npos) end = ir.size();
+        lines.push_back(ir.substr(begin, end - begin));
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+// a Document after each edit generates what a fresh Document of the edited text does. the edits are those that once
+// told them apart: a bare Return, and externs sharing a name
+bool check_incremental()
+{
+    struct Edit {
+        std::string_view from; // the first occurrence is replaced
+        std::string_view to;
+    };
+    struct Case {
+        const char* name;
+        const char* source;
+        std::vector<Edit> edits;
+    };
+    const Case cases[] = {
+        {
+            "bare Return",
+            "Function Grow%(n%)\n"
+            "    If n > 3 Then Return n + 1\n"
+            "    Return n * 2\n"
+            "End Function\n"
+            "total% = Grow(2) + Grow(5)\n"
+            "Return total\n",
+            { { "Return n + 1", "Return" }, { "Then Return\n", "Then Return n + 1\n" } },
+        },
+        {
+            "duplicate Extern",
+            "Extern Twice%(a%)\n"
+            "y% = 1\n"
+            "Extern Twice#(a#)\n"
+            "x# = Twice(2)\n"
+            "Return 0\n",
+            { { "Twice%(a%)", "Twice%(b%)" }, { "Extern Twice%(b%)\n", "" }, { "y% = 1\n", "Extern Twice%(a%)\ny% = 1\n" } },
+        },
+    };
+    bool passed = true;
+    for (const Case& check : cases) {
+        Document document(check.source);
+        for (size_t step = 0; step <= check.edits.size(); step++) {
+            if (step > 0) {
+                const Edit& edit = check.edits[step - 1];
+                document.edit({ document.text().find(edit.from), edit.from.size(), std::string(edit.to) });
+            }
+            Document fresh(document.text());
+            if (generated_lines(document.analyzer()) != generated_lines(fresh.analyzer())) {
+                std::cout << check.name << ": the edited document differs from a fresh one after " << step << " edits of\n" << check.source;
+                passed = false;
+            }
+        }
+    }
+    return passed;
+}
+
+void benchmark_numbers(size_t iterations)
+{
+    auto int_to_string = reinterpret_cast<const ZString* (*)(int32_t)>(Interpreter::native_stdlib_function("_ziyue4d_int_to_string__"));
+    auto float_to_string = reinterpret_cast<const ZString* (*)(float)>(Interpreter::native_stdlib_function("_ziyue4d_float_to_string__"));
+    auto string_to_int = reinterpret_cast<int32_t (*)(const ZString*)>(Interpreter::native_stdlib_function("_ziyue4d_int"));
+    auto string_to_float = reinterpret_cast<float (*)(const ZString*)>(Interpreter::native_stdlib_function("_ziyue4d_float"));
+    auto release_string = reinterpret_cast<void (*)(const ZString*)>(Interpreter::native_stdlib_function("_ziyue4d_release_string__"));
+    auto per_call = [iterations](auto&& call) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) call(i);
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / iterations;
+    };
+
+    // numbers of all lengths, as strings of the runtime and as text for the C library
+    constexpr size_t count = 1024;
+    std::vector<int32_t> ints;
+    std::vector<float> floats;
+    std::vector<const ZString*> int_strings, float_strings;
+    std::vector<std::string> int_texts, float_texts;
+    for (size_t i = 0; i < count; i++) {
+        ints.push_back(int32_t(uint32_t(i * 2654435761u) >> (i % 32)));
+        floats.push_back(std::ldexp(float(ints.back()), int(i % 40) - 30));
+        int_strings.push_back(int_to_string(ints.back()));
+        float_strings.push_back(float_to_string(floats.back()));
+        int_texts.push_back(std::to_string(ints.back()));
+        float_texts.push_back(std::to_string(floats.back()));
+    }
+    volatile size_t sink = 0;
+    auto report = [](const char* name, double runtime, const char* library_name, double library) {
+        std::cout << name << ": runtime " << runtime << " ns, " << library_name << ' ' << library << " ns per call\n";
+    };
+    report("int to string", per_call([&](size_t i) { release_string(int_to_string(ints[i % count])); }),
+        "std::to_string", per_call([&](size_t i) { sink = sink + std::to_string(ints[i % count]).size(); }));
+    report("float to string", per_call([&](size_t i) { release_string(float_to_string(floats[i % count])); }),
+        "std::to_string", per_call([&](size_t i) { sink = sink + std::to_string(floats[i % count]).size(); }));
+    report("string to int", per_call([&](size_t i) { sink = sink + string_to_int(int_strings[i % count]); }),
+        "atoi", per_call([&](size_t i) { sink = sink + atoi(int_texts[i % count].c_str()); }));
+    report("string to float", per_call([&](size_t i) { sink = sink + size_t(string_to_float(float_strings[i % count])); }),
+        "strtof", per_call([&](size_t i) { sink = sink + size_t(strtof(float_texts[i % count].c_str(), nullptr)); }));
+    for (size_t i = 0; i < count; i++) {
+        release_string(int_strings[i]);
+        release_string(float_strings[i]);
+    }
+
+    // literals parsed where they are in the source
+    std::string source;
+    for (size_t i = 0; i < iterations; i++) {
+        source += i % 2 == 0 ? std::to_string(ints[i % count] & INT32_MAX) : std::to_string(std::fabs(floats[i % count]));
+        source += ' ';
+    }
+    Lex lex(llvm::MemoryBuffer::getMemBuffer(source, "benchmark", false));
+    size_t literals = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int token = lex.get_token(); token != TOKEN_EOF; token = lex.get_token()) literals++;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "number literals: " << seconds * 1e9 / literals << " ns per literal lexed\n";
+}
+
+void benchmark_inline_stdlib(size_t iterations)
+{
+    // calls of tiny stdlib wrappers in a hot loop
+    const char* workloads[] = { "sqr(i)", "sqr(i) + sin(i)" };
+    for (const char* workload : workloads) {
+        std::string source =
+            "total# = 0\n"
+            "For i% = 1 To " + std::to_string(iterations) + "\n"
+            "    total# = total + " + workload + "\n"
+            "Next\n"
+            "If total > 1000 Then Return 1\n"
+            "Return 0\n";
+        std::shared_ptr<SemanticAnalyzer> semantic = analyzed_program(source);
+        Optimizer(*semantic).optimize();
+
+        double compile_seconds[2], seconds[2];
+        int results[2];
+        for (bool inline_stdlib : { false, true }) {
+            JIT jit(semantic);
+            jit.print_ir = false;
+            jit.inline_stdlib = inline_stdlib;
+            auto start = std::chrono::steady_clock::now();
+            jit.generate_functions();
+            jit.init();
+            auto main = jit.compile();
+            compile_seconds[inline_stdlib] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            start = std::chrono::steady_clock::now();
+            results[inline_stdlib] = main();
+            seconds[inline_stdlib] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        std::cout << workload << ": stdlib apart " << compile_seconds[0] * 1000 << " ms to compile and " << seconds[0] * 1e9 / iterations <<
+            " ns per iteration, inlined " << compile_seconds[1] * 1000 << " ms and " << seconds[1] * 1e9 / iterations << " ns" <<
+            (results[0] == results[1] ? "" : ", results differ!") << '\n';
+    }
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// benchmarks reachable from the driver, results are printed to stdout
+void benchmark_lex(size_t lines);
+void benchmark_incremental(size_t lines);
+void benchmark_parse(size_t lines);
+void benchmark_nodes(size_t nodes);
+void benchmark_chain(size_t terms);
+void benchmark_calls(size_t calls);
+void benchmark_analysis(size_t lines);
+void benchmark_optimizer(size_t statements);
+void benchmark_jit(size_t calls);
+void benchmark_object_cache(size_t calls);
+void benchmark_lazy(size_t functions);
+void benchmark_partitions(size_t functions);
+void benchmark_loops(size_t iterations);
+void benchmark_project(size_t files);
+void benchmark_cache(size_t lines);
+void benchmark_startup(size_t runs);
+void benchmark_aot(size_t runs);
+void benchmark_interpreter(size_t calls);
+void benchmark_literals(size_t iterations);
+void benchmark_strings(size_t iterations);
+void benchmark_numbers(size_t iterations);
+void benchmark_inline_stdlib(size_t iterations);
+
+// checks reachable from the driver, they print what they find wrong and return whether nothing was
+bool check_strings();
+bool check_incremental();
\ No newline at end of file
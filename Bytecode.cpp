@@ -0,0 +1,634 @@
+#include "Bytecode.h"
+#include "CodeGen.h"
+#include "exceptions.h"
+#include <bit>
+#include <cassert>
+
+std::unique_ptr<BytecodeProgram> BytecodeCompiler::compile()
+{
+    program = std::make_unique<BytecodeProgram>();
+    for (const auto& symbol : ast.global_symbols) {
+        if (symbol.second != SYMBOL_TYPE_INT && symbol.second != SYMBOL_TYPE_FLOAT && symbol.second != SYMBOL_TYPE_STRING) continue;
+        // like in CodeGen, a name declared twice is the first declaration
+        if (globals.contains(symbol.first)) continue;
+        if (program->globals.size() == UINT16_MAX) throw codegen_exception("the program has more globals than the interpreter can address");
+        globals.emplace(symbol.first, Variable{ true, uint16_t(program->globals.size()), kind_of(symbol.second) });
+        program->globals.push_back({ symbol.first, symbol.second });
+    }
+    // calls may come before their callee, so every function is numbered first
+    for (auto& func : ast.function_table) {
+        if (program->functions.size() == UINT16_MAX) throw codegen_exception("the program has more functions than the interpreter can address");
+        if (func.second->signature->name == MAIN_SYMBOL) program->main = uint16_t(program->functions.size());
+        functions.emplace(func.second->signature.get(), uint16_t(program->functions.size()));
+        program->functions.push_back({ func.second->signature.get() });
+    }
+    size_t index = 0;
+    for (auto& func : ast.function_table) compile_function(*func.second, program->functions[index++]);
+    return std::move(program);
+}
+
+void BytecodeCompiler::compile_function(const FunctionAST& func, BytecodeFunction& target)
+{
+    function = &target;
+    current_signature = func.signature.get();
+    locals.clear();
+    next_register = 0;
+    last_label = 0;
+    terminated = false;
+    // the arguments take the first registers, calls copy them there
+    for (const auto& arg : current_signature->arguments) {
+        if (!locals.contains(arg->name)) locals.emplace(arg->name, Variable{ false, allocate(), kind_of(arg->type) });
+    }
+    for (const auto& symbol : current_signature->symbol_table) {
+        if (symbol.second != SYMBOL_TYPE_INT && symbol.second != SYMBOL_TYPE_FLOAT && symbol.second != SYMBOL_TYPE_STRING) continue;
+        if (!locals.contains(symbol.first)) locals.emplace(symbol.first, Variable{ false, allocate(), kind_of(symbol.second) });
+    }
+    variable_count = next_register;
+    for (const auto& symbol : current_signature->symbol_table) {
+        auto variable = locals.find(symbol.first);
+        bool is_argument = std::any_of(current_signature->arguments.begin(), current_signature->arguments.end(),
+            [&symbol](const FunctionArgument* arg) { return arg->name == symbol.first; });
+        if (variable == locals.end() || is_argument) continue;
+        set_default(variable->second.index, symbol.second);
+        if (symbol.second == SYMBOL_TYPE_STRING) owned_strings.push_back(variable->second);
+    }
+    // string arguments are borrowed from the caller, unless the function assigns them
+    for (const auto& arg : current_signature->arguments) {
+        if (arg->type != SYMBOL_TYPE_STRING || !CodeGen::is_assigned(func.body, arg->name)) continue;
+        const Variable& variable = locals.at(arg->name);
+        emit(OP_RETAIN_STRING, variable.index, variable.index);
+        owned_strings.push_back(variable);
+    }
+    // main owns the global strings
+    if (current_signature->name == MAIN_SYMBOL) {
+        for (const auto& global : globals) {
+            if (global.second.kind != VALUE_POINTER) continue;
+            emit(OP_STORE_GLOBAL, global.second.index, default_value(SYMBOL_TYPE_STRING).reg);
+            owned_strings.push_back(global.second);
+        }
+        next_register = variable_count;
+    }
+
+    compile_block(func.body);
+    if (!terminated) {
+        release_lifecycle_resources();
+        compile_default_return();
+    }
+    current_signature = nullptr;
+    owned_strings.clear();
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::visit(const ExprAST* expr)
+{
+    return visit_expr(expr, [this](const auto& node) { return compile(node); });
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const FloatExprAST& float_expr)
+{
+    Operand result{ allocate(), VALUE_FLOAT };
+    emit_immediate(OP_FLOAT, result.reg, std::bit_cast<int32_t>(float_expr.value));
+    return result;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const IntegerExprAST& int_expr)
+{
+    Operand result{ allocate(), VALUE_INT };
+    emit_immediate(OP_INT, result.reg, int_expr.value);
+    return result;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const StringExprAST& string)
+{
+    Operand result{ allocate(), VALUE_POINTER, true };
+    emit(OP_STRING, result.reg, literal(string.string));
+    return result;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const UnaryExprAST& unary_expr)
+{
+    Operand value = visit(unary_expr.expr);
+    bool is_int = unary_expr.expr->type == SYMBOL_TYPE_INT;
+    switch (unary_expr.op) {
+    case TOKEN_LOGIC_NOT:
+    {
+        Operand result{ allocate(), VALUE_INT };
+        emit(is_int ? OP_NOT_INT : OP_NOT_FLOAT, result.reg, value.reg);
+        return result;
+    }
+    case '-':
+    {
+        Operand result{ allocate(), value.kind };
+        emit(is_int ? OP_NEGATE_INT : OP_NEGATE_FLOAT, result.reg, value.reg);
+        return result;
+    }
+    }
+    return {};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const BinaryExprAST& bi_expr)
+{
+    if (bi_expr.op == '=') {
+        if (bi_expr.lhs->kind == EXPR_VARIABLE && bi_expr.lhs->type == SYMBOL_TYPE_STRING) {
+            Symbol name = static_cast<const VariableExprAST&>(*bi_expr.lhs).name;
+            const Variable* variable = find_variable(name);
+            if (variable != nullptr) {
+                auto pieces = CodeGen::appended_pieces(name, bi_expr.rhs, variable->global);
+                if (!pieces.empty()) return compile_append(name, pieces);
+            }
+        }
+        Operand rhs = visit(bi_expr.rhs);
+        if (bi_expr.lhs->kind != EXPR_VARIABLE) return rhs;
+        return compile_assignment(static_cast<const VariableExprAST&>(*bi_expr.lhs).name, bi_expr.lhs->type, rhs);
+    }
+    if (bi_expr.op == '+' && bi_expr.type == SYMBOL_TYPE_STRING) {
+        std::vector<const ExprAST*> pieces;
+        CodeGen::concatenated_pieces(&bi_expr, pieces);
+        auto [first, kinds] = compile_pieces(pieces);
+        Operand result{ allocate(), VALUE_POINTER };
+        emit(OP_BUILD_STRING, result.reg, first, kinds);
+        return temporary(result);
+    }
+    Operand lhs = protect(visit(bi_expr.lhs), bi_expr.lhs, std::span<ExprAST* const>(&bi_expr.rhs, 1));
+    Operand rhs = visit(bi_expr.rhs);
+    SymbolType lhs_type = bi_expr.lhs->type;
+    SymbolType rhs_type = bi_expr.rhs->type;
+    switch (bi_expr.op)
+    {
+    case '+':
+    case '-':
+    case '*':
+    case '/':
+    {
+        if (lhs_type == SYMBOL_TYPE_STRING || rhs_type == SYMBOL_TYPE_STRING) return {};
+        // the opcodes of the four operators follow each other in this order
+        int index = bi_expr.op == '+' ? 0 : bi_expr.op == '-' ? 1 : bi_expr.op == '*' ? 2 : 3;
+        if (lhs_type == SYMBOL_TYPE_FLOAT || rhs_type == SYMBOL_TYPE_FLOAT) {
+            Operand new_lhs = cast_value_to(lhs, SYMBOL_TYPE_FLOAT);
+            Operand new_rhs = cast_value_to(rhs, SYMBOL_TYPE_FLOAT);
+            Operand result{ allocate(), VALUE_FLOAT };
+            emit(Opcode(OP_ADD_FLOAT + index), result.reg, new_lhs.reg, new_rhs.reg);
+            return result;
+        }
+        Operand result{ allocate(), VALUE_INT };
+        emit(Opcode(OP_ADD_INT + index), result.reg, lhs.reg, rhs.reg);
+        return result;
+    }
+    case TOKEN_EQUAL:
+    case TOKEN_NOT_EQUAL:
+    case '<':
+    case '>':
+    case TOKEN_LESS_EQUAL:
+    case TOKEN_GREATER_EQUAL:
+    {
+        SymbolType type = lhs_type == SYMBOL_TYPE_FLOAT || rhs_type == SYMBOL_TYPE_FLOAT ? SYMBOL_TYPE_FLOAT : lhs_type;
+        return compile_comparison(bi_expr.op, lhs, rhs, type);
+    }
+    case TOKEN_AND:
+    case TOKEN_OR:
+    {
+        Operand new_lhs = cast_value_to(lhs, SYMBOL_TYPE_INT);
+        Operand new_rhs = cast_value_to(rhs, SYMBOL_TYPE_INT);
+        Operand result{ allocate(), VALUE_INT };
+        emit(bi_expr.op == TOKEN_AND ? OP_AND : OP_OR, result.reg, new_lhs.reg, new_rhs.reg);
+        return result;
+    }
+    }
+    return {};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const VariableExprAST& var)
+{
+    return load(*find_variable(var.name));
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const CallExprAST& call)
+{
+    const FunctionSignatureAST* func = call.callee;
+    // set by the analyzer, programs it rejected are not compiled
+    assert(func != nullptr);
+    // string arguments are borrowed, except a global's: the callee could assign it and release the string it was given
+    auto extern_function = ast.extern_function_table.find(func->name);
+    bool is_extern = extern_function != ast.extern_function_table.end() && extern_function->second.get() == func;
+    // each argument is moved to its register once evaluated, so the ones after it cannot change it anymore
+    uint16_t arguments = allocate(func->arguments.size());
+    for (uint16_t i = 0; i < func->arguments.size(); i++)
+    {
+        const ExprAST* argument = call.arguments.size() > i ? call.arguments[i] : func->arguments.at(i)->default_value;
+        Operand value = cast_value_to(visit(argument), func->arguments.at(i)->type);
+        if (!is_extern && func->arguments.at(i)->type == SYMBOL_TYPE_STRING && argument->kind == EXPR_VARIABLE &&
+            find_variable(static_cast<const VariableExprAST&>(*argument).name)->global) {
+            Operand string{ allocate(), VALUE_POINTER };
+            emit(OP_RETAIN_STRING, string.reg, value.reg);
+            value = temporary(string);
+        }
+        emit(OP_MOVE, uint16_t(arguments + i), value.reg);
+    }
+    Operand result{ allocate(), kind_of(func->return_value_type) };
+    auto callee = functions.find(func);
+    if (callee != functions.end()) {
+        emit(OP_CALL, result.reg, callee->second, arguments);
+    }
+    else {
+        auto index = externs.emplace(func, uint16_t(program->externs.size()));
+        if (index.second) program->externs.push_back(func);
+        emit(OP_CALL_EXTERN, result.reg, index.first->second, arguments);
+    }
+    if (func->return_value_type == SYMBOL_TYPE_STRING) temporary(result);
+    return result;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const ReturnExprAST& ret)
+{
+    if (ret.expr == nullptr) {
+        release_lifecycle_resources();
+        compile_default_return();
+        terminated = true;
+        return {};
+    }
+    Operand return_value = cast_value_to(visit(ret.expr), current_signature->return_value_type);
+    // the caller releases the string it gets back
+    if (current_signature->return_value_type == SYMBOL_TYPE_STRING) return_value = take_ownership(return_value);
+    release_lifecycle_resources();
+    emit(OP_RETURN, return_value.reg);
+    terminated = true;
+    return {};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const IfExprAST& if_expr)
+{
+    Operand condition = compile_condition(if_expr.condition);
+    size_t to_else = emit_jump(OP_JUMP_IF_ZERO, condition.reg);
+    compile_block(if_expr.then_body);
+    if (if_expr.else_body.empty()) {
+        bind(to_else);
+        return {};
+    }
+    size_t to_end = terminated ? SIZE_MAX : emit_jump(OP_JUMP);
+    bind(to_else);
+    compile_block(if_expr.else_body);
+    size_t end = label();
+    if (to_end != SIZE_MAX) bind(to_end, end);
+    return {};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const ForExprAST& for_expr)
+{
+    SymbolType type = for_expr.variable->type;
+    const Variable& variable = *find_variable(for_expr.variable->name);
+    compile_assignment(for_expr.variable->name, type, visit(for_expr.start));
+    // evaluated once, the body may assign a variable the end was read from
+    Operand end = cast_value_to(visit(for_expr.end), type);
+    if (end.reg < variable_count) end = copy(end);
+    Operand step = cast_value_to(visit(for_expr.step), type);
+    bool descending = for_expr.step->kind == EXPR_INTEGER ? static_cast<const IntegerExprAST&>(*for_expr.step).value < 0 :
+        static_cast<const FloatExprAST&>(*for_expr.step).value < 0.0f;
+
+    size_t condition_position = label();
+    Operand counter = load(variable);
+    Operand condition{ allocate(), VALUE_INT };
+    Opcode compare = type == SYMBOL_TYPE_INT ?
+        (descending ? OP_GREATER_EQUAL_INT : OP_LESS_EQUAL_INT) :
+        (descending ? OP_GREATER_EQUAL_FLOAT : OP_LESS_EQUAL_FLOAT);
+    emit(compare, condition.reg, counter.reg, end.reg);
+    size_t to_end = emit_jump(OP_JUMP_IF_ZERO, condition.reg);
+
+    compile_block(for_expr.body);
+
+    label();
+    counter = load(variable);
+    uint16_t next = variable.global ? allocate() : variable.index;
+    emit(type == SYMBOL_TYPE_INT ? OP_ADD_INT : OP_ADD_FLOAT, next, counter.reg, step.reg);
+    if (variable.global) emit(OP_STORE_GLOBAL, variable.index, next);
+    emit_immediate(OP_JUMP, 0, int32_t(condition_position));
+    bind(to_end);
+    return {};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const WhileExprAST& while_expr)
+{
+    size_t condition_position = label();
+    Operand condition = compile_condition(while_expr.condition);
+    size_t to_end = emit_jump(OP_JUMP_IF_ZERO, condition.reg);
+    compile_block(while_expr.body);
+    if (!terminated) emit_immediate(OP_JUMP, 0, int32_t(condition_position));
+    bind(to_end);
+    return {};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const RepeatExprAST& repeat)
+{
+    size_t body_position = label();
+    compile_block(repeat.body);
+    if (!terminated) {
+        if (repeat.condition != nullptr) emit_immediate(OP_JUMP_IF_ZERO, compile_condition(repeat.condition).reg, int32_t(body_position));
+        else emit_immediate(OP_JUMP, 0, int32_t(body_position));
+    }
+    label();
+    return {};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile(const ExprAST& expr)
+{
+    return {};
+}
+
+void BytecodeCompiler::compile_block(std::span<ExprAST* const> body)
+{
+    for (const auto& expr : body) {
+        if (terminated) break;
+        // temporaries die with their statement, and so do the registers it used
+        lifecycles.push_back({});
+        uint16_t first_register = next_register;
+        visit(expr);
+        if (!terminated) {
+            for (auto reg : lifecycles.back()) emit(OP_RELEASE, reg);
+        }
+        lifecycles.pop_back();
+        next_register = first_register;
+    }
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile_condition(const ExprAST* condition)
+{
+    // evaluated again on every iteration of a loop, so its temporaries are released right away
+    lifecycles.push_back({});
+    Operand result = visit(condition);
+    if (condition->type == SYMBOL_TYPE_FLOAT) {
+        Operand zero{ allocate(), VALUE_FLOAT };
+        emit_immediate(OP_FLOAT, zero.reg, 0);
+        Operand value = result;
+        result = { allocate(), VALUE_INT };
+        emit(OP_NOT_EQUAL_FLOAT, result.reg, value.reg, zero.reg);
+    }
+    for (auto reg : lifecycles.back()) emit(OP_RELEASE, reg);
+    lifecycles.pop_back();
+    return result;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile_comparison(int op, Operand lhs, Operand rhs, SymbolType type)
+{
+    // the opcodes of the six comparisons follow each other in this order
+    int index = op == TOKEN_NOT_EQUAL ? 1 : op == '<' ? 2 : op == '>' ? 3 : op == TOKEN_LESS_EQUAL ? 4 : op == TOKEN_GREATER_EQUAL ? 5 : 0;
+    Opcode first = OP_EQUAL_INT;
+    if (type == SYMBOL_TYPE_FLOAT) {
+        lhs = cast_value_to(lhs, SYMBOL_TYPE_FLOAT);
+        rhs = cast_value_to(rhs, SYMBOL_TYPE_FLOAT);
+        first = OP_EQUAL_FLOAT;
+    }
+    else if (type == SYMBOL_TYPE_STRING) {
+        // strings are ordered like std::string::compare, whose sign is compared instead
+        Operand compared{ allocate(), VALUE_INT };
+        emit(OP_COMPARE_STRINGS, compared.reg, lhs.reg, rhs.reg);
+        lhs = compared;
+        rhs = { allocate(), VALUE_INT };
+        emit_immediate(OP_INT, rhs.reg, 0);
+    }
+    Operand result{ allocate(), VALUE_INT };
+    emit(Opcode(first + index), result.reg, lhs.reg, rhs.reg);
+    return result;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile_assignment(Symbol name, SymbolType type, Operand value)
+{
+    const Variable* variable = find_variable(name);
+    if (variable == nullptr) return value;
+    value = cast_value_to(value, type);
+    if (type != SYMBOL_TYPE_STRING) {
+        if (variable->global) {
+            emit(OP_STORE_GLOBAL, variable->index, value.reg);
+        }
+        else if (value.reg >= variable_count && !function->code.empty() && function->code.back().a == value.reg &&
+            function->code.back().op != OP_STORE_GLOBAL && function->code.back().op < OP_RELEASE && function->code.size() > last_label) {
+            // the temporary was just computed, the instruction computing it writes the variable instead
+            function->code.back().a = variable->index;
+            value.reg = variable->index;
+        }
+        else if (value.reg != variable->index) {
+            emit(OP_MOVE, variable->index, value.reg);
+        }
+        return value;
+    }
+    // a string variable owns its string, the one it held before is released
+    value = take_ownership(value);
+    if (variable->global) {
+        Operand old_value = load(*variable);
+        emit(OP_STORE_GLOBAL, variable->index, value.reg);
+        emit(OP_RELEASE, old_value.reg);
+    }
+    else {
+        emit(OP_RELEASE, variable->index);
+        emit(OP_MOVE, variable->index, value.reg);
+    }
+    return value;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile_append(Symbol name, std::span<const ExprAST* const> pieces)
+{
+    auto [first, kinds] = compile_pieces(pieces);
+    const Variable& variable = *find_variable(name);
+    Operand string = load(variable);
+    emit(OP_APPEND, string.reg, first, kinds);
+    if (variable.global) emit(OP_STORE_GLOBAL, variable.index, string.reg);
+    return string;
+}
+
+std::pair<uint16_t, uint16_t> BytecodeCompiler::compile_pieces(std::span<const ExprAST* const> pieces)
+{
+    // like the arguments of a call, a piece moved to its register cannot be changed by the ones after it
+    uint16_t first = allocate(pieces.size());
+    std::string kinds;
+    for (uint16_t i = 0; i < pieces.size(); i++) {
+        Operand value = visit(pieces[i]);
+        if (value.kind == VALUE_POINTER) {
+            kinds += char(ZPIECE_STRING);
+            // a variable's string is borrowed, unless a later piece could assign the variable and release it
+            if (pieces[i]->kind == EXPR_VARIABLE) {
+                Symbol name = static_cast<const VariableExprAST&>(*pieces[i]).name;
+                if (CodeGen::may_assign(pieces.subspan(i + 1), name, find_variable(name)->global)) {
+                    Operand string{ allocate(), VALUE_POINTER };
+                    emit(OP_RETAIN_STRING, string.reg, value.reg);
+                    value = temporary(string);
+                }
+            }
+        }
+        else {
+            kinds += char(value.kind == VALUE_FLOAT ? ZPIECE_FLOAT : ZPIECE_INT);
+        }
+        emit(OP_MOVE, uint16_t(first + i), value.reg);
+    }
+    auto found = piece_kinds.find(kinds);
+    if (found == piece_kinds.end()) {
+        if (program->piece_kinds.size() == UINT16_MAX) throw codegen_exception("the program has more kinds of concatenations than the interpreter can address");
+        found = piece_kinds.emplace(kinds, uint16_t(program->piece_kinds.size())).first;
+        program->piece_kinds.push_back(kinds);
+    }
+    return { first, found->second };
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::protect(Operand value, const ExprAST* read, std::span<ExprAST* const> rest)
+{
+    if (read->kind != EXPR_VARIABLE || value.reg >= variable_count) return value;
+    if (!CodeGen::is_assigned(rest, static_cast<const VariableExprAST&>(*read).name)) return value;
+    return copy(value);
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::copy(Operand value)
+{
+    Operand result{ allocate(), value.kind };
+    emit(OP_MOVE, result.reg, value.reg);
+    return result;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::cast_value_to(Operand value, SymbolType type)
+{
+    Opcode op;
+    switch (value.kind) {
+    case VALUE_INT:
+        if (type == SYMBOL_TYPE_FLOAT) op = OP_INT_TO_FLOAT;
+        else if (type == SYMBOL_TYPE_STRING) op = OP_INT_TO_STRING;
+        else return value;
+        break;
+    case VALUE_FLOAT:
+        if (type == SYMBOL_TYPE_INT) op = OP_FLOAT_TO_INT;
+        else if (type == SYMBOL_TYPE_STRING) op = OP_FLOAT_TO_STRING;
+        else return value;
+        break;
+    case VALUE_POINTER:
+        if (type == SYMBOL_TYPE_INT) op = OP_POINTER_TO_INT; // deprecated, see the analyzer
+        else return value;
+        break;
+    default:
+        return value;
+    }
+    Operand result{ allocate(), kind_of(type) };
+    emit(op, result.reg, value.reg);
+    return type == SYMBOL_TYPE_STRING ? temporary(result) : result;
+}
+
+BytecodeCompiler::ValueKind BytecodeCompiler::kind_of(SymbolType type)
+{
+    switch (type) {
+    case SYMBOL_TYPE_INT:
+        return VALUE_INT;
+    case SYMBOL_TYPE_FLOAT:
+        return VALUE_FLOAT;
+    case SYMBOL_TYPE_VOID:
+        return VALUE_NONE;
+    default:
+        return VALUE_POINTER;
+    }
+}
+
+const BytecodeCompiler::Variable* BytecodeCompiler::find_variable(Symbol name) const
+{
+    auto local = locals.find(name);
+    if (local != locals.end()) return &local->second;
+    auto global = globals.find(name);
+    return global != globals.end() ? &global->second : nullptr;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::load(const Variable& variable)
+{
+    if (!variable.global) return { variable.index, variable.kind };
+    Operand result{ allocate(), variable.kind };
+    emit(OP_LOAD_GLOBAL, result.reg, variable.index);
+    return result;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::default_value(SymbolType type)
+{
+    Operand result{ allocate(), kind_of(type) };
+    set_default(result.reg, type);
+    return result;
+}
+
+void BytecodeCompiler::set_default(uint16_t reg, SymbolType type)
+{
+    if (type == SYMBOL_TYPE_STRING) emit(OP_STRING, reg, literal(""));
+    else emit_immediate(type == SYMBOL_TYPE_FLOAT ? OP_FLOAT : OP_INT, reg, 0);
+}
+
+void BytecodeCompiler::compile_default_return()
+{
+    if (current_signature->return_value_type == SYMBOL_TYPE_VOID) emit(OP_RETURN_VOID);
+    else emit(OP_RETURN, default_value(current_signature->return_value_type).reg);
+}
+
+void BytecodeCompiler::release_lifecycle_resources()
+{
+    // the statements being compiled end at this return, none of them gets to release its own temporaries
+    for (auto& lifecycle : lifecycles) {
+        for (auto reg : lifecycle) emit(OP_RELEASE, reg);
+    }
+    for (auto& variable : owned_strings) emit(OP_RELEASE, load(variable).reg);
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::temporary(Operand string)
+{
+    lifecycles.back().push_back(string.reg);
+    return string;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::take_ownership(Operand string)
+{
+    if (string.literal) return string;
+    for (auto lifecycle = lifecycles.rbegin(); lifecycle != lifecycles.rend(); ++lifecycle) {
+        auto found = std::find(lifecycle->begin(), lifecycle->end(), string.reg);
+        if (found != lifecycle->end()) {
+            lifecycle->erase(found);
+            return string;
+        }
+    }
+    Operand result{ allocate(), VALUE_POINTER };
+    emit(OP_RETAIN_STRING, result.reg, string.reg);
+    return result;
+}
+
+uint16_t BytecodeCompiler::allocate(size_t count)
+{
+    if (count > size_t(UINT16_MAX - next_register)) throw codegen_exception("a function needs more registers than the interpreter has");
+    uint16_t first = next_register;
+    next_register = uint16_t(next_register + count);
+    function->register_count = std::max(function->register_count, next_register);
+    return first;
+}
+
+uint16_t BytecodeCompiler::literal(std::string_view string)
+{
+    auto found = literals.find(string);
+    if (found != literals.end()) return found->second;
+    if (program->literals.size() == UINT16_MAX) throw codegen_exception("the program has more string literals than the interpreter can address");
+    uint16_t index = uint16_t(program->literals.size());
+    program->literals.emplace_back(string);
+    literals.emplace(string, index);
+    return index;
+}
+
+void BytecodeCompiler::emit(Opcode op, uint16_t a, uint16_t b, uint16_t c)
+{
+    function->code.push_back({ op, a, b, c });
+}
+
+void BytecodeCompiler::emit_immediate(Opcode op, uint16_t a, int32_t immediate)
+{
+    function->code.push_back({ op, a, uint16_t(uint32_t(immediate) & 0xffff), uint16_t(uint32_t(immediate) >> 16) });
+}
+
+size_t BytecodeCompiler::emit_jump(Opcode op, uint16_t condition)
+{
+    emit_immediate(op, condition, 0);
+    return function->code.size() - 1;
+}
+
+size_t BytecodeCompiler::label()
+{
+    terminated = false;
+    last_label = function->code.size();
+    return last_label;
+}
+
+void BytecodeCompiler::bind(size_t jump, size_t target)
+{
+    function->code[jump].b = uint16_t(target & 0xffff);
+    function->code[jump].c = uint16_t(target >> 16);
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "SemanticAnalyzer.h"
+
+// instructions of the interpreter. registers are the slots of a call frame, the function's arguments come first, then
+// its other variables and then the temporaries of the statement being run. ints, floats and strings have opcodes of
+// their own since the types are known when compiling, strings are owned and released like in the code CodeGen generates
+enum Opcode : uint8_t {
+    OP_MOVE, // a = b
+    OP_INT, // a = immediate
+    OP_FLOAT, // a = immediate, the bits of the float
+    OP_STRING, // a = literal b, which is never released
+    OP_LOAD_GLOBAL, // a = global b
+    OP_STORE_GLOBAL, // global a = b
+    OP_ADD_INT, // a = b + c, likewise up to OP_OR
+    OP_SUB_INT,
+    OP_MUL_INT,
+    OP_DIV_INT,
+    OP_ADD_FLOAT,
+    OP_SUB_FLOAT,
+    OP_MUL_FLOAT,
+    OP_DIV_FLOAT,
+    OP_EQUAL_INT,
+    OP_NOT_EQUAL_INT,
+    OP_LESS_INT,
+    OP_GREATER_INT,
+    OP_LESS_EQUAL_INT,
+    OP_GREATER_EQUAL_INT,
+    OP_EQUAL_FLOAT,
+    OP_NOT_EQUAL_FLOAT,
+    OP_LESS_FLOAT,
+    OP_GREATER_FLOAT,
+    OP_LESS_EQUAL_FLOAT,
+    OP_GREATER_EQUAL_FLOAT,
+    OP_COMPARE_STRINGS, // -1, 0 or 1 like std::string::compare
+    OP_AND,
+    OP_OR,
+    OP_NEGATE_INT, // a = op b, likewise up to OP_RELEASE
+    OP_NEGATE_FLOAT,
+    OP_NOT_INT,
+    OP_NOT_FLOAT,
+    OP_INT_TO_FLOAT,
+    OP_FLOAT_TO_INT,
+    OP_INT_TO_STRING,
+    OP_FLOAT_TO_STRING,
+    OP_POINTER_TO_INT,
+    OP_BUILD_STRING, // a = the pieces in the registers from b on put together, piece_kinds[c] tells what they are
+    OP_APPEND, // a = a with the pieces from b on appended like OP_BUILD_STRING, a is given up and may be appended to in place
+    OP_RETAIN_STRING, // a = b, shared with one more owner
+    OP_RELEASE, // releases the string in a
+    OP_JUMP, // to instruction immediate
+    OP_JUMP_IF_ZERO, // to instruction immediate if a is 0
+    OP_CALL, // a = function b called with the registers from c on
+    OP_CALL_EXTERN, // a = extern b called with the registers from c on
+    OP_RETURN, // returns a
+    OP_RETURN_VOID
+};
+
+struct Instruction {
+    Opcode op;
+    uint16_t a = 0;
+    uint16_t b = 0;
+    uint16_t c = 0;
+
+    // b and c together, for constants and jump targets
+    int32_t immediate() const { return int32_t(uint32_t(b) | uint32_t(c) << 16); }
+};
+
+struct BytecodeFunction {
+    const FunctionSignatureAST* signature;
+    std::vector<Instruction> code;
+    uint16_t register_count = 0;
+};
+
+struct BytecodeProgram {
+    std::vector<BytecodeFunction> functions;
+    std::vector<const FunctionSignatureAST*> externs; // the ones called, OP_CALL_EXTERN indexes them
+    std::vector<std::string> literals;
+    std::vector<std::string> piece_kinds; // the ZPIECE_* of the pieces of each OP_BUILD_STRING and OP_APPEND
+    std::vector<std::pair<Symbol, SymbolType>> globals;
+    uint16_t main = 0; // index in `functions`
+};
+
+// turns the analyzed program into bytecode for the Interpreter, mirroring what CodeGen generates statement by
+// statement. the Optimizer may run before it like before CodeGen
+class BytecodeCompiler {
+public:
+    BytecodeCompiler(const SemanticAnalyzer& semantic) : ast(*semantic.ast) {}
+    // throws codegen_exception for a function too big for the registers of a frame
+    std::unique_ptr<BytecodeProgram> compile();
+
+private:
+    // what a value is in a register, like the LLVM type CodeGen would give it
+    enum ValueKind : uint8_t {
+        VALUE_NONE,
+        VALUE_INT,
+        VALUE_FLOAT,
+        VALUE_POINTER
+    };
+    struct Operand {
+        uint16_t reg = 0;
+        ValueKind kind = VALUE_NONE;
+        bool literal = false; // releasing it does nothing, so it can be owned as it is
+    };
+    struct Variable {
+        bool global;
+        uint16_t index; // a register or a global
+        ValueKind kind;
+    };
+
+    void compile_function(const FunctionAST& func, BytecodeFunction& target);
+    Operand visit(const ExprAST* expr);
+    Operand compile(const FloatExprAST& float_expr);
+    Operand compile(const IntegerExprAST& int_expr);
+    Operand compile(const StringExprAST& string);
+    Operand compile(const UnaryExprAST& unary_expr);
+    Operand compile(const BinaryExprAST& bi_expr);
+    Operand compile(const VariableExprAST& var);
+    Operand compile(const CallExprAST& call);
+    Operand compile(const ReturnExprAST& ret);
+    Operand compile(const IfExprAST& if_expr);
+    Operand compile(const ForExprAST& for_expr);
+    Operand compile(const WhileExprAST& while_expr);
+    Operand compile(const RepeatExprAST& repeat);
+    Operand compile(const ExprAST& expr);
+    void compile_block(std::span<ExprAST* const> body);
+    // an int register that is not zero if `condition` holds
+    Operand compile_condition(const ExprAST* condition);
+    Operand compile_comparison(int op, Operand lhs, Operand rhs, SymbolType type);
+    Operand compile_assignment(Symbol name, SymbolType type, Operand value);
+    Operand compile_append(Symbol name, std::span<const ExprAST* const> pieces);
+    // the pieces moved to registers one after the other, and the index of their kinds in piece_kinds
+    std::pair<uint16_t, uint16_t> compile_pieces(std::span<const ExprAST* const> pieces);
+    // a local variable `read` gave keeps the value it had then, even if an operand evaluated after it assigns it
+    Operand protect(Operand value, const ExprAST* read, std::span<ExprAST* const> rest);
+    Operand copy(Operand value);
+    Operand cast_value_to(Operand value, SymbolType type);
+    static ValueKind kind_of(SymbolType type);
+    const Variable* find_variable(Symbol name) const;
+    Operand load(const Variable& variable);
+    Operand default_value(SymbolType type);
+    void set_default(uint16_t reg, SymbolType type);
+    void compile_default_return();
+    void release_lifecycle_resources();
+    Operand temporary(Operand string);
+    Operand take_ownership(Operand string);
+    // the first of `count` registers, the only place a register number is checked against what the interpreter has
+    uint16_t allocate(size_t count = 1);
+    uint16_t literal(std::string_view string);
+    void emit(Opcode op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0);
+    void emit_immediate(Opcode op, uint16_t a, int32_t immediate);
+    // a jump whose target is set by bind()
+    size_t emit_jump(Opcode op, uint16_t condition = 0);
+    // where the next instruction goes, code jumped to is reachable again
+    size_t label();
+    void bind(size_t jump) { bind(jump, label()); }
+    void bind(size_t jump, size_t target);
+
+    const AST& ast;
+    std::unique_ptr<BytecodeProgram> program;
+    std::unordered_map<Symbol, Variable> globals;
+    std::unordered_map<const FunctionSignatureAST*, uint16_t> functions;
+    std::unordered_map<const FunctionSignatureAST*, uint16_t> externs;
+    std::unordered_map<std::string_view, uint16_t> literals;
+    std::unordered_map<std::string, uint16_t> piece_kinds;
+    // of the function being compiled
+    BytecodeFunction* function = nullptr;
+    const FunctionSignatureAST* current_signature = nullptr;
+    std::unordered_map<Symbol, Variable> locals;
+    std::vector<std::vector<uint16_t>> lifecycles; // string temporaries of the statements being compiled, innermost last
+    std::vector<Variable> owned_strings;
+    uint16_t variable_count = 0; // the registers below hold variables, the ones above temporaries
+    uint16_t next_register = 0;
+    size_t last_label = 0; // the last position jumped to
+    bool terminated = false; // the code compiled last returns, what follows is unreachable
+};
\ No newline at end of file
@@ -1,9 +1,20 @@
 #include "CodeGen.h"
+#include "ThreadPool.h"
+#include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/Support/MemoryBuffer.h>
 #include <llvm/IRReader/IRReader.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Transforms/IPO/GlobalDCE.h>
+#include <llvm/Transforms/IPO/Internalize.h>
+#include <cassert>
+#include <optional>
 
 #ifdef _WIN32
 #pragma comment(linker, "/export:??_7type_info@@6B@")
@@ -13,256 +24,561 @@
 #endif
 
 llvm::Value* CodeGen::generate_functions()
+{
+    if (partition_count <= 1) {
+        generate_partition();
+        return nullptr;
+    }
+    for (unsigned index = 1; index < partition_count; index++) partitions.push_back(std::unique_ptr<CodeGen>(new CodeGen(*this, index)));
+    std::vector<std::exception_ptr> errors(partitions.size());
+    {
+        ThreadPool pool((unsigned)partitions.size());
+        for (size_t i = 0; i < partitions.size(); i++) {
+            pool.submit([this, i, &errors] {
+                try {
+                    partitions[i]->generate_partition();
+                }
+                catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        // the first partition is generated on this thread meanwhile
+        generate_partition();
+        pool.wait();
+    }
+    for (auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+    if (print_ir) {
+        for (auto& partition : partitions) {
+            for (auto& function : *partition->module) {
+                if (!function.isDeclaration()) function.print(llvm::errs());
+            }
+        }
+    }
+    return nullptr;
+}
+
+void CodeGen::generate_partition()
 {
     // register global variables & main entry
     for (const auto& symbol : semantic->ast->global_symbols) {
-        switch (symbol.second) {
-        case SYMBOL_TYPE_INT:
-        {
-            llvm::GlobalVariable* variable = new llvm::GlobalVariable(
-                *this->module,
-                llvm::Type::getInt32Ty(*context),
-                false,
-                llvm::GlobalValue::ExternalLinkage,
-                llvm::ConstantInt::get(*context, llvm::APInt(32, 0, true)),
-                symbol.first
-            );
-            variable->print(llvm::errs());
-            llvm::errs() << '\n';
-            scoped_symbol_table.back().insert({ symbol.first, variable });
-            break;
-        }
-        case SYMBOL_TYPE_FLOAT:
-        {
-            llvm::GlobalVariable* variable = new llvm::GlobalVariable(
-                *this->module,
-                llvm::Type::getFloatTy(*context),
-                false,
-                llvm::GlobalValue::ExternalLinkage,
-                llvm::ConstantFP::get(*context, llvm::APFloat(0.0f)),
-                symbol.first
-            );
+        if (symbol.second != SYMBOL_TYPE_INT && symbol.second != SYMBOL_TYPE_FLOAT && symbol.second != SYMBOL_TYPE_STRING) continue;
+        // strings start out null, main sets them to an empty string. the first partition defines them
+        llvm::Type* type = symbol_type_to_type(symbol.second);
+        llvm::GlobalVariable* variable = new llvm::GlobalVariable(
+            *this->module,
+            type,
+            false,
+            llvm::GlobalValue::ExternalLinkage,
+            partition_index == 0 && external_globals.empty() ? llvm::Constant::getNullValue(type) : nullptr,
+            symbol_name(symbol.first)
+        );
+        if (print_ir) {
             variable->print(llvm::errs());
             llvm::errs() << '\n';
-            scoped_symbol_table.back().insert({ symbol.first, variable });
-            break;
-        }
         }
+        scoped_symbol_table.back().insert({ symbol.first, variable });
     }
 
     // register function signatures
     for (auto& func : semantic->ast->extern_function_table) {
-        llvm::Function::Create(create_function_type(func.second), llvm::Function::ExternalLinkage, func.second->name, &*module)->print(llvm::errs());
+        llvm::Function* function = llvm::Function::Create(create_function_type(*func.second), llvm::Function::ExternalLinkage, symbol_name(func.second->name), &*module);
+        functions.emplace(func.second.get(), function);
+        if (print_ir) function->print(llvm::errs());
     }
     for (auto& func : semantic->ast->function_table) {
-        llvm::Function* function = llvm::Function::Create(create_function_type(func.second->signature), llvm::Function::ExternalLinkage, unique_function_name(func.second->signature), &*module);
+        llvm::Function* function = llvm::Function::Create(create_function_type(*func.second->signature), llvm::Function::ExternalLinkage, unique_function_name(*func.second->signature), &*module);
+        functions.emplace(func.second->signature.get(), function);
+    }
+    runtime.release_string = module->getFunction("_ziyue4d_release_string__");
+    runtime.int_to_string = module->getFunction("_ziyue4d_int_to_string__");
+    runtime.float_to_string = module->getFunction("_ziyue4d_float_to_string__");
+    runtime.retain_string = module->getFunction("_ziyue4d_retain_string__");
+    runtime.build_string = module->getFunction("_ziyue4d_build_string__");
+    runtime.append = module->getFunction("_ziyue4d_append__");
+    runtime.compare_strings = module->getFunction("_ziyue4d_compare_strings__");
+    if (!runtime.release_string || !runtime.int_to_string || !runtime.float_to_string ||
+        !runtime.retain_string || !runtime.build_string || !runtime.append || !runtime.compare_strings) {
+        throw codegen_exception("the stdlib manifest lacks runtime functions, rebuild the stdlib target");
     }
 
     // register function definations
+    size_t position = 0;
     for (auto& func : semantic->ast->function_table) {
-        llvm::Function* function = module->getFunction(unique_function_name(func.second->signature));
+        // main stays in the first partition with the globals, the other functions are dealt out in turn
+        unsigned partition = func.second->signature->name == MAIN_SYMBOL ? 0 : unsigned(++position % partition_count);
+        if (partition != partition_index) continue;
+        llvm::Function* function = functions.at(func.second->signature.get());
         llvm::BasicBlock* block = llvm::BasicBlock::Create(*context, "", function);
         scoped_symbol_table.push_back({});
-        lifecycles.push({ true, {} });
         builder->SetInsertPoint(block);
-        for (const auto& symbol : func.second->signature->symbol_table) {
-            switch (symbol.second) {
-            case SYMBOL_TYPE_INT:
-                scoped_symbol_table.back().insert({ symbol.first, llvm::ConstantInt::get(*context, llvm::APInt(32, 0, true)) });
-                break;
-            case SYMBOL_TYPE_FLOAT:
-                scoped_symbol_table.back().insert({ symbol.first, llvm::ConstantFP::get(*context, llvm::APFloat(0.0f)) });
-                break;
-            case SYMBOL_TYPE_STRING:
-                scoped_symbol_table.back().insert({ symbol.first, build_literal_string("") });
-                break;
-            }
+        current_signature = func.second->signature.get();
+        // variables live in allocas, mem2reg turns them back into registers and leaves loops in canonical form
+        for (const auto& symbol : current_signature->symbol_table) {
+            if (symbol.second != SYMBOL_TYPE_INT && symbol.second != SYMBOL_TYPE_FLOAT && symbol.second != SYMBOL_TYPE_STRING) continue;
+            scoped_symbol_table.back().insert({ symbol.first, builder->CreateAlloca(symbol_type_to_type(symbol.second), nullptr, symbol_name(symbol.first)) });
         }
+        for (const auto& symbol : current_signature->symbol_table) {
+            auto variable = scoped_symbol_table.back().find(symbol.first);
+            bool is_argument = std::any_of(current_signature->arguments.begin(), current_signature->arguments.end(),
+                [&symbol](const FunctionArgument* arg) { return arg->name == symbol.first; });
+            if (variable == scoped_symbol_table.back().end() || is_argument) continue;
+            builder->CreateStore(default_value(symbol.second), variable->second);
+            if (symbol.second == SYMBOL_TYPE_STRING) owned_strings.push_back(variable->second);
+        }
+        // string arguments are borrowed from the caller, unless the function assigns them
         int index = 0;
-        for (const auto& arg : func.second->signature->arguments) {
-            function->getArg(index)->setName(arg->name);
-            scoped_symbol_table.back().insert_or_assign(arg->name, function->getArg(index));
-            index++;
+        for (const auto& arg : current_signature->arguments) {
+            llvm::Value* value = function->getArg(index++);
+            value->setName(symbol_name(arg->name));
+            llvm::Value* variable = scoped_symbol_table.back().at(arg->name);
+            if (arg->type == SYMBOL_TYPE_STRING && is_assigned(func.second->body, arg->name)) {
+                value = builder->CreateCall(runtime.retain_string, { value });
+                owned_strings.push_back(variable);
+            }
+            builder->CreateStore(value, variable);
         }
-        semantic->scope = &func.second->signature;
-        for (const auto& expr : func.second->body) {
-            if (builder->GetInsertBlock()->getTerminator() != nullptr) {
-                llvm::errs() << "unreachable code\n";
-                break;
+        // main owns the global strings
+        if (current_signature->name == MAIN_SYMBOL) {
+            for (const auto& global : scoped_symbol_table.front()) {
+                auto variable = llvm::cast<llvm::GlobalVariable>(global.second);
+                if (!variable->getValueType()->isPointerTy()) continue;
+                builder->CreateStore(default_value(SYMBOL_TYPE_STRING), variable);
+                owned_strings.push_back(variable);
             }
-            visit(expr);
         }
+
+        generate_block(func.second->body);
         if (builder->GetInsertBlock()->getTerminator() == nullptr) {
-            release_lifecycle_resources(true);
-            switch (func.second->signature->return_value_type) {
-            case SYMBOL_TYPE_FLOAT:
-                builder->CreateRet(llvm::ConstantFP::get(*context, llvm::APFloat(0.0f)));
-                break;
-            default:
-                builder->CreateRet(llvm::ConstantInt::get(*context, llvm::APInt(32, 0, true)));
-                break;
-            }
+            release_lifecycle_resources();
+            builder->CreateRet(default_value(current_signature->return_value_type));
         }
         llvm::verifyFunction(*function);
-        function->print(llvm::errs());
-        semantic->scope = nullptr;
+        if (print_ir) function->print(llvm::errs());
+        current_signature = nullptr;
+        owned_strings.clear();
         scoped_symbol_table.pop_back();
     }
-    return nullptr;
 }
 
 // There is no type check since I trust my semantic analyzer
-llvm::Value* CodeGen::visit(const std::unique_ptr<ExprAST>& expr)
-{
-    if (typeid(*expr) == typeid(FloatExprAST)) {
-        auto& float_expr = dynamic_cast<const FloatExprAST&>(*expr);
-        return llvm::ConstantFP::get(*context, llvm::APFloat(float_expr.value));
-    }
-    if (typeid(*expr) == typeid(IntegerExprAST)) {
-        auto& int_expr = dynamic_cast<const IntegerExprAST&>(*expr);
-        return llvm::ConstantInt::get(*context, llvm::APInt(32, int_expr.value, true));
-    }
-    if (typeid(*expr) == typeid(StringExprAST)) {
-        auto& string = dynamic_cast<const StringExprAST&>(*expr);
-        return build_literal_string(string.string);
-    }
-    if (typeid(*expr) == typeid(UnaryExprAST)) {
-        auto& unary_expr = dynamic_cast<const UnaryExprAST&>(*expr);
-        llvm::Value* value = visit(unary_expr.expr);
-        SymbolType type = semantic->get_type(unary_expr.expr);
-        switch (unary_expr.op) {
-        case TOKEN_LOGIC_NOT:
-            if (type == SYMBOL_TYPE_INT) {
-                return cast_value_to(builder->CreateICmpEQ(value, llvm::ConstantInt::get(value->getType(), 0)), SYMBOL_TYPE_INT);
-            }
-            else {
-                return cast_value_to(builder->CreateFCmpOEQ(value, llvm::ConstantFP::get(value->getType(), 0.0f)), SYMBOL_TYPE_INT);
-            }
-        case '-':
-            if (type == SYMBOL_TYPE_INT) {
-                return builder->CreateSub(llvm::ConstantInt::get(value->getType(), 0), value);
-            }
-            else {
-                return builder->CreateFSub(llvm::ConstantFP::get(value->getType(), 0.0f), value);
-            }
+llvm::Value* CodeGen::visit(const ExprAST* expr)
+{
+    return visit_expr(expr, [this](const auto& node) { return generate(node); });
+}
+
+llvm::Value* CodeGen::generate(const FloatExprAST& float_expr)
+{
+    return llvm::ConstantFP::get(*context, llvm::APFloat(float_expr.value));
+}
+
+llvm::Value* CodeGen::generate(const IntegerExprAST& int_expr)
+{
+    return llvm::ConstantInt::get(*context, llvm::APInt(32, int_expr.value, true));
+}
+
+llvm::Value* CodeGen::generate(const StringExprAST& string)
+{
+    return build_literal_string(string.string);
+}
+
+llvm::Value* CodeGen::generate(const UnaryExprAST& unary_expr)
+{
+    llvm::Value* value = visit(unary_expr.expr);
+    SymbolType type = unary_expr.expr->type;
+    switch (unary_expr.op) {
+    case TOKEN_LOGIC_NOT:
+        if (type == SYMBOL_TYPE_INT) {
+            return cast_value_to(builder->CreateICmpEQ(value, llvm::ConstantInt::get(value->getType(), 0)), SYMBOL_TYPE_INT);
+        }
+        else {
+            return cast_value_to(builder->CreateFCmpOEQ(value, llvm::ConstantFP::get(value->getType(), 0.0f)), SYMBOL_TYPE_INT);
+        }
+    case '-':
+        if (type == SYMBOL_TYPE_INT) {
+            return builder->CreateSub(llvm::ConstantInt::get(value->getType(), 0), value);
+        }
+        else {
+            return builder->CreateFSub(llvm::ConstantFP::get(value->getType(), 0.0f), value);
         }
     }
-    if (typeid(*expr) == typeid(BinaryExprAST)) {
-        auto& bi_expr = dynamic_cast<const BinaryExprAST&>(*expr);
-        llvm::Value* lhs = visit(bi_expr.lhs);
-        llvm::Value* rhs = visit(bi_expr.rhs);
-        SymbolType lhs_type = semantic->get_type(bi_expr.lhs);
-        SymbolType rhs_type = semantic->get_type(bi_expr.rhs);
-        switch (bi_expr.op)
-        {
-        case '+':
-        case '-':
-        case '*':
-        case '/':
-            if (lhs_type == SYMBOL_TYPE_STRING || rhs_type == SYMBOL_TYPE_STRING) {
-                llvm::Value* new_lhs = lhs;
-                llvm::Value* new_rhs = rhs;
-                if (lhs_type == SYMBOL_TYPE_INT) {
-                    new_lhs = builder->CreateCall(module->getFunction("_ziyue4d_int_to_string__"), { lhs });
-                    lifecycles.top().values.insert(new_lhs);
-                }
-                if (lhs_type == SYMBOL_TYPE_FLOAT) {
-                    new_lhs = builder->CreateCall(module->getFunction("_ziyue4d_float_to_string__"), { lhs });
-                    lifecycles.top().values.insert(new_lhs);
-                }
-                if (rhs_type == SYMBOL_TYPE_INT) {
-                    new_rhs = builder->CreateCall(module->getFunction("_ziyue4d_int_to_string__"), { rhs });
-                    lifecycles.top().values.insert(new_rhs);
-                }
-                if (rhs_type == SYMBOL_TYPE_FLOAT) {
-                    new_rhs = builder->CreateCall(module->getFunction("_ziyue4d_float_to_string__"), { rhs });
-                    lifecycles.top().values.insert(new_rhs);
-                }
-                if (bi_expr.op == '+') {
-                    llvm::Value* new_string = builder->CreateCall(module->getFunction("_ziyue4d_concat"), { new_lhs, new_rhs });
-                    lifecycles.top().values.insert(new_string);
-                    return new_string;
-                }
-                return nullptr;
-            }
+    return nullptr;
+}
 
-            if (lhs_type == SYMBOL_TYPE_FLOAT || rhs_type == SYMBOL_TYPE_FLOAT) {
-                llvm::Value* new_lhs = lhs;
-                llvm::Value* new_rhs = rhs;
-                if (lhs_type == SYMBOL_TYPE_INT) {
-                    new_lhs = builder->CreateSIToFP(lhs, llvm::Type::getFloatTy(*context));
-                }
-                if (rhs_type == SYMBOL_TYPE_INT) {
-                    new_rhs = builder->CreateSIToFP(rhs, llvm::Type::getFloatTy(*context));
-                }
-                switch (bi_expr.op) {
-                case '+':
-                    return builder->CreateFAdd(new_lhs, new_rhs);
-                case '-':
-                    return builder->CreateFSub(new_lhs, new_rhs);
-                case '*':
-                    return builder->CreateFMul(new_lhs, new_rhs);
-                case '/':
-                    return builder->CreateFDiv(new_lhs, new_rhs);
-                }
+llvm::Value* CodeGen::generate(const BinaryExprAST& bi_expr)
+{
+    if (bi_expr.op == '=') {
+        if (bi_expr.lhs->kind == EXPR_VARIABLE && bi_expr.lhs->type == SYMBOL_TYPE_STRING) {
+            Symbol name = static_cast<const VariableExprAST&>(*bi_expr.lhs).name;
+            llvm::Value* variable = find_variable(name);
+            if (variable != nullptr) {
+                auto pieces = appended_pieces(name, bi_expr.rhs, llvm::isa<llvm::GlobalVariable>(variable));
+                if (!pieces.empty()) return generate_append(name, pieces);
             }
+        }
+        llvm::Value* rhs = visit(bi_expr.rhs);
+        if (bi_expr.lhs->kind != EXPR_VARIABLE) return rhs;
+        return generate_assignment(static_cast<const VariableExprAST&>(*bi_expr.lhs).name, bi_expr.lhs->type, rhs);
+    }
+    // a chain of concatenations is built at once, in a string allocated for all of it
+    if (bi_expr.op == '+' && bi_expr.type == SYMBOL_TYPE_STRING) {
+        std::vector<const ExprAST*> pieces;
+        concatenated_pieces(&bi_expr, pieces);
+        auto arguments = generate_pieces(pieces);
+        return temporary(builder->CreateCall(runtime.build_string, arguments));
+    }
+    llvm::Value* lhs = visit(bi_expr.lhs);
+    llvm::Value* rhs = visit(bi_expr.rhs);
+    SymbolType lhs_type = bi_expr.lhs->type;
+    SymbolType rhs_type = bi_expr.rhs->type;
+    switch (bi_expr.op)
+    {
+    case '+':
+    case '-':
+    case '*':
+    case '/':
+        if (lhs_type == SYMBOL_TYPE_STRING || rhs_type == SYMBOL_TYPE_STRING) return nullptr;
+
+        if (lhs_type == SYMBOL_TYPE_FLOAT || rhs_type == SYMBOL_TYPE_FLOAT) {
+            llvm::Value* new_lhs = cast_value_to(lhs, SYMBOL_TYPE_FLOAT);
+            llvm::Value* new_rhs = cast_value_to(rhs, SYMBOL_TYPE_FLOAT);
             switch (bi_expr.op) {
             case '+':
-                return builder->CreateAdd(lhs, rhs);
+                return builder->CreateFAdd(new_lhs, new_rhs);
             case '-':
-                return builder->CreateSub(lhs, rhs);
+                return builder->CreateFSub(new_lhs, new_rhs);
             case '*':
-                return builder->CreateMul(lhs, rhs);
+                return builder->CreateFMul(new_lhs, new_rhs);
             case '/':
-                return builder->CreateSDiv(lhs, rhs);
-            }
-        case '=':
-            if (typeid(*bi_expr.lhs) == typeid(VariableExprAST)) {
-                auto& var = dynamic_cast<const VariableExprAST&>(*bi_expr.lhs);
-                update_variable_value(var.name, cast_value_to(rhs, semantic->get_type(bi_expr.lhs)));
+                return builder->CreateFDiv(new_lhs, new_rhs);
             }
-            return rhs;
         }
+        switch (bi_expr.op) {
+        case '+':
+            return builder->CreateAdd(lhs, rhs);
+        case '-':
+            return builder->CreateSub(lhs, rhs);
+        case '*':
+            return builder->CreateMul(lhs, rhs);
+        case '/':
+            return builder->CreateSDiv(lhs, rhs);
+        }
+    case TOKEN_EQUAL:
+    case TOKEN_NOT_EQUAL:
+    case '<':
+    case '>':
+    case TOKEN_LESS_EQUAL:
+    case TOKEN_GREATER_EQUAL:
+    {
+        SymbolType type = lhs_type == SYMBOL_TYPE_FLOAT || rhs_type == SYMBOL_TYPE_FLOAT ? SYMBOL_TYPE_FLOAT : lhs_type;
+        return cast_value_to(generate_comparison(bi_expr.op, lhs, rhs, type), SYMBOL_TYPE_INT);
     }
-    if (typeid(*expr) == typeid(VariableExprAST)) {
-        auto& var = dynamic_cast<const VariableExprAST&>(*expr);
-        return find_variable_value(var.name);
-    }
-    if (typeid(*expr) == typeid(CallExprAST)) {
-        auto& call = dynamic_cast<const CallExprAST&>(*expr);
-        auto& func = semantic->seek_best_match_function(call);
-        std::vector<llvm::Value*> built_arguments = {};
-        for (int i = 0; i < func->arguments.size(); i++)
-        {
-            built_arguments.push_back(cast_value_to(
-                visit(call.arguments.size() > i ? call.arguments.at(i) : func->arguments.at(i)->default_value),
-                func->arguments.at(i)->type));
+    case TOKEN_AND:
+        return builder->CreateAnd(cast_value_to(lhs, SYMBOL_TYPE_INT), cast_value_to(rhs, SYMBOL_TYPE_INT));
+    case TOKEN_OR:
+        return builder->CreateOr(cast_value_to(lhs, SYMBOL_TYPE_INT), cast_value_to(rhs, SYMBOL_TYPE_INT));
+    }
+    return nullptr;
+}
+
+llvm::Value* CodeGen::generate(const VariableExprAST& var)
+{
+    return find_variable_value(var.name);
+}
+
+llvm::Value* CodeGen::generate(const CallExprAST& call)
+{
+    const FunctionSignatureAST* func = call.callee;
+    // set by the analyzer, programs it rejected are not generated
+    assert(func != nullptr);
+    // string arguments are borrowed, except a global's: the callee could assign it and release the string it was given,
+    // or append to it in place
+    auto extern_function = semantic->ast->extern_function_table.find(func->name);
+    bool is_extern = extern_function != semantic->ast->extern_function_table.end() && extern_function->second.get() == func;
+    std::vector<llvm::Value*> built_arguments = {};
+    for (int i = 0; i < func->arguments.size(); i++)
+    {
+        const ExprAST* argument = call.arguments.size() > i ? call.arguments[i] : func->arguments.at(i)->default_value;
+        llvm::Value* value = cast_value_to(visit(argument), func->arguments.at(i)->type);
+        if (!is_extern && func->arguments.at(i)->type == SYMBOL_TYPE_STRING && argument->kind == EXPR_VARIABLE &&
+            llvm::isa<llvm::GlobalVariable>(find_variable(static_cast<const VariableExprAST&>(*argument).name))) {
+            value = temporary(builder->CreateCall(runtime.retain_string, { value }));
         }
-        llvm::Value* ret_val = builder->CreateCall(module->getFunction(unique_function_name(func)), built_arguments);
-        if (func->return_value_type == SYMBOL_TYPE_STRING) lifecycles.top().values.insert(ret_val);
-        return ret_val;
+        built_arguments.push_back(value);
     }
-    if (typeid(*expr) == typeid(ReturnExprAST)) {
-        auto& ret = dynamic_cast<const ReturnExprAST&>(*expr);
-        llvm::Value* return_value = cast_value_to(visit(ret.expr), (*semantic->scope)->return_value_type);
-        release_lifecycle_resources(true, return_value);
-        builder->CreateRet(return_value);
+    llvm::Value* ret_val = builder->CreateCall(functions.at(func), built_arguments);
+    if (func->return_value_type == SYMBOL_TYPE_STRING) temporary(ret_val);
+    return ret_val;
+}
+
+llvm::Value* CodeGen::generate(const ReturnExprAST& ret)
+{
+    if (ret.expr == nullptr) {
+        release_lifecycle_resources();
+        builder->CreateRet(default_value(current_signature->return_value_type));
+        return nullptr;
+    }
+    llvm::Value* return_value = cast_value_to(visit(ret.expr), current_signature->return_value_type);
+    // the caller releases the string it gets back
+    if (current_signature->return_value_type == SYMBOL_TYPE_STRING) return_value = take_ownership(return_value);
+    release_lifecycle_resources();
+    builder->CreateRet(return_value);
+    return nullptr;
+}
+
+llvm::Value* CodeGen::generate(const IfExprAST& if_expr)
+{
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::Value* condition = generate_condition(if_expr.condition);
+    llvm::BasicBlock* then_block = llvm::BasicBlock::Create(*context, "then", function);
+    llvm::BasicBlock* else_block = if_expr.else_body.empty() ? nullptr : llvm::BasicBlock::Create(*context, "else");
+    llvm::BasicBlock* end_block = llvm::BasicBlock::Create(*context, "endif");
+    builder->CreateCondBr(condition, then_block, else_block != nullptr ? else_block : end_block);
+
+    builder->SetInsertPoint(then_block);
+    generate_block(if_expr.then_body);
+    if (builder->GetInsertBlock()->getTerminator() == nullptr) builder->CreateBr(end_block);
+    if (else_block != nullptr) {
+        else_block->insertInto(function);
+        builder->SetInsertPoint(else_block);
+        generate_block(if_expr.else_body);
+        if (builder->GetInsertBlock()->getTerminator() == nullptr) builder->CreateBr(end_block);
     }
+    end_block->insertInto(function);
+    builder->SetInsertPoint(end_block);
     return nullptr;
 }
 
+llvm::Value* CodeGen::generate(const ForExprAST& for_expr)
+{
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    SymbolType type = for_expr.variable->type;
+    llvm::Value* variable = find_variable(for_expr.variable->name);
+    generate_assignment(for_expr.variable->name, type, visit(for_expr.start));
+    llvm::Value* end = cast_value_to(visit(for_expr.end), type);
+    llvm::Value* step = cast_value_to(visit(for_expr.step), type);
+    bool descending = for_expr.step->kind == EXPR_INTEGER ? static_cast<const IntegerExprAST&>(*for_expr.step).value < 0 :
+        static_cast<const FloatExprAST&>(*for_expr.step).value < 0.0f;
+
+    // the counter is tested before the body and stepped in a block of its own, the shape LoopRotate and the
+    // vectorizer expect. the int step is nsw, so the trip count can be computed
+    llvm::BasicBlock* condition_block = llvm::BasicBlock::Create(*context, "for", function);
+    llvm::BasicBlock* body_block = llvm::BasicBlock::Create(*context, "loop");
+    llvm::BasicBlock* step_block = llvm::BasicBlock::Create(*context, "next");
+    llvm::BasicBlock* end_block = llvm::BasicBlock::Create(*context, "endfor");
+    builder->CreateBr(condition_block);
+
+    builder->SetInsertPoint(condition_block);
+    llvm::Value* counter = builder->CreateLoad(variable_type(variable), variable);
+    llvm::Value* condition = type == SYMBOL_TYPE_INT ?
+        (descending ? builder->CreateICmpSGE(counter, end) : builder->CreateICmpSLE(counter, end)) :
+        (descending ? builder->CreateFCmpOGE(counter, end) : builder->CreateFCmpOLE(counter, end));
+    builder->CreateCondBr(condition, body_block, end_block);
+
+    body_block->insertInto(function);
+    builder->SetInsertPoint(body_block);
+    generate_block(for_expr.body);
+    if (builder->GetInsertBlock()->getTerminator() == nullptr) builder->CreateBr(step_block);
+
+    step_block->insertInto(function);
+    builder->SetInsertPoint(step_block);
+    counter = builder->CreateLoad(variable_type(variable), variable);
+    builder->CreateStore(type == SYMBOL_TYPE_INT ? builder->CreateNSWAdd(counter, step) : builder->CreateFAdd(counter, step), variable);
+    builder->CreateBr(condition_block);
+
+    end_block->insertInto(function);
+    builder->SetInsertPoint(end_block);
+    return nullptr;
+}
+
+llvm::Value* CodeGen::generate(const WhileExprAST& while_expr)
+{
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* condition_block = llvm::BasicBlock::Create(*context, "while", function);
+    llvm::BasicBlock* body_block = llvm::BasicBlock::Create(*context, "loop");
+    llvm::BasicBlock* end_block = llvm::BasicBlock::Create(*context, "wend");
+    builder->CreateBr(condition_block);
+
+    builder->SetInsertPoint(condition_block);
+    builder->CreateCondBr(generate_condition(while_expr.condition), body_block, end_block);
+
+    body_block->insertInto(function);
+    builder->SetInsertPoint(body_block);
+    generate_block(while_expr.body);
+    if (builder->GetInsertBlock()->getTerminator() == nullptr) builder->CreateBr(condition_block);
+
+    end_block->insertInto(function);
+    builder->SetInsertPoint(end_block);
+    return nullptr;
+}
+
+llvm::Value* CodeGen::generate(const RepeatExprAST& repeat)
+{
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* body_block = llvm::BasicBlock::Create(*context, "repeat", function);
+    llvm::BasicBlock* end_block = llvm::BasicBlock::Create(*context, "until");
+    builder->CreateBr(body_block);
+
+    builder->SetInsertPoint(body_block);
+    generate_block(repeat.body);
+    if (builder->GetInsertBlock()->getTerminator() == nullptr) {
+        if (repeat.condition != nullptr) builder->CreateCondBr(generate_condition(repeat.condition), end_block, body_block);
+        else builder->CreateBr(body_block);
+    }
+
+    end_block->insertInto(function);
+    builder->SetInsertPoint(end_block);
+    return nullptr;
+}
+
+llvm::Value* CodeGen::generate(const ExprAST& expr)
+{
+    return nullptr;
+}
+
+void CodeGen::generate_block(std::span<ExprAST* const> body)
+{
+    for (const auto& expr : body) {
+        if (builder->GetInsertBlock()->getTerminator() != nullptr) {
+            llvm::errs() << "unreachable code\n";
+            break;
+        }
+        // temporaries die with their statement, so a loop body does not pile them up until the function returns
+        lifecycles.push_back({});
+        visit(expr);
+        if (builder->GetInsertBlock()->getTerminator() == nullptr) {
+            for (auto value : lifecycles.back().values) builder->CreateCall(runtime.release_string, { value });
+        }
+        lifecycles.pop_back();
+    }
+}
+
+llvm::Value* CodeGen::generate_condition(const ExprAST* condition)
+{
+    // evaluated again on every iteration of a loop, so its temporaries are released right away
+    lifecycles.push_back({});
+    llvm::Value* value = visit(condition);
+    llvm::Value* result = condition->type == SYMBOL_TYPE_FLOAT ?
+        builder->CreateFCmpUNE(value, llvm::ConstantFP::get(value->getType(), 0.0)) :
+        builder->CreateICmpNE(value, llvm::ConstantInt::get(value->getType(), 0));
+    for (auto value : lifecycles.back().values) builder->CreateCall(runtime.release_string, { value });
+    lifecycles.pop_back();
+    return result;
+}
+
+llvm::Value* CodeGen::generate_comparison(int op, llvm::Value* lhs, llvm::Value* rhs, SymbolType type)
+{
+    if (type == SYMBOL_TYPE_FLOAT) {
+        lhs = cast_value_to(lhs, SYMBOL_TYPE_FLOAT);
+        rhs = cast_value_to(rhs, SYMBOL_TYPE_FLOAT);
+        switch (op) {
+        case '<': return builder->CreateFCmpOLT(lhs, rhs);
+        case '>': return builder->CreateFCmpOGT(lhs, rhs);
+        case TOKEN_LESS_EQUAL: return builder->CreateFCmpOLE(lhs, rhs);
+        case TOKEN_GREATER_EQUAL: return builder->CreateFCmpOGE(lhs, rhs);
+        case TOKEN_NOT_EQUAL: return builder->CreateFCmpUNE(lhs, rhs);
+        default: return builder->CreateFCmpOEQ(lhs, rhs);
+        }
+    }
+    if (type == SYMBOL_TYPE_STRING) {
+        // strings are ordered like std::string::compare, whose sign is compared instead
+        lhs = builder->CreateCall(runtime.compare_strings, { lhs, rhs });
+        rhs = builder->getInt32(0);
+    }
+    switch (op) {
+    case '<': return builder->CreateICmpSLT(lhs, rhs);
+    case '>': return builder->CreateICmpSGT(lhs, rhs);
+    case TOKEN_LESS_EQUAL: return builder->CreateICmpSLE(lhs, rhs);
+    case TOKEN_GREATER_EQUAL: return builder->CreateICmpSGE(lhs, rhs);
+    case TOKEN_NOT_EQUAL: return builder->CreateICmpNE(lhs, rhs);
+    default: return builder->CreateICmpEQ(lhs, rhs);
+    }
+}
+
+llvm::Value* CodeGen::generate_assignment(Symbol name, SymbolType type, llvm::Value* value)
+{
+    llvm::Value* variable = find_variable(name);
+    if (variable == nullptr) return value;
+    value = cast_value_to(value, type);
+    if (type != SYMBOL_TYPE_STRING) {
+        builder->CreateStore(value, variable);
+        return value;
+    }
+    // a string variable owns its string, the one it held before is released
+    llvm::Value* old_value = builder->CreateLoad(variable_type(variable), variable);
+    value = take_ownership(value);
+    builder->CreateStore(value, variable);
+    builder->CreateCall(runtime.release_string, { old_value });
+    return value;
+}
+
+llvm::Value* CodeGen::generate_append(Symbol name, std::span<const ExprAST* const> pieces)
+{
+    auto arguments = generate_pieces(pieces);
+    // the pieces are evaluated first, the variable holds the string it is appended to meanwhile
+    llvm::Value* variable = find_variable(name);
+    llvm::Value* string = builder->CreateLoad(variable_type(variable), variable);
+    string = builder->CreateCall(runtime.append, { string, arguments[0], arguments[1], arguments[2] });
+    builder->CreateStore(string, variable);
+    return string;
+}
+
+std::array<llvm::Value*, 3> CodeGen::generate_pieces(std::span<const ExprAST* const> pieces)
+{
+    std::string kinds;
+    std::vector<llvm::Value*> values;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        llvm::Value* value = visit(pieces[i]);
+        if (value->getType()->isIntegerTy()) {
+            value = cast_value_to(value, SYMBOL_TYPE_INT);
+            kinds += char(ZPIECE_INT);
+        }
+        else if (value->getType()->isFloatTy()) {
+            kinds += char(ZPIECE_FLOAT);
+        }
+        else {
+            kinds += char(ZPIECE_STRING);
+            // a variable's string is borrowed, unless a later piece could assign the variable and release it
+            if (pieces[i]->kind == EXPR_VARIABLE) {
+                Symbol name = static_cast<const VariableExprAST&>(*pieces[i]).name;
+                if (may_assign(pieces.subspan(i + 1), name, llvm::isa<llvm::GlobalVariable>(find_variable(name)))) {
+                    value = temporary(builder->CreateCall(runtime.retain_string, { value }));
+                }
+            }
+        }
+        values.push_back(value);
+    }
+    // in the entry block, so that a loop reuses the array instead of growing the stack
+    llvm::BasicBlock& entry = builder->GetInsertBlock()->getParent()->getEntryBlock();
+    llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+    llvm::Type* array_type = llvm::ArrayType::get(llvm::PointerType::get(*context, 0), values.size());
+    llvm::Value* array = entry_builder.CreateAlloca(array_type);
+    for (size_t i = 0; i < values.size(); i++) builder->CreateStore(values[i], builder->CreateConstInBoundsGEP2_32(array_type, array, 0, unsigned(i)));
+
+    auto found = piece_kinds.find(kinds);
+    if (found == piece_kinds.end()) {
+        llvm::Constant* data = llvm::ConstantDataArray::getString(*context, kinds, false);
+        auto variable = new llvm::GlobalVariable(*module, data->getType(), true, llvm::GlobalValue::PrivateLinkage, data, ".kinds");
+        variable->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+        found = piece_kinds.emplace(kinds, variable).first;
+    }
+    return { found->second, array, builder->getInt32(uint32_t(values.size())) };
+}
+
 llvm::Value* CodeGen::cast_value_to(llvm::Value* value, SymbolType type)
 {
     switch (value->getType()->getTypeID()) {
     case llvm::Type::IntegerTyID:
+        if (value->getType() == builder->getInt1Ty()) { // bool to int32
+            value = builder->CreateZExt(value, builder->getInt32Ty());
+        }
         switch (type) {
         case SYMBOL_TYPE_FLOAT:
             return builder->CreateSIToFP(value, llvm::Type::getFloatTy(*context));
         case SYMBOL_TYPE_STRING:
-        case SYMBOL_TYPE_INT:
-            if (value->getType() == builder->getInt1Ty()) { // bool to int32
-                return builder->CreateZExt(value, builder->getInt32Ty());
-            }
+            return temporary(builder->CreateCall(runtime.int_to_string, { value }));
         default:
             return value;
         }
@@ -271,21 +587,25 @@ llvm::Value* CodeGen::cast_value_to(llvm::Value* value, SymbolType type)
         case SYMBOL_TYPE_INT:
             return builder->CreateFPToSI(value, llvm::Type::getInt32Ty(*context));
         case SYMBOL_TYPE_STRING:
+            return temporary(builder->CreateCall(runtime.float_to_string, { value }));
         default:
             return value;
         }
+    case llvm::Type::PointerTyID:
+        if (type == SYMBOL_TYPE_INT) return builder->CreatePtrToInt(value, builder->getInt32Ty()); // deprecated, see the analyzer
+        return value;
     }
     return value;
 }
 
-llvm::FunctionType* CodeGen::create_function_type(const std::unique_ptr<FunctionSignatureAST>& signature)
+llvm::FunctionType* CodeGen::create_function_type(const FunctionSignatureAST& signature)
 {
-    std::vector<llvm::Type*> arguments{ signature->arguments.size() };
-    std::transform(signature->arguments.begin(),
-        signature->arguments.end(),
+    std::vector<llvm::Type*> arguments{ signature.arguments.size() };
+    std::transform(signature.arguments.begin(),
+        signature.arguments.end(),
         arguments.begin(),
-        [this](const std::unique_ptr<FunctionArgument>& arg) { return symbol_type_to_type(arg->type); });
-    return llvm::FunctionType::get(symbol_type_to_type(signature->return_value_type), arguments, false);
+        [this](const FunctionArgument* arg) { return symbol_type_to_type(arg->type); });
+    return llvm::FunctionType::get(symbol_type_to_type(signature.return_value_type), arguments, false);
 }
 
 llvm::Type* CodeGen::token_to_type(Token token)
@@ -323,26 +643,19 @@ llvm::Type* CodeGen::symbol_type_to_type(SymbolType type)
     }
 }
 
-std::string CodeGen::unique_function_name(const std::unique_ptr<FunctionSignatureAST>& signature)
+std::string CodeGen::unique_function_name(const FunctionSignatureAST& signature)
 {
-    static std::map<void*, std::string> cache = {};
-    if (signature->name == "__main") return "__main";
-    if (cache.contains((void*)&signature)) return cache.at((void*)&signature); // what am i doing?
-
-    auto extern_func = semantic->ast->extern_function_table.find(signature->name.starts_with("_ziyue4d_") ? signature->name.substr(9) : signature->name);
-    if (extern_func != semantic->ast->extern_function_table.end() && extern_func->second == signature) {
-        cache.insert({ (void*)&signature, signature->name });
-        return cache.at((void*)&signature);
-    }
-
-    int mandatory_args = std::count_if(signature->arguments.begin(),
-        signature->arguments.end(),
-        [](const std::unique_ptr<FunctionArgument>& arg) {
+    // only called once per function when it is declared, calls use `functions`
+    if (signature.name == MAIN_SYMBOL) return "__main";
+    std::string_view name = symbol_name(signature.name);
+    int mandatory_args = std::count_if(signature.arguments.begin(),
+        signature.arguments.end(),
+        [](const FunctionArgument* arg) {
             return arg->default_value == nullptr;
         });
-    int optional_args = signature->arguments.size() - mandatory_args;
+    int optional_args = signature.arguments.size() - mandatory_args;
     char return_value_type = 'i';
-    switch (signature->return_value_type)
+    switch (signature.return_value_type)
     {
     case SYMBOL_TYPE_FLOAT:
         return_value_type = 'f';
@@ -354,62 +667,197 @@ std::string CodeGen::unique_function_name(const std::unique_ptr<FunctionSignatur
         return_value_type = 'p';
     }
 
-    std::string&& stylized = std::move(std::format("{}{}_{}_{}", return_value_type, signature->name, mandatory_args, optional_args));
-    cache.insert({ (void*)&signature, stylized });
+    return std::format("{}{}_{}_{}", return_value_type, name, mandatory_args, optional_args);
+}
 
-    return cache.at((void*)&signature);
+llvm::Value* CodeGen::find_variable(Symbol name)
+{
+    for (auto it = scoped_symbol_table.rbegin(); it != scoped_symbol_table.rend(); ++it) {
+        auto variable = it->find(name);
+        if (variable != it->end()) return variable->second;
+    }
+    return nullptr;
 }
 
-void CodeGen::update_variable_value(const std::string& name, llvm::Value* value)
+llvm::Type* CodeGen::variable_type(llvm::Value* variable)
 {
-    for (auto it = scoped_symbol_table.end() - 1; it != scoped_symbol_table.begin(); it--)
-    {
-        if (it->contains(name)) {
-            it->insert_or_assign(name, value);
-            return;
-        }
+    if (auto local = llvm::dyn_cast<llvm::AllocaInst>(variable)) return local->getAllocatedType();
+    return llvm::cast<llvm::GlobalVariable>(variable)->getValueType();
+}
+
+llvm::Value* CodeGen::find_variable_value(Symbol name)
+{
+    llvm::Value* variable = find_variable(name);
+    return builder->CreateLoad(variable_type(variable), variable, symbol_name(name));
+}
+
+llvm::Value* CodeGen::default_value(SymbolType type)
+{
+    if (type == SYMBOL_TYPE_STRING) return build_literal_string("");
+    return llvm::Constant::getNullValue(symbol_type_to_type(type));
+}
+
+void CodeGen::release_lifecycle_resources()
+{
+    // the statements being generated end at this return, none of them gets to release its own temporaries
+    for (auto& lifecycle : lifecycles) {
+        for (auto value : lifecycle.values) builder->CreateCall(runtime.release_string, { value });
     }
-    if (scoped_symbol_table.front().contains(name)) { // global variable
-        auto global_variable = llvm::cast<llvm::GlobalVariable>(scoped_symbol_table.front().at(name));
-        builder->CreateStore(value, global_variable);
+    for (auto variable : owned_strings) {
+        builder->CreateCall(runtime.release_string, { builder->CreateLoad(variable_type(variable), variable) });
+    }
+}
+
+llvm::Value* CodeGen::temporary(llvm::Value* string)
+{
+    lifecycles.back().values.push_back(string);
+    return string;
+}
+
+llvm::Value* CodeGen::take_ownership(llvm::Value* string)
+{
+    // releasing a literal does nothing, it can be owned as it is
+    if (llvm::isa<llvm::Constant>(string)) return string;
+    for (auto lifecycle = lifecycles.rbegin(); lifecycle != lifecycles.rend(); ++lifecycle) {
+        auto found = std::find(lifecycle->values.begin(), lifecycle->values.end(), string);
+        if (found != lifecycle->values.end()) {
+            lifecycle->values.erase(found);
+            return string;
+        }
     }
+    return builder->CreateCall(runtime.retain_string, { string });
+}
+
+llvm::Value* CodeGen::build_literal_string(std::string_view str)
+{
+    auto found = literals.find(str);
+    if (found != literals.end()) return found->second;
+    // a ZString of the stdlib without references, which its runtime functions never change nor free
+    llvm::Constant* characters = llvm::ConstantDataArray::getString(*context, llvm::StringRef(str.data(), str.size()));
+    llvm::Constant* size = builder->getInt32(uint32_t(str.size()));
+    llvm::Constant* string = llvm::ConstantStruct::getAnon({ size, size, builder->getInt32(ZSTRING_LITERAL), characters });
+    auto variable = new llvm::GlobalVariable(*module, string->getType(), true, llvm::GlobalValue::PrivateLinkage, string, ".str");
+    variable->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    variable->setAlignment(llvm::Align(4));
+    literals.emplace(str, variable);
+    return variable;
 }
 
-llvm::Value* CodeGen::find_variable_value(const std::string& name)
+bool CodeGen::is_assigned(const ExprAST* expr, Symbol name)
 {
-    for (auto it = scoped_symbol_table.end() - 1; it != scoped_symbol_table.begin(); it--)
+    switch (expr->kind) {
+    case EXPR_CALL:
+    {
+        auto& call = static_cast<const CallExprAST&>(*expr);
+        return std::any_of(call.arguments.begin(), call.arguments.end(), [name](const ExprAST* argument) { return is_assigned(argument, name); });
+    }
+    case EXPR_RETURN:
     {
-        if (it->contains(name)) return it->at(name);
+        auto& ret = static_cast<const ReturnExprAST&>(*expr);
+        return ret.expr != nullptr && is_assigned(ret.expr, name);
     }
-    if (scoped_symbol_table.front().contains(name)) { // global variable
-        auto global_variable = llvm::cast<llvm::GlobalVariable>(scoped_symbol_table.front().at(name));
-        return builder->CreateLoad(global_variable->getValueType(), global_variable);
+    case EXPR_UNARY:
+        return is_assigned(static_cast<const UnaryExprAST&>(*expr).expr, name);
+    case EXPR_BINARY:
+    {
+        auto& binary = static_cast<const BinaryExprAST&>(*expr);
+        if (binary.op == '=' && binary.lhs->kind == EXPR_VARIABLE && static_cast<const VariableExprAST&>(*binary.lhs).name == name) return true;
+        return is_assigned(binary.lhs, name) || is_assigned(binary.rhs, name);
+    }
+    case EXPR_IF:
+    {
+        auto& if_expr = static_cast<const IfExprAST&>(*expr);
+        return is_assigned(if_expr.condition, name) || is_assigned(if_expr.then_body, name) || is_assigned(if_expr.else_body, name);
+    }
+    case EXPR_FOR:
+    {
+        auto& for_expr = static_cast<const ForExprAST&>(*expr);
+        return for_expr.variable->name == name || is_assigned(for_expr.start, name) || is_assigned(for_expr.end, name) || is_assigned(for_expr.body, name);
+    }
+    case EXPR_WHILE:
+    {
+        auto& while_expr = static_cast<const WhileExprAST&>(*expr);
+        return is_assigned(while_expr.condition, name) || is_assigned(while_expr.body, name);
+    }
+    case EXPR_REPEAT:
+    {
+        auto& repeat = static_cast<const RepeatExprAST&>(*expr);
+        return is_assigned(repeat.body, name) || (repeat.condition != nullptr && is_assigned(repeat.condition, name));
+    }
+    default:
+        return false;
     }
 }
 
-void CodeGen::release_lifecycle_resources(bool is_function_return, llvm::Value* return_value)
+bool CodeGen::is_assigned(std::span<ExprAST* const> body, Symbol name)
 {
-    while (lifecycles.size() > 0) {
-        for (auto value : lifecycles.top().values) {
-            if (value != return_value) {
-                builder->CreateCall(module->getFunction("_ziyue4d_release_string__"), { value });
-            }
-        }
-        if ((!is_function_return) || (is_function_return && lifecycles.top().is_function)) {
-            lifecycles.pop();
-            break;
-        }
-        else {
-            lifecycles.pop();
-        }
+    return std::any_of(body.begin(), body.end(), [name](const ExprAST* statement) { return is_assigned(statement, name); });
+}
+
+bool CodeGen::calls_function(const ExprAST* expr)
+{
+    switch (expr->kind) {
+    case EXPR_CALL:
+        return true;
+    case EXPR_UNARY:
+        return calls_function(static_cast<const UnaryExprAST&>(*expr).expr);
+    case EXPR_BINARY:
+        return calls_function(static_cast<const BinaryExprAST&>(*expr).lhs) || calls_function(static_cast<const BinaryExprAST&>(*expr).rhs);
+    default:
+        return false;
+    }
+}
+
+bool CodeGen::may_assign(std::span<const ExprAST* const> exprs, Symbol name, bool global)
+{
+    return std::any_of(exprs.begin(), exprs.end(), [name, global](const ExprAST* expr) { return is_assigned(expr, name) || (global && calls_function(expr)); });
+}
+
+void CodeGen::concatenated_pieces(const ExprAST* expr, std::vector<const ExprAST*>& pieces)
+{
+    if (expr->kind == EXPR_BINARY && expr->type == SYMBOL_TYPE_STRING && static_cast<const BinaryExprAST&>(*expr).op == '+') {
+        concatenated_pieces(static_cast<const BinaryExprAST&>(*expr).lhs, pieces);
+        concatenated_pieces(static_cast<const BinaryExprAST&>(*expr).rhs, pieces);
     }
+    else {
+        pieces.push_back(expr);
+    }
+}
+
+std::vector<const ExprAST*> CodeGen::appended_pieces(Symbol name, const ExprAST* value, bool global)
+{
+    std::vector<const ExprAST*> pieces;
+    concatenated_pieces(value, pieces);
+    if (pieces.size() < 2 || pieces[0]->kind != EXPR_VARIABLE || static_cast<const VariableExprAST&>(*pieces[0]).name != name) return {};
+    pieces.erase(pieces.begin());
+    // the variable is loaded after the pieces are evaluated, none of them may change it meanwhile
+    if (may_assign(pieces, name, global)) return {};
+    return pieces;
+}
+
+// the stdlib target compiles stdlib.bc at -O2, only the program module goes through the pipeline.
+// once `cancelled` turns true the passes left are skipped, the module is not worth finishing then
+static void optimize_module(llvm::Module& module, llvm::TargetMachine* target_machine, llvm::OptimizationLevel level, const std::atomic<bool>* cancelled = nullptr)
+{
+    llvm::LoopAnalysisManager loop_analyses;
+    llvm::FunctionAnalysisManager function_analyses;
+    llvm::CGSCCAnalysisManager cgscc_analyses;
+    llvm::ModuleAnalysisManager module_analyses;
+    llvm::PassInstrumentationCallbacks instrumentation;
+    if (cancelled != nullptr) instrumentation.registerShouldRunOptionalPassCallback([cancelled](llvm::StringRef, llvm::Any) { return !cancelled->load(); });
+    llvm::PassBuilder builder(target_machine, llvm::PipelineTuningOptions(), std::nullopt, &instrumentation);
+    builder.registerModuleAnalyses(module_analyses);
+    builder.registerCGSCCAnalyses(cgscc_analyses);
+    builder.registerFunctionAnalyses(function_analyses);
+    builder.registerLoopAnalyses(loop_analyses);
+    builder.crossRegisterProxies(loop_analyses, function_analyses, cgscc_analyses, module_analyses);
+    builder.buildPerModuleDefaultPipeline(level).run(module, module_analyses);
 }
 
-llvm::Value* CodeGen::build_literal_string(const std::string& str)
+static llvm::OptimizationLevel pipeline_level(unsigned optimization_level)
 {
-    llvm::Value* built_string = builder->CreateCall(module->getFunction("_ziyue4d_create_string__"), { builder->CreateGlobalStringPtr(str) });
-    lifecycles.top().values.insert(built_string);
-    return built_string;
+    static const llvm::OptimizationLevel levels[] = { llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1, llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3 };
+    return levels[std::min(optimization_level, 3u)];
 }
 
 void JIT::init()
@@ -418,25 +866,180 @@ void JIT::init()
     llvm::InitializeNativeTargetAsmPrinter();
     llvm::InitializeNativeTargetAsmParser();
     llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
-    auto jit = llvm::orc::LLJITBuilder().create();
+    auto target = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!target) throw std::runtime_error("failed to detect the host target");
+    this->target = std::make_unique<llvm::orc::JITTargetMachineBuilder>(*target);
+    llvm::TargetMachine* target_machine = thread_target_machine();
+    // the lazy JIT only differs once the program is added, so it is used either way
+    llvm::orc::LLLazyJITBuilder jit_builder;
+    jit_builder.setJITTargetMachineBuilder(std::move(*target));
+    // lazily, a function is compiled when it is called, on the thread calling it. compile threads would only sit idle
+    jit_builder.setNumCompileThreads(lazy ? 0 : compile_threads);
+    if (!object_cache_directory.empty()) {
+        std::string target_name = target_machine->getTargetTriple().str() + ' ' + target_machine->getTargetCPU().str() + ' ' + target_machine->getTargetFeatureString().str();
+        this->objects = std::make_unique<JITObjectCache>(object_cache_directory, std::move(target_name));
+        jit_builder.setCompileFunctionCreator(
+            [this](llvm::orc::JITTargetMachineBuilder target) -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+                return std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(target), objects.get());
+            });
+    }
+    auto jit = jit_builder.create();
     if (!jit) throw std::runtime_error("failed to initialize JIT");
     this->jit = std::move(*jit);
     this->jit->getMainJITDylib().addGenerator(
         llvm::cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
             this->jit->getDataLayout().getGlobalPrefix()))
     );
-    auto stdlib = llvm::parseBitcodeFile(**llvm::MemoryBuffer::getFile("stdlib.bc"), *context);
-    auto std_module = llvm::orc::ThreadSafeModule(std::move(*stdlib), std::make_unique<llvm::LLVMContext>());
-    auto program_module = llvm::orc::ThreadSafeModule(std::move(module), std::make_unique<llvm::LLVMContext>());
-    this->jit->addIRModule(std::move(std_module));
-    this->jit->addIRModule(std::move(program_module));
+    if (cancelled != nullptr) {
+        // a cancelled compile fails every module still to come, which is expected rather than worth reporting
+        this->jit->getExecutionSession().setErrorReporter([this](llvm::Error error) {
+            if (cancelled->load()) llvm::consumeError(std::move(error));
+            else llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "JIT session error: ");
+        });
+    }
+    if (optimization_level > 0 || objects != nullptr || cancelled != nullptr) {
+        llvm::OptimizationLevel level = pipeline_level(optimization_level);
+        this->jit->getIRTransformLayer().setTransform(
+            [this, level](llvm::orc::ThreadSafeModule module, const llvm::orc::MaterializationResponsibility&) -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+                auto given_up = [this] { return cancelled != nullptr && cancelled->load(); };
+                if (given_up()) return llvm::make_error<llvm::StringError>("compiling was cancelled", llvm::inconvertibleErrorCode());
+                module.withModuleDo([this, level](llvm::Module& module) {
+                    // a cached module is compiled from the object on disk, optimizing it would be wasted
+                    if (objects != nullptr && objects->prepare(module, optimization_level)) return;
+                    // compiled lazily, the program arrives one function at a time in modules named after it
+                    if (optimization_level > 0 && module.getName().starts_with("ziyue4d")) optimize_module(module, thread_target_machine(), level, cancelled);
+                });
+                // the optimizer may have stopped halfway, generating code for that would be wasted too
+                if (given_up()) return llvm::make_error<llvm::StringError>("compiling was cancelled", llvm::inconvertibleErrorCode());
+                return std::move(module);
+            });
+    }
+    if (!external_globals.empty()) {
+        llvm::orc::SymbolMap globals;
+        for (const auto& global : external_globals) {
+            globals[this->jit->mangleAndIntern(symbol_name(global.first))] = { llvm::orc::ExecutorAddr::fromPtr(global.second), llvm::JITSymbolFlags::Exported };
+        }
+        llvm::cantFail(this->jit->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(globals))));
+    }
+    if (inline_stdlib) link_stdlib_into_program();
+    // both modules live in the context of the code generator, the JIT owns it from now on
+    llvm::orc::ThreadSafeContext thread_safe_context(std::move(context));
+    if (link_stdlib && !inline_stdlib) {
+        auto stdlib = llvm::parseBitcodeFile(**llvm::MemoryBuffer::getFile("stdlib.bc"), *thread_safe_context.getContext());
+        this->jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(*stdlib), thread_safe_context));
+    }
+    auto add_program_module = [this](llvm::orc::ThreadSafeModule program_module) {
+        // each function is compiled the first time it is called, until then calls go through a stub
+        auto added = lazy ? this->jit->addLazyIRModule(std::move(program_module)) : this->jit->addIRModule(std::move(program_module));
+        if (added) throw std::runtime_error("failed to add the program to the JIT: " + llvm::toString(std::move(added)));
+    };
+    add_program_module(llvm::orc::ThreadSafeModule(std::move(module), thread_safe_context));
+    // the partitions do not share a context, so the compile threads can work on them at the same time
+    for (auto& partition : partitions) {
+        llvm::orc::ThreadSafeContext partition_context(std::move(partition->context));
+        add_program_module(llvm::orc::ThreadSafeModule(std::move(partition->module), partition_context));
+    }
 }
 
-int JIT::run()
+void JIT::link_stdlib_into_program()
+{
+    if (lazy || !partitions.empty()) throw std::runtime_error("the stdlib is only inlined into a program generated into a single module and compiled up front");
+    auto buffer = llvm::MemoryBuffer::getFile("stdlib.bc");
+    if (!buffer) throw std::runtime_error("failed to read stdlib.bc");
+    auto stdlib = llvm::parseBitcodeFile(**buffer, *context);
+    if (!stdlib) throw std::runtime_error("failed to parse stdlib.bc");
+    module->setDataLayout(jit->getDataLayout());
+    module->setTargetTriple(jit->getTargetTriple().str());
+    (*stdlib)->setDataLayout(module->getDataLayout());
+    (*stdlib)->setTargetTriple(module->getTargetTriple());
+    if (llvm::Linker::linkModules(*module, std::move(*stdlib))) throw std::runtime_error("failed to link the stdlib into the program");
+    // the annotations the manifest was written from would keep every stdlib function alive
+    if (auto annotations = module->getNamedGlobal("llvm.global.annotations")) annotations->eraseFromParent();
+    llvm::internalizeModule(*module, [](const llvm::GlobalValue& value) { return value.getName() == "__main"; });
+    // what the program does not call is dropped before it is optimized or compiled, the pipeline inlines the rest
+    llvm::ModuleAnalysisManager analyses;
+    llvm::PassBuilder().registerModuleAnalyses(analyses);
+    llvm::GlobalDCEPass().run(*module, analyses);
+}
+
+llvm::TargetMachine* JIT::thread_target_machine()
+{
+    std::lock_guard lock(target_machines_mutex);
+    auto& machine = target_machines[std::this_thread::get_id()];
+    if (machine == nullptr) {
+        auto created = target->createTargetMachine();
+        if (!created) throw std::runtime_error("failed to create the target machine");
+        machine = std::move(*created);
+    }
+    return machine.get();
+}
+
+JIT::MainFunction JIT::compile()
 {
-    jit->initialize(jit->getMainJITDylib());
+    if (auto error = jit->initialize(jit->getMainJITDylib())) throw codegen_exception(("failed to initialize the program: " + llvm::toString(std::move(error))).c_str());
     auto sym = jit->lookup("__main");
-    auto main = sym->toPtr<int (*)()>();
-    int result = main();
+    if (!sym) throw codegen_exception(("failed to compile the program: " + llvm::toString(sym.takeError())).c_str());
+    return sym->toPtr<MainFunction>();
+}
+
+int JIT::run()
+{
+    int result = compile()();
     return result;
 }
+
+void* JIT::address_of(const FunctionSignatureAST& function)
+{
+    auto symbol = jit->lookup(unique_function_name(function));
+    if (!symbol) throw codegen_exception(("failed to look up " + unique_function_name(function) + ": " + llvm::toString(symbol.takeError())).c_str());
+    return symbol->toPtr<void*>();
+}
+
+void AOT::emit_object(const std::filesystem::path& object)
+{
+    if (!partitions.empty()) throw std::runtime_error("programs compiled ahead of time are generated into a single module");
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto target = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!target) throw std::runtime_error("failed to detect the host target");
+    // executables are position independent by default on most systems
+    target->setRelocationModel(llvm::Reloc::PIC_);
+    auto machine = target->createTargetMachine();
+    if (!machine) throw std::runtime_error("failed to create the target machine");
+    module->setTargetTriple((*machine)->getTargetTriple().str());
+    module->setDataLayout((*machine)->createDataLayout());
+
+    auto buffer = llvm::MemoryBuffer::getFile("stdlib.bc");
+    if (!buffer) throw std::runtime_error("failed to read stdlib.bc");
+    auto stdlib = llvm::parseBitcodeFile(**buffer, *context);
+    if (!stdlib) throw std::runtime_error("failed to parse stdlib.bc");
+    (*stdlib)->setTargetTriple(module->getTargetTriple());
+    (*stdlib)->setDataLayout(module->getDataLayout());
+    // unlike the JIT, the stdlib is optimized along with the program, so its functions can be inlined
+    if (llvm::Linker::linkModules(*module, std::move(*stdlib))) throw std::runtime_error("failed to link the stdlib into the program");
+    if (optimization_level > 0) optimize_module(*module, machine->get(), pipeline_level(optimization_level));
+
+    std::error_code error;
+    llvm::raw_fd_ostream out(object.string(), error, llvm::sys::fs::OF_None);
+    if (error) throw std::runtime_error("failed to open " + object.string() + ": " + error.message());
+    llvm::legacy::PassManager passes;
+    if ((*machine)->addPassesToEmitFile(passes, out, nullptr, llvm::CodeGenFileType::ObjectFile))
+        throw std::runtime_error("the target cannot write object files");
+    passes.run(*module);
+}
+
+void AOT::link_executable(const std::filesystem::path& object, const std::filesystem::path& executable)
+{
+    // the stdlib is C++, so the executable is linked by a C++ compiler that brings its runtime along
+    auto compiler = llvm::sys::findProgramByName("clang++");
+    if (!compiler) throw std::runtime_error("clang++ is needed to link executables but was not found");
+    // the stdlib target builds the entry stub into the build directory, where the driver is too, so it is found whatever
+    // the working directory is
+    auto entry = std::filesystem::path(llvm::sys::fs::getMainExecutable(nullptr, nullptr)).parent_path() / "entry.o";
+    if (!std::filesystem::exists(entry)) throw std::runtime_error("the entry stub " + entry.string() + " is missing, build the stdlib target");
+    std::string object_path = object.string(), entry_path = entry.string(), output = executable.string();
+    llvm::StringRef arguments[] = { *compiler, object_path, entry_path, "-o", output };
+    std::string message;
+    if (llvm::sys::ExecuteAndWait(*compiler, arguments, std::nullopt, {}, 0, 0, &message) != 0)
+        throw std::runtime_error("failed to link " + output + (message.empty() ? "" : ": " + message));
+}
\ No newline at end of file
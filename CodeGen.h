@@ -1,56 +1,188 @@
 #pragma once
 
 #include "SemanticAnalyzer.h"
+#include "ObjectCache.h"
 #pragma warning(push)
 #pragma warning(disable: 4146 4996)
 #include <llvm/ExecutionEngine/Orc/LLJIT.h>
 #include <llvm/IR/IRBuilder.h>
 #pragma warning(pop)
-#include <stack>
+#include <array>
+#include <atomic>
+#include <filesystem>
 
+// the references of ZString literals in stdlib/std.hpp, which are never freed
+constexpr uint32_t ZSTRING_LITERAL = 0;
+// the kinds of the pieces build_string__ and append__ take, like in stdlib/std.hpp
+enum : uint8_t { ZPIECE_STRING, ZPIECE_INT, ZPIECE_FLOAT };
+
+// string temporaries of the statement or condition being generated, released once it is done
 struct Lifecycle {
-    bool is_function;
-    std::set<llvm::Value*> values;
+    std::vector<llvm::Value*> values;
 };
 
 class CodeGen {
 public:
-    CodeGen(std::unique_ptr<SemanticAnalyzer> semantic) : semantic(std::move(semantic)) {
+    CodeGen(std::shared_ptr<SemanticAnalyzer> semantic) : semantic(std::move(semantic)) {
         this->context = std::make_unique<llvm::LLVMContext>();
         this->builder = std::make_unique<llvm::IRBuilder<>>(*context);
         this->module = std::make_unique<llvm::Module>("ziyue4d", *context);
     }
     virtual ~CodeGen() {}
     llvm::Value* generate_functions();
+    // the first partition, which holds __main and the globals
+    const llvm::Module& generated_module() const { return *module; }
+
+    bool print_ir = true; // dump globals and functions to stderr as they are generated
+    // modules the functions are spread over, each with a context of its own so that they are generated and compiled in
+    // parallel. set before generate_functions()
+    unsigned partition_count = 1;
+    // where the globals live when the program is run by someone else who defines them, like the interpreter. the
+    // module only declares them then. set before generate_functions()
+    std::unordered_map<Symbol, void*> external_globals;
+
+    static bool is_assigned(const ExprAST* expr, Symbol name);
+    static bool is_assigned(std::span<ExprAST* const> body, Symbol name);
+    // whether evaluating one of `exprs` could assign the variable `name`. a global may be assigned by any function called
+    static bool may_assign(std::span<const ExprAST* const> exprs, Symbol name, bool global);
+    // the operands of a chain of string `+`, in order, with `expr` itself the only piece when it is no such chain
+    static void concatenated_pieces(const ExprAST* expr, std::vector<const ExprAST*>& pieces);
+    // the pieces `value` appends to the string variable `name` when it is `name + a + b...`, in order. empty when it is
+    // something else, or when a piece could assign the variable before it is appended to
+    static std::vector<const ExprAST*> appended_pieces(Symbol name, const ExprAST* value, bool global);
 
 private:
-    llvm::Value* visit(const std::unique_ptr<ExprAST>& expr);
+    // a partition after the first
+    CodeGen(const CodeGen& first, unsigned index) : CodeGen(first.semantic) {
+        this->module->setModuleIdentifier("ziyue4d." + std::to_string(index));
+        this->print_ir = false;
+        this->partition_count = first.partition_count;
+        this->partition_index = index;
+    }
+    // whether evaluating `expr` calls a function of the program or of the stdlib
+    static bool calls_function(const ExprAST* expr);
+    // defines the functions of this partition, the others are declared only
+    void generate_partition();
+    llvm::Value* visit(const ExprAST* expr);
+    llvm::Value* generate(const FloatExprAST& float_expr);
+    llvm::Value* generate(const IntegerExprAST& int_expr);
+    llvm::Value* generate(const StringExprAST& string);
+    llvm::Value* generate(const UnaryExprAST& unary_expr);
+    llvm::Value* generate(const BinaryExprAST& bi_expr);
+    llvm::Value* generate(const VariableExprAST& var);
+    llvm::Value* generate(const CallExprAST& call);
+    llvm::Value* generate(const ReturnExprAST& ret);
+    llvm::Value* generate(const IfExprAST& if_expr);
+    llvm::Value* generate(const ForExprAST& for_expr);
+    llvm::Value* generate(const WhileExprAST& while_expr);
+    llvm::Value* generate(const RepeatExprAST& repeat);
+    llvm::Value* generate(const ExprAST& expr);
+    void generate_block(std::span<ExprAST* const> body);
+    // an i1 that is true if `condition` is not zero
+    llvm::Value* generate_condition(const ExprAST* condition);
+    llvm::Value* generate_comparison(int op, llvm::Value* lhs, llvm::Value* rhs, SymbolType type);
+    llvm::Value* generate_assignment(Symbol name, SymbolType type, llvm::Value* value);
+    // `name = name + pieces...`, the variable's string is given up to the appends and replaced by what they return
+    llvm::Value* generate_append(Symbol name, std::span<const ExprAST* const> pieces);
+    // the kinds, values and count arguments of build_string__ and append__. the values are put in an array on the stack
+    std::array<llvm::Value*, 3> generate_pieces(std::span<const ExprAST* const> pieces);
     llvm::Value* cast_value_to(llvm::Value* value, SymbolType type);
-    llvm::FunctionType* create_function_type(const std::unique_ptr<FunctionSignatureAST>& signature);
+    llvm::FunctionType* create_function_type(const FunctionSignatureAST& signature);
     llvm::Type* token_to_type(Token token);
     llvm::Type* symbol_type_to_type(SymbolType type);
-    std::string unique_function_name(const std::unique_ptr<FunctionSignatureAST>& signature);
-    void update_variable_value(const std::string& name, llvm::Value* value);
-    llvm::Value* find_variable_value(const std::string& name);
-    void release_lifecycle_resources(bool is_function_return = false, llvm::Value* string_return_value = nullptr);
-    llvm::Value* build_literal_string(const std::string& str);
+    std::string unique_function_name(const FunctionSignatureAST& signature);
+    // the alloca or global holding the variable
+    llvm::Value* find_variable(Symbol name);
+    llvm::Type* variable_type(llvm::Value* variable);
+    llvm::Value* find_variable_value(Symbol name);
+    llvm::Value* default_value(SymbolType type);
+    // called before every return
+    void release_lifecycle_resources();
+    llvm::Value* temporary(llvm::Value* string);
+    // a string nobody else releases: a temporary is taken out of its lifecycle, anything else is retained
+    llvm::Value* take_ownership(llvm::Value* string);
+    // the constant ZString of the literal, emitted once per module. it is not a temporary, nobody releases it
+    llvm::Value* build_literal_string(std::string_view str);
 
     std::unique_ptr<llvm::LLVMContext> context;
     std::unique_ptr<llvm::IRBuilder<>> builder;
     std::unique_ptr<llvm::Module> module;
-    std::vector<std::unordered_map<std::string, llvm::Value*>> scoped_symbol_table = { {} };
-    std::stack<Lifecycle> lifecycles;
-    std::unique_ptr<SemanticAnalyzer> semantic;
+    std::vector<std::unordered_map<Symbol, llvm::Value*>> scoped_symbol_table = { {} };
+    std::vector<Lifecycle> lifecycles; // innermost last
+    std::vector<llvm::Value*> owned_strings; // variables whose string the function releases when it returns
+    std::unordered_map<std::string_view, llvm::GlobalVariable*> literals;
+    std::unordered_map<std::string, llvm::GlobalVariable*> piece_kinds; // constant arrays of ZPIECE_*, emitted once per module
+    const FunctionSignatureAST* current_signature = nullptr; // of the function being generated
+    std::shared_ptr<SemanticAnalyzer> semantic; // shared by the partitions
+    unsigned partition_index = 0;
+    std::vector<std::unique_ptr<CodeGen>> partitions; // after the first, which is this one
+    // every extern and function declared in the module, calls go through the callee the analyzer picked
+    std::unordered_map<const FunctionSignatureAST*, llvm::Function*> functions;
+    // stdlib functions the generated code calls on its own
+    struct {
+        llvm::Function* release_string = nullptr;
+        llvm::Function* int_to_string = nullptr;
+        llvm::Function* float_to_string = nullptr;
+        llvm::Function* retain_string = nullptr;
+        llvm::Function* build_string = nullptr;
+        llvm::Function* append = nullptr;
+        llvm::Function* compare_strings = nullptr;
+    } runtime;
 
     friend class JIT;
+    friend class AOT;
 };
 
 class JIT : public CodeGen {
 public:
-    JIT(std::unique_ptr<SemanticAnalyzer> semantic) : CodeGen(std::move(semantic)) {}
+    using MainFunction = int (*)();
+
+    JIT(std::shared_ptr<SemanticAnalyzer> semantic) : CodeGen(std::move(semantic)) {}
     void init();
+    // compiles the program on first use, optimizing it at `optimization_level`. when lazy, the functions are compiled as they are called instead.
+    // throws codegen_exception when the program does not compile or link, like for an extern nothing defines
+    MainFunction compile();
     int run();
+    // of a function of the program, after compile(). throws codegen_exception if it is not found
+    void* address_of(const FunctionSignatureAST& function);
+
+    unsigned optimization_level = 2; // 0 to 3 like -O0..-O3, set before init()
+    // threads the JIT compiles modules on, 0 compiles on the thread looking __main up. not used when lazy, set before init()
+    unsigned compile_threads = 0;
+    bool lazy = false; // compile each function when it is first called instead of all of them up front, set before init()
+    // false if the stdlib is loaded natively already, the program then calls that one instead of compiling stdlib.bc. set before init()
+    bool link_stdlib = true;
+    // links stdlib.bc into the program module instead of compiling it next to it, with everything but __main internal, so
+    // that the optimizer inlines stdlib wrappers into the program and the stdlib functions it does not call are dropped.
+    // address_of() cannot find the program's functions then. needs the program in one module compiled up front, set before init()
+    bool inline_stdlib = false;
+    std::filesystem::path object_cache_directory; // where compiled modules are kept between runs, none if empty. set before init()
+    // once it turns true, the modules not compiled yet are given up and compile() throws. none if null, set before init()
+    const std::atomic<bool>* cancelled = nullptr;
+    // null without an object cache directory
+    const JITObjectCache* object_cache() const { return objects.get(); }
 
 private:
-    std::unique_ptr<llvm::orc::LLJIT> jit;
+    void link_stdlib_into_program();
+    // for the cost models of the optimization passes. a target machine is not safe to share, so each thread gets its own
+    llvm::TargetMachine* thread_target_machine();
+
+    // declared before the JIT so that they outlive its compile threads
+    std::unique_ptr<JITObjectCache> objects;
+    std::unique_ptr<llvm::orc::JITTargetMachineBuilder> target;
+    std::mutex target_machines_mutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<llvm::TargetMachine>> target_machines;
+    std::unique_ptr<llvm::orc::LLLazyJIT> jit;
 };
+
+// compiles the program ahead of time: the module is linked with the stdlib, optimized as a whole and written as a
+// native object, which the entry stub built with the stdlib turns into an executable that starts without the JIT
+class AOT : public CodeGen {
+public:
+    AOT(std::unique_ptr<SemanticAnalyzer> semantic) : CodeGen(std::move(semantic)) {}
+    void emit_object(const std::filesystem::path& object);
+    // links an object written by emit_object with the entry stub next to the driver, using the clang++ found on PATH
+    static void link_executable(const std::filesystem::path& object, const std::filesystem::path& executable);
+
+    unsigned optimization_level = 2; // 0 to 3 like -O0..-O3
+};
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "Document.h"
+#include <algorithm>
+#include <iostream>
+
+Document::Document(std::string source) : source(std::move(source))
+{
+    // lexers are created per parsed region, see parse_region
+    auto ast = std::make_unique<AST>(nullptr);
+    auto function = ast->create_main();
+    this->main = function.get();
+    ast->function_table.emplace(MAIN_SYMBOL, std::move(function));
+    this->semantic = std::make_unique<SemanticAnalyzer>(std::move(ast));
+    this->arena_base = semantic->ast->arena.mark();
+
+    auto unit = std::make_unique<Unit>();
+    unit->end = this->source.size();
+    units.push_back(std::move(unit));
+    reparse(0, 1, true);
+}
+
+void Document::edit(const TextEdit& edit)
+{
+    if (edit.offset + edit.length > source.size()) throw std::out_of_range("edit is out of the document");
+    source.replace(edit.offset, edit.length, edit.text);
+
+    // every unit the edit touches, boundaries included, since an edit at the end of a unit can join it with the next one
+    size_t first = unit_at(edit.offset);
+    if (first > 0 && units[first]->begin == edit.offset) first--;
+    size_t last = unit_at(edit.offset + edit.length) + 1;
+
+    ptrdiff_t delta = (ptrdiff_t)edit.text.size() - (ptrdiff_t)edit.length;
+    units[last - 1]->end += delta;
+    for (size_t i = last; i < units.size(); i++) {
+        units[i]->begin += delta;
+        units[i]->end += delta;
+    }
+    reparse(first, last);
+    // nodes of replaced units stay in the arena until a full parse, do one once they outweigh the live nodes
+    if (semantic->ast->arena.size() > 2 * compacted_size + 65536) reparse(0, units.size(), true);
+}
+
+size_t Document::unit_at(size_t offset) const
+{
+    auto it = std::upper_bound(units.begin(), units.end(), offset, [](size_t offset, const std::unique_ptr<Unit>& unit) {
+        return offset < unit->begin;
+    });
+    return it == units.begin() ? 0 : it - units.begin() - 1;
+}
+
+void Document::reparse(size_t first, size_t last, bool full)
+{
+    size_t statement_index = std::count_if(units.begin(), units.begin() + first, [](const std::unique_ptr<Unit>& unit) {
+        return unit->kind == TOP_LEVEL_STATEMENT;
+    });
+    std::vector<std::unique_ptr<Unit>> removed;
+    auto take = [&](size_t index) {
+        remove_unit(*units[index], statement_index);
+        removed.push_back(std::move(units[index]));
+    };
+    for (size_t i = first; i < last; i++) take(i);
+    // nothing past the stdlib signatures is referenced anymore
+    if (first == 0 && last == units.size()) semantic->ast->arena.rewind(arena_base);
+
+    // a region that does not parse on its own (e.g. an unterminated function) grows until it does or reaches the end of the file
+    size_t begin = removed.front()->begin;
+    std::vector<std::unique_ptr<Unit>> parsed;
+    std::string error;
+    while (!parse_region(begin, removed.back()->end, statement_index, parsed, error) && last < units.size()) {
+        take(last++);
+    }
+    if (parsed.empty()) {
+        std::cerr << "invalid syntax at offset " << begin << ": " << error << '\n';
+        auto unit = std::make_unique<Unit>();
+        unit->begin = begin;
+        unit->end = removed.back()->end;
+        parsed.push_back(std::move(unit));
+    }
+
+    size_t count = parsed.size();
+    units.erase(units.begin() + first, units.begin() + last);
+    units.insert(units.begin() + first, std::make_move_iterator(parsed.begin()), std::make_move_iterator(parsed.end()));
+    for (size_t i = first; i < first + count; i++) {
+        for (auto& declaration : units[i]->log.declarations) {
+            if (is_variable_type(declaration.second)) global_owners.try_emplace(declaration.first, units[i].get());
+        }
+    }
+
+    if (full) {
+        semantic->analyze();
+        compacted_size = semantic->ast->arena.size();
+        return;
+    }
+    if (!is_consistent(removed, first, first + count)) {
+        reparse(0, units.size(), true);
+        return;
+    }
+
+    std::set<Symbol> replaced = replaced_signatures(removed, first, first + count);
+    for (Symbol name : replaced) semantic->index_overloads(name);
+    for (size_t i = first; i < first + count; i++) {
+        analyze_unit(*units[i], statement_index);
+        if (units[i]->kind == TOP_LEVEL_STATEMENT) statement_index++;
+    }
+    // calls outside the region still point at the removed signatures even if the new ones look the same
+    if (replaced.empty()) return;
+    statement_index = 0;
+    for (size_t i = 0; i < units.size(); i++) {
+        Unit& unit = *units[i];
+        bool outside = i < first || i >= first + count;
+        if (outside && std::any_of(unit.log.calls.begin(), unit.log.calls.end(), [&](Symbol callee) { return replaced.contains(callee); })) {
+            analyze_unit(unit, statement_index);
+        }
+        if (unit.kind == TOP_LEVEL_STATEMENT) statement_index++;
+    }
+}
+
+bool Document::parse_region(size_t begin, size_t end, size_t statement_index, std::vector<std::unique_ptr<Unit>>& parsed, std::string& error)
+{
+    AST& ast = *semantic->ast;
+    ast.lex = std::make_unique<Lex>(llvm::MemoryBuffer::getMemBuffer(llvm::StringRef(source.data() + begin, end - begin), "", false));
+    size_t statements = 0;
+    auto unit = std::make_unique<Unit>();
+    bool success = true;
+    try {
+        while (true) {
+            ast.log = &unit->log;
+            TopLevelItem item = ast.parse_top_level(*main);
+            ast.log = nullptr;
+            if (item.kind == TOP_LEVEL_NONE) break;
+            unit->begin = parsed.empty() ? begin : begin + item.offset;
+            unit->kind = item.kind;
+            unit->statement = item.statement;
+            unit->function = item.function;
+            unit->extern_function = item.extern_function;
+            FunctionSignatureAST* signature = item.function != nullptr ? item.function->signature.get() : item.extern_function;
+            if (signature != nullptr) unit->name = signature->name;
+            if (!parsed.empty()) parsed.back()->end = unit->begin;
+            if (item.kind == TOP_LEVEL_STATEMENT) statements++;
+            parsed.push_back(std::move(unit));
+            unit = std::make_unique<Unit>();
+            // the statement may go on past the region, only the whole rest of the file can tell
+            if (item.ends_at_eof && end != source.size()) {
+                error = "statement reaches the end of the region";
+                success = false;
+                break;
+            }
+        }
+    }
+    catch (std::exception& e) {
+        ast.log = nullptr;
+        error = e.what();
+        success = false;
+    }
+    ast.lex = nullptr;
+    ast.includes.clear(); // a document is a single file, includes are not followed
+
+    if (!success) {
+        undo_declarations(*unit);
+        while (!parsed.empty()) {
+            remove_unit(*parsed.back(), main->body.size() - 1);
+            parsed.pop_back();
+        }
+        return false;
+    }
+    if (parsed.empty()) {
+        unit->begin = begin;
+        parsed.push_back(std::move(unit));
+    }
+    parsed.back()->end = end;
+    std::rotate(main->body.begin() + statement_index, main->body.end() - statements, main->body.end());
+    return true;
+}
+
+void Document::remove_unit(Unit& unit, size_t statement_index)
+{
+    AST& ast = *semantic->ast;
+    switch (unit.kind) {
+    case TOP_LEVEL_STATEMENT:
+        main->body.erase(main->body.begin() + statement_index);
+        break;
+    case TOP_LEVEL_FUNCTION:
+    {
+        auto range = ast.function_table.equal_range(unit.function->signature->name);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second.get() == unit.function) {
+                ast.function_table.erase(it);
+                break;
+            }
+        }
+        break;
+    }
+    case TOP_LEVEL_EXTERN:
+        if (unit.extern_function != nullptr) ast.extern_function_table.erase(unit.extern_function->name);
+        break;
+    default:
+        break;
+    }
+    unit.statement = nullptr;
+    unit.function = nullptr;
+    unit.extern_function = nullptr;
+    undo_declarations(unit);
+}
+
+void Document::undo_declarations(Unit& unit)
+{
+    AST& ast = *semantic->ast;
+    for (auto& declaration : unit.log.declarations) {
+        auto range = ast.global_symbols.equal_range(declaration.first);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == declaration.second) {
+                ast.global_symbols.erase(it);
+                break;
+            }
+        }
+        auto owner = global_owners.find(declaration.first);
+        if (owner != global_owners.end() && owner->second == &unit) global_owners.erase(owner);
+    }
+}
+
+// the region parse equals a parse of the whole file when it declares the same globals and only relies on globals declared above it
+bool Document::is_consistent(const std::vector<std::unique_ptr<Unit>>& removed, size_t first, size_t last)
+{
+    auto variables = [](auto begin, auto end) {
+        std::vector<std::pair<Symbol, SymbolType>> result;
+        for (auto it = begin; it != end; ++it) {
+            for (auto& declaration : (*it)->log.declarations) {
+                if (is_variable_type(declaration.second)) result.push_back(declaration);
+            }
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    if (variables(removed.begin(), removed.end()) != variables(units.begin() + first, units.begin() + last)) return false;
+
+    // of several externs with one name the first one in the file is kept, which one that is takes a full parse to tell
+    auto is_extern = [](const std::unique_ptr<Unit>& unit) { return unit->kind == TOP_LEVEL_EXTERN; };
+    bool externs_changed = std::any_of(removed.begin(), removed.end(), is_extern) || std::any_of(units.begin() + first, units.begin() + last, is_extern);
+    if (externs_changed && std::any_of(units.begin(), units.end(), [](const std::unique_ptr<Unit>& unit) {
+        return unit->kind == TOP_LEVEL_EXTERN && unit->extern_function == nullptr;
+    })) return false;
+
+    size_t end = units[last - 1]->end;
+    for (size_t i = first; i < last; i++) {
+        for (Symbol name : units[i]->log.global_lookups) {
+            auto owner = global_owners.find(name);
+            if (owner == global_owners.end() || owner->second->begin >= end) return false;
+        }
+    }
+    return true;
+}
+
+std::set<Symbol> Document::replaced_signatures(const std::vector<std::unique_ptr<Unit>>& removed, size_t first, size_t last)
+{
+    std::set<Symbol> replaced;
+    for (auto& unit : removed) {
+        if (unit->name != Symbol()) replaced.insert(unit->name);
+    }
+    for (size_t i = first; i < last; i++) {
+        if (units[i]->name != Symbol()) replaced.insert(units[i]->name);
+    }
+    return replaced;
+}
+
+void Document::analyze_unit(Unit& unit, size_t statement_index)
+{
+    switch (unit.kind) {
+    case TOP_LEVEL_STATEMENT:
+        semantic->analyze_statement(*main, main->body.at(statement_index));
+        break;
+    case TOP_LEVEL_FUNCTION:
+        semantic->analyze_function(*unit.function);
+        break;
+    default:
+        break;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "SemanticAnalyzer.h"
+
+// replaces `length` bytes at `offset` with `text`
+struct TextEdit {
+    size_t offset;
+    size_t length;
+    std::string text;
+};
+
+// a source file kept parsed and analyzed between edits, an edit only re-lexes and re-parses
+// the top-level statements, functions and extern declarations it touches
+class Document {
+public:
+    Document(std::string source);
+
+    void edit(const TextEdit& edit);
+    const std::string& text() const { return source; }
+    SemanticAnalyzer& analyzer() { return *semantic; }
+
+private:
+    // one top-level item and the trivia following it, units cover the whole source without gaps
+    struct Unit {
+        size_t begin = 0;
+        size_t end = 0;
+        TopLevelKind kind = TOP_LEVEL_NONE;
+        ExprAST* statement = nullptr;
+        FunctionAST* function = nullptr;
+        FunctionSignatureAST* extern_function = nullptr;
+        // name of a function or extern, kept after the unit is removed
+        Symbol name = Symbol();
+        ParseLog log;
+    };
+
+    size_t unit_at(size_t offset) const;
+    void reparse(size_t first, size_t last, bool full = false);
+    bool parse_region(size_t begin, size_t end, size_t statement_index, std::vector<std::unique_ptr<Unit>>& parsed, std::string& error);
+    void remove_unit(Unit& unit, size_t statement_index);
+    void undo_declarations(Unit& unit);
+    bool is_consistent(const std::vector<std::unique_ptr<Unit>>& removed, size_t first, size_t last);
+    std::set<Symbol> replaced_signatures(const std::vector<std::unique_ptr<Unit>>& removed, size_t first, size_t last);
+    void analyze_unit(Unit& unit, size_t statement_index);
+
+    std::string source;
+    std::unique_ptr<SemanticAnalyzer> semantic;
+    FunctionAST* main = nullptr;
+    std::vector<std::unique_ptr<Unit>> units;
+    // the unit whose parse added a global variable, lookups of globals declared further down force a full parse
+    std::unordered_map<Symbol, Unit*> global_owners;
+    // the arena position after the stdlib signatures, and its size after the last full parse
+    Arena::Mark arena_base;
+    size_t compacted_size = 0;
+};
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "Interpreter.h"
+#include "exceptions.h"
+#include <llvm/Support/DynamicLibrary.h>
+#include <bit>
+#include <cstring>
+#include <iostream>
+
+// the stdlib compiled natively by the stdlib target, next to stdlib.bc. without it, its functions have to be linked
+// into the driver
+#ifdef _WIN32
+constexpr const char* NATIVE_STDLIB = "ziyue4d_stdlib.dll";
+#else
+constexpr const char* NATIVE_STDLIB = "libziyue4d_stdlib.so";
+#endif
+
+// a thunk is instantiated for every combination of argument types, functions taking more are not called natively
+constexpr size_t MAX_NATIVE_ARGUMENTS = 4;
+
+template<typename T>
+static T unpack(const Register& value)
+{
+    if constexpr (std::is_same_v<T, int32_t>) return value.i;
+    else if constexpr (std::is_same_v<T, float>) return value.f;
+    else return value.s;
+}
+
+template<typename Result, typename... Arguments>
+struct NativeCall {
+    static Register call(void* address, const Register* arguments)
+    {
+        return unpack_call(address, arguments, std::index_sequence_for<Arguments...>());
+    }
+
+    template<size_t... Indices>
+    static Register unpack_call(void* address, const Register* arguments, std::index_sequence<Indices...>)
+    {
+        auto function = reinterpret_cast<Result (*)(Arguments...)>(address);
+        Register result = {};
+        if constexpr (std::is_void_v<Result>) function(unpack<Arguments>(arguments[Indices])...);
+        else if constexpr (std::is_same_v<Result, int32_t>) result.i = function(unpack<Arguments>(arguments[Indices])...);
+        else if constexpr (std::is_same_v<Result, float>) result.f = function(unpack<Arguments>(arguments[Indices])...);
+        else result.s = function(unpack<Arguments>(arguments[Indices])...);
+        return result;
+    }
+};
+
+// the thunk of the signature, picked one argument type at a time
+template<typename... Arguments>
+static NativeThunk thunk_for(const FunctionSignatureAST& signature)
+{
+    constexpr size_t count = sizeof...(Arguments);
+    if (signature.arguments.size() > count) {
+        if constexpr (count < MAX_NATIVE_ARGUMENTS) {
+            switch (signature.arguments[count]->type) {
+            case SYMBOL_TYPE_INT: return thunk_for<Arguments..., int32_t>(signature);
+            case SYMBOL_TYPE_FLOAT: return thunk_for<Arguments..., float>(signature);
+            default: return thunk_for<Arguments..., const ZString*>(signature);
+            }
+        }
+        return nullptr;
+    }
+    switch (signature.return_value_type) {
+    case SYMBOL_TYPE_INT: return &NativeCall<int32_t, Arguments...>::call;
+    case SYMBOL_TYPE_FLOAT: return &NativeCall<float, Arguments...>::call;
+    case SYMBOL_TYPE_VOID: return &NativeCall<void, Arguments...>::call;
+    default: return &NativeCall<const ZString*, Arguments...>::call;
+    }
+}
+
+void* Interpreter::native_stdlib_function(std::string_view name)
+{
+    [[maybe_unused]] static const bool loaded = [] {
+        llvm::sys::DynamicLibrary::LoadLibraryPermanently(std::filesystem::absolute(NATIVE_STDLIB).string().c_str());
+        return llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    }();
+    void* address = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(std::string(name));
+    if (address == nullptr) throw codegen_exception(("the native stdlib lacks " + std::string(name) + ", rebuild the stdlib target").c_str());
+    return address;
+}
+
+Interpreter::Interpreter(std::shared_ptr<SemanticAnalyzer> semantic) : semantic(std::move(semantic))
+{
+    program = BytecodeCompiler(*this->semantic).compile();
+    auto resolve = native_stdlib_function;
+    runtime.release_string = reinterpret_cast<decltype(runtime.release_string)>(resolve("_ziyue4d_release_string__"));
+    runtime.int_to_string = reinterpret_cast<decltype(runtime.int_to_string)>(resolve("_ziyue4d_int_to_string__"));
+    runtime.float_to_string = reinterpret_cast<decltype(runtime.float_to_string)>(resolve("_ziyue4d_float_to_string__"));
+    runtime.build_string = reinterpret_cast<decltype(runtime.build_string)>(resolve("_ziyue4d_build_string__"));
+    runtime.append = reinterpret_cast<decltype(runtime.append)>(resolve("_ziyue4d_append__"));
+    runtime.retain_string = reinterpret_cast<decltype(runtime.retain_string)>(resolve("_ziyue4d_retain_string__"));
+    runtime.compare_strings = reinterpret_cast<decltype(runtime.compare_strings)>(resolve("_ziyue4d_compare_strings__"));
+    for (const FunctionSignatureAST* signature : program->externs) {
+        std::string_view name = symbol_name(signature->name);
+        NativeThunk thunk = thunk_for(*signature);
+        if (thunk == nullptr) throw codegen_exception(("the interpreter cannot pass that many arguments to " + std::string(name)).c_str());
+        externs.push_back({ resolve(name), thunk });
+    }
+    callees = std::make_unique<Callee[]>(program->functions.size());
+    for (size_t i = 0; i < program->functions.size(); i++) callees[i].thunk = thunk_for(*program->functions[i].signature);
+    for (const auto& literal : program->literals) {
+        // laid out like the literals CodeGen emits, the runtime never changes nor frees them
+        auto data = std::make_unique<uint32_t[]>(3 + (literal.size() + 4) / 4);
+        data[0] = uint32_t(literal.size());
+        data[1] = uint32_t(literal.size());
+        data[2] = ZSTRING_LITERAL;
+        std::memcpy(&data[3], literal.c_str(), literal.size() + 1);
+        literals.push_back({ .s = reinterpret_cast<const ZString*>(data.get()) });
+        literal_data.push_back(std::move(data));
+    }
+    globals = std::make_unique<Register[]>(program->globals.size());
+    stack = std::make_unique_for_overwrite<Register[]>(stack_size);
+}
+
+Interpreter::~Interpreter()
+{
+    // native code may still be compiling. nothing would run it anymore, so the compile is given up rather than waited for
+    cancelled = true;
+    if (compiler.joinable()) compiler.join();
+}
+
+int Interpreter::run()
+{
+    // a call in progress, where its caller continues once it returns
+    struct Frame {
+        const BytecodeFunction* function;
+        const Instruction* pc;
+        Register* registers;
+        uint16_t result;
+    };
+    std::vector<Frame> frames;
+    const BytecodeFunction* function = &program->functions[program->main];
+    const Instruction* pc = function->code.data();
+    Register* registers = stack.get();
+    const Register* stack_end = stack.get() + stack_size;
+    interpreted++;
+    for (;;) {
+        const Instruction& in = *pc++;
+        // ints wrap around like in the generated code
+        switch (in.op) {
+        case OP_MOVE: registers[in.a] = registers[in.b]; break;
+        case OP_INT: registers[in.a].i = in.immediate(); break;
+        case OP_FLOAT: registers[in.a].f = std::bit_cast<float>(in.immediate()); break;
+        case OP_STRING: registers[in.a] = literals[in.b]; break;
+        case OP_LOAD_GLOBAL: registers[in.a] = globals[in.b]; break;
+        case OP_STORE_GLOBAL: globals[in.a] = registers[in.b]; break;
+        case OP_ADD_INT: registers[in.a].i = int32_t(uint32_t(registers[in.b].i) + uint32_t(registers[in.c].i)); break;
+        case OP_SUB_INT: registers[in.a].i = int32_t(uint32_t(registers[in.b].i) - uint32_t(registers[in.c].i)); break;
+        case OP_MUL_INT: registers[in.a].i = int32_t(uint32_t(registers[in.b].i) * uint32_t(registers[in.c].i)); break;
+        case OP_DIV_INT: registers[in.a].i = registers[in.b].i / registers[in.c].i; break;
+        case OP_ADD_FLOAT: registers[in.a].f = registers[in.b].f + registers[in.c].f; break;
+        case OP_SUB_FLOAT: registers[in.a].f = registers[in.b].f - registers[in.c].f; break;
+        case OP_MUL_FLOAT: registers[in.a].f = registers[in.b].f * registers[in.c].f; break;
+        case OP_DIV_FLOAT: registers[in.a].f = registers[in.b].f / registers[in.c].f; break;
+        case OP_EQUAL_INT: registers[in.a].i = registers[in.b].i == registers[in.c].i; break;
+        case OP_NOT_EQUAL_INT: registers[in.a].i = registers[in.b].i != registers[in.c].i; break;
+        case OP_LESS_INT: registers[in.a].i = registers[in.b].i < registers[in.c].i; break;
+        case OP_GREATER_INT: registers[in.a].i = registers[in.b].i > registers[in.c].i; break;
+        case OP_LESS_EQUAL_INT: registers[in.a].i = registers[in.b].i <= registers[in.c].i; break;
+        case OP_GREATER_EQUAL_INT: registers[in.a].i = registers[in.b].i >= registers[in.c].i; break;
+        case OP_EQUAL_FLOAT: registers[in.a].i = registers[in.b].f == registers[in.c].f; break;
+        case OP_NOT_EQUAL_FLOAT: registers[in.a].i = registers[in.b].f != registers[in.c].f; break;
+        case OP_LESS_FLOAT: registers[in.a].i = registers[in.b].f < registers[in.c].f; break;
+        case OP_GREATER_FLOAT: registers[in.a].i = registers[in.b].f > registers[in.c].f; break;
+        case OP_LESS_EQUAL_FLOAT: registers[in.a].i = registers[in.b].f <= registers[in.c].f; break;
+        case OP_GREATER_EQUAL_FLOAT: registers[in.a].i = registers[in.b].f >= registers[in.c].f; break;
+        case OP_COMPARE_STRINGS: registers[in.a].i = runtime.compare_strings(registers[in.b].s, registers[in.c].s); break;
+        case OP_AND: registers[in.a].i = registers[in.b].i & registers[in.c].i; break;
+        case OP_OR: registers[in.a].i = registers[in.b].i | registers[in.c].i; break;
+        case OP_NEGATE_INT: registers[in.a].i = int32_t(0u - uint32_t(registers[in.b].i)); break;
+        case OP_NEGATE_FLOAT: registers[in.a].f = 0.0f - registers[in.b].f; break;
+        case OP_NOT_INT: registers[in.a].i = registers[in.b].i == 0; break;
+        case OP_NOT_FLOAT: registers[in.a].i = registers[in.b].f == 0.0f; break;
+        case OP_INT_TO_FLOAT: registers[in.a].f = float(registers[in.b].i); break;
+        case OP_FLOAT_TO_INT: registers[in.a].i = int32_t(registers[in.b].f); break;
+        case OP_INT_TO_STRING: registers[in.a].s = runtime.int_to_string(registers[in.b].i); break;
+        case OP_FLOAT_TO_STRING: registers[in.a].s = runtime.float_to_string(registers[in.b].f); break;
+        case OP_POINTER_TO_INT: registers[in.a].i = int32_t(intptr_t(registers[in.b].s)); break;
+        case OP_BUILD_STRING:
+        {
+            const std::string& kinds = program->piece_kinds[in.c];
+            registers[in.a].s = runtime.build_string(reinterpret_cast<const uint8_t*>(kinds.data()), registers + in.b, int(kinds.size()));
+            break;
+        }
+        case OP_APPEND:
+        {
+            const std::string& kinds = program->piece_kinds[in.c];
+            registers[in.a].s = runtime.append(registers[in.a].s, reinterpret_cast<const uint8_t*>(kinds.data()), registers + in.b, int(kinds.size()));
+            break;
+        }
+        case OP_RETAIN_STRING: registers[in.a].s = runtime.retain_string(registers[in.b].s); break;
+        case OP_RELEASE: runtime.release_string(registers[in.a].s); break;
+        case OP_JUMP: pc = function->code.data() + in.immediate(); break;
+        case OP_JUMP_IF_ZERO:
+            if (registers[in.a].i == 0) pc = function->code.data() + in.immediate();
+            break;
+        case OP_CALL:
+        {
+            Callee& callee = callees[in.b];
+            if (void* address = callee.native.load(std::memory_order_acquire)) {
+                registers[in.a] = callee.thunk(address, registers + in.c);
+                native++;
+                break;
+            }
+            if (++callee.calls == tier_up_threshold) tier_up();
+            const BytecodeFunction& target = program->functions[in.b];
+            // the frame of the callee follows the caller's, the arguments are its first registers
+            Register* callee_registers = registers + function->register_count;
+            if (callee_registers + target.register_count > stack_end) throw std::runtime_error("the interpreter ran out of stack");
+            std::copy_n(registers + in.c, target.signature->arguments.size(), callee_registers);
+            frames.push_back({ function, pc, registers, in.a });
+            function = &target;
+            pc = target.code.data();
+            registers = callee_registers;
+            interpreted++;
+            break;
+        }
+        case OP_CALL_EXTERN:
+            registers[in.a] = externs[in.b].thunk(externs[in.b].address, registers + in.c);
+            break;
+        case OP_RETURN:
+        case OP_RETURN_VOID:
+        {
+            Register result = in.op == OP_RETURN ? registers[in.a] : Register{};
+            if (frames.empty()) return result.i;
+            const Frame& caller = frames.back();
+            function = caller.function;
+            pc = caller.pc;
+            registers = caller.registers;
+            registers[caller.result] = result;
+            frames.pop_back();
+            break;
+        }
+        }
+    }
+}
+
+void Interpreter::tier_up()
+{
+    // several functions get hot, the program is compiled once
+    if (compiler.joinable()) return;
+    compiler = std::thread([this] { compile_program(); });
+}
+
+void Interpreter::compile_program()
+{
+    try {
+        auto compiled = std::make_unique<JIT>(semantic);
+        compiled->print_ir = false;
+        compiled->optimization_level = optimization_level;
+        compiled->object_cache_directory = object_cache_directory;
+        // the native code shares the stdlib and the globals with the interpreter, which goes on running meanwhile
+        compiled->link_stdlib = false;
+        for (size_t i = 0; i < program->globals.size(); i++) compiled->external_globals.emplace(program->globals[i].first, &globals[i]);
+        compiled->cancelled = &cancelled;
+        compiled->generate_functions();
+        if (cancelled) return;
+        compiled->init();
+        compiled->compile();
+        jit = std::move(compiled);
+        // main runs once and is running already
+        for (size_t i = 0; i < program->functions.size(); i++) {
+            if (i == program->main || callees[i].thunk == nullptr) continue;
+            callees[i].native.store(jit->address_of(*program->functions[i].signature), std::memory_order_release);
+        }
+    }
+    catch (const std::exception& error) {
+        // the program goes on in the interpreter, unless it is done and cancelled the compile
+        if (!cancelled) std::cerr << "compiling the program in the background failed: " << error.what() << '\n';
+    }
+}
\ No newline at end of file
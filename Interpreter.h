@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Bytecode.h"
+#include "CodeGen.h"
+#include <atomic>
+
+struct ZString; // of the stdlib
+
+// what a register or a global holds, ints and floats take its first bytes like in a variable of their own. laid out like
+// ZValue of the stdlib, so that registers are passed as the pieces of a string
+union Register {
+    int32_t i;
+    float f;
+    const ZString* s;
+};
+static_assert(sizeof(Register) == sizeof(void*));
+
+// calls a native function with arguments taken from registers, there is one for each signature
+using NativeThunk = Register (*)(void* address, const Register* arguments);
+
+// runs the program as bytecode right away, without waiting for LLVM, and calls the stdlib natively. a function
+// called often enough has the program compiled by the JIT on a thread of its own meanwhile, its calls are
+// run natively once that is done. a call already running stays in the interpreter, there is no on-stack replacement
+class Interpreter {
+public:
+    // throws codegen_exception for programs it cannot run and without the native stdlib, the JIT still can run them
+    Interpreter(std::shared_ptr<SemanticAnalyzer> semantic);
+    ~Interpreter();
+    // throws std::runtime_error when calls nest deeper than its stack
+    int run();
+
+    // calls of one function that start compiling the program, 0 never does. set before run()
+    unsigned tier_up_threshold = 1000;
+    unsigned optimization_level = 2; // of the compiled program, set before run()
+    std::filesystem::path object_cache_directory; // passed on to the JIT, set before run()
+    size_t interpreted_calls() const { return interpreted; }
+    size_t native_calls() const { return native; }
+    // the address of a function of the native stdlib, which is loaded on first use. throws codegen_exception without it
+    static void* native_stdlib_function(std::string_view name);
+
+private:
+    struct Callee {
+        std::atomic<void*> native = nullptr; // set once compiled
+        NativeThunk thunk = nullptr; // null for functions with too many arguments, they stay in the interpreter
+        unsigned calls = 0;
+    };
+    struct Extern {
+        void* address;
+        NativeThunk thunk;
+    };
+
+    void tier_up();
+    // on the compiler thread
+    void compile_program();
+
+    std::shared_ptr<SemanticAnalyzer> semantic;
+    std::unique_ptr<BytecodeProgram> program;
+    std::unique_ptr<Callee[]> callees; // like program->functions
+    std::vector<Extern> externs; // like program->externs
+    std::vector<Register> literals;
+    std::vector<std::unique_ptr<uint32_t[]>> literal_data; // the ZStrings of the literals
+    std::unique_ptr<Register[]> globals; // their addresses are given to the JIT
+    std::unique_ptr<Register[]> stack; // the registers of the frames, one after the other
+    size_t stack_size = 1 << 20;
+    // stdlib functions the instructions call
+    struct {
+        void (*release_string)(const ZString*) = nullptr;
+        const ZString* (*int_to_string)(int32_t) = nullptr;
+        const ZString* (*float_to_string)(float) = nullptr;
+        const ZString* (*build_string)(const uint8_t* kinds, const Register* values, int count) = nullptr;
+        const ZString* (*append)(const ZString*, const uint8_t* kinds, const Register* values, int count) = nullptr;
+        const ZString* (*retain_string)(const ZString*) = nullptr;
+        int32_t (*compare_strings)(const ZString*, const ZString*) = nullptr;
+    } runtime;
+    size_t interpreted = 0;
+    size_t native = 0;
+    std::unique_ptr<JIT> jit; // set on the compiler thread, native code runs from it
+    std::thread compiler;
+    std::atomic<bool> cancelled = false; // the compiler thread gives up once it is set
+};
\ No newline at end of file
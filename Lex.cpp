@@ -1,62 +1,99 @@
 #include "Lex.h"
+#include "LexScan.h"
+#include <charconv>
 
-int Lex::get_token() {
-    static int last_char = ' ';    
+void Lex::rewind() {
+    // leading blank lines never produce an end of statement
+    cursor = scan_kernels().skip_whitespace(buffer->getBufferStart(), buffer->getBufferEnd());
+    end = buffer->getBufferEnd();
+    token_begin = cursor;
+}
 
-    if (last_char == '\n' || last_char == ':') { last_char = file->get(); return TOKEN_END_OF_STMT; }
+int Lex::get_token() {
+    // cursor always points at the next unread character, cursor == end means EOF
+    if (cursor != end && (*cursor == '\n' || *cursor == ':')) { token_begin = cursor++; return TOKEN_END_OF_STMT; }
 
-    while (isspace(last_char)) last_char = file->get();
-    if (last_char == '%') { last_char = file->get(); return TOKEN_TYPE_INT; }
-    if (last_char == '#') { last_char = file->get(); return TOKEN_TYPE_FLOAT; }
-    if (last_char == '$') { last_char = file->get(); return TOKEN_TYPE_STRING; }
-    if (last_char == '!') { last_char = file->get(); return TOKEN_LOGIC_NOT; }
+    const ScanKernels& scan = scan_kernels();
+    cursor = scan.skip_whitespace(cursor, end);
+    token_begin = cursor;
+    if (cursor == end) return TOKEN_EOF;
+    if (*cursor == '%') { cursor++; return TOKEN_TYPE_INT; }
+    if (*cursor == '#') { cursor++; return TOKEN_TYPE_FLOAT; }
+    if (*cursor == '$') { cursor++; return TOKEN_TYPE_STRING; }
+    if (*cursor == '!') { cursor++; return TOKEN_LOGIC_NOT; }
+    if (*cursor == '<' || *cursor == '>') {
+        char first = *cursor++;
+        if (cursor != end && *cursor == '=') { cursor++; return first == '<' ? TOKEN_LESS_EQUAL : TOKEN_GREATER_EQUAL; }
+        if (first == '<' && cursor != end && *cursor == '>') { cursor++; return TOKEN_NOT_EQUAL; }
+        return first;
+    }
 
-    if (last_char == '\"') {
-        string_value.clear();
-        while ((last_char = file->get()) != '\"') {
-            if (last_char == '\n') throw lex_exception("mismatched quotes");
-            string_value += last_char;
-        }
-        last_char = file->get();
+    if (*cursor == '\"') {
+        const char* begin = ++cursor;
+        cursor = scan.find_string_end(cursor, end);
+        if (cursor == end || *cursor == '\n') throw lex_exception("mismatched quotes");
+        string_value = std::string_view(begin, cursor - begin);
+        cursor++;
         return TOKEN_STRING;
     }
 
-    if (isalpha(last_char)) {
-        identifier = tolower(last_char);
-        while (isalnum(last_char = file->get())) identifier += tolower(last_char);
-        if (tokens.contains(identifier)) return tokens.at(identifier);
-        return TOKEN_IDENTIFIER;
+    if (isalpha((unsigned char)*cursor)) {
+        const char* begin = cursor;
+        bool has_upper = false;
+        cursor = scan.scan_identifier(cursor, end, has_upper);
+        if (has_upper) {
+            // identifiers are case-insensitive, only mixed-case ones need a folded copy
+            folded_identifier.resize(cursor - begin);
+            scan.fold_case(begin, cursor - begin, folded_identifier.data());
+            identifier = folded_identifier;
+        }
+        else {
+            identifier = std::string_view(begin, cursor - begin);
+        }
+        symbol = intern(identifier);
+        return keyword_token(symbol);
     }
 
-    if (isdigit(last_char) || last_char == '.') {
-        std::string number;
+    if (isdigit((unsigned char)*cursor) || *cursor == '.') {
+        const char* begin = cursor;
         Token type = TOKEN_INTEGER;
+        bool separated = false;
         do {
-            if (last_char != '_') {
-                number += last_char;
-                if (last_char == '.') type = TOKEN_FLOAT;
+            if (*cursor == '.') type = TOKEN_FLOAT;
+            if (*cursor == '_') separated = true;
+            cursor++;
+        } while (cursor != end && (isdigit((unsigned char)*cursor) || *cursor == '.' || *cursor == '_'));
+        // parsed where it is in the buffer, only digits separated by underscores are copied without them
+        char number[64];
+        const char* first = begin;
+        const char* last = cursor;
+        if (separated) {
+            size_t length = 0;
+            for (const char* c = begin; c != cursor; c++) {
+                if (*c == '_') continue;
+                if (length == sizeof(number)) throw lex_exception("number literal is too long");
+                number[length++] = *c;
             }
-            last_char = file->get();
-        } while (isdigit(last_char) || last_char == '.' || last_char == '_');
+            first = number;
+            last = number + length;
+        }
         if (type == TOKEN_INTEGER) {
-            int_value = atoi(number.c_str());
+            if (std::from_chars(first, last, int_value).ec != std::errc()) throw lex_exception("integer literal is out of range");
         }
         else {
-            float_value = strtof(number.c_str(), nullptr);
+            auto result = std::from_chars(first, last, float_value);
+            if (result.ec == std::errc::result_out_of_range) throw lex_exception("float literal is out of range");
+            // a lone dot is 0
+            if (result.ec == std::errc::invalid_argument) float_value = .0f;
         }
         return type;
     }
 
-    if (last_char == ';') {
-        do {
-            last_char = file->get();
-        } while (last_char != EOF && last_char != '\n' && last_char != '\r');
-        if (last_char != EOF) return get_token();
+    if (*cursor == ';') {
+        cursor = scan.find_line_end(cursor + 1, end);
+        if (cursor != end) return get_token();
+        return TOKEN_EOF;
     }
 
-    if (last_char == EOF) return TOKEN_EOF;
-
-    int curr_char = last_char;
-    last_char = file->get();
-    return curr_char;
+    return (unsigned char)*cursor++;
 }
\ No newline at end of file
@@ -1,8 +1,9 @@
 #pragma once
 
-#include "Token.h"
+#include "Symbol.h"
 #include "exceptions.h"
-#include <fstream>
+#include <llvm/Support/MemoryBuffer.h>
+#include <string_view>
 
 constexpr bool is_variable_type(SymbolType type) {
     return type == SYMBOL_TYPE_INT || type == SYMBOL_TYPE_FLOAT || type == SYMBOL_TYPE_STRING || type == SYMBOL_TYPE_STRUCT;
@@ -24,19 +25,36 @@ constexpr SymbolType token_to_type(Token token) {
 
 class Lex {
 public:
-    std::string identifier = "";
+    // token text points into the source buffer (or a folding buffer for identifiers), valid until the next get_token()
+    std::string_view identifier;
+    Symbol symbol = Symbol();
     int int_value = 0;
-    std::string string_value = "";
+    std::string_view string_value;
     float float_value = .0f;
 
     Lex(std::string file) {
-        this->file = std::move(std::make_unique<std::ifstream>(file));
+        // large files are mapped instead of read
+        auto buffer = llvm::MemoryBuffer::getFile(file, false, false);
+        if (!buffer) throw std::exception("Failed to open source file");
+        this->buffer = std::move(*buffer);
+        rewind();
+    }
 
-        if (!this->file->good()) throw std::exception("Failed to open source file");
+    // in-memory sources, use llvm::MemoryBuffer::getMemBuffer to lex without copying
+    Lex(std::unique_ptr<llvm::MemoryBuffer> buffer) : buffer(std::move(buffer)) {
+        rewind();
     }
 
     int get_token();
+    // where the last token returned by get_token() starts in the buffer
+    size_t token_offset() const { return token_begin - buffer->getBufferStart(); }
 
 private:
-    std::unique_ptr<std::ifstream> file;
+    void rewind();
+
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    const char* cursor = nullptr;
+    const char* end = nullptr;
+    const char* token_begin = nullptr;
+    std::string folded_identifier;
 };
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "LexScan.h"
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ZIYUE4D_SCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ZIYUE4D_TARGET_AVX2
+#define ZIYUE4D_CTZ(x) _tzcnt_u32(x)
+#else
+#define ZIYUE4D_TARGET_AVX2 __attribute__((target("avx2")))
+#define ZIYUE4D_CTZ(x) __builtin_ctz(x)
+#endif
+#endif
+
+// ' ', '\t', '\n', '\v', '\f', '\r', same as isspace in the C locale
+static inline bool is_space(unsigned char c) { return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t'; }
+static inline bool is_upper(unsigned char c) { return (unsigned char)(c - 'A') <= 'Z' - 'A'; }
+static inline bool is_identifier(unsigned char c) {
+    return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a' || (unsigned char)(c - '0') <= 9;
+}
+
+static const char* skip_whitespace_scalar(const char* begin, const char* end) {
+    while (begin != end && is_space(*begin)) begin++;
+    return begin;
+}
+
+static const char* scan_identifier_scalar(const char* begin, const char* end, bool& has_upper) {
+    while (begin != end && is_identifier(*begin)) has_upper |= is_upper(*begin++);
+    return begin;
+}
+
+static const char* find_line_end_scalar(const char* begin, const char* end) {
+    while (begin != end && *begin != '\n' && *begin != '\r') begin++;
+    return begin;
+}
+
+static const char* find_string_end_scalar(const char* begin, const char* end) {
+    while (begin != end && *begin != '\"' && *begin != '\n') begin++;
+    return begin;
+}
+
+static void fold_case_scalar(const char* source, size_t length, char* destination) {
+    for (size_t i = 0; i < length; i++) {
+        destination[i] = source[i] + (is_upper(source[i]) ? 'a' - 'A' : 0);
+    }
+}
+
+#ifdef ZIYUE4D_SCAN_X86
+
+// unsigned "c - low <= high - low" on every byte
+static inline __m128i in_range_sse2(__m128i c, char low, char high) {
+    __m128i shifted = _mm_sub_epi8(c, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(high - low)), shifted);
+}
+
+static inline __m128i is_identifier_sse2(__m128i c) {
+    return _mm_or_si128(in_range_sse2(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z'), in_range_sse2(c, '0', '9'));
+}
+
+static const char* skip_whitespace_sse2(const char* begin, const char* end) {
+    // most tokens are separated by a single space or none at all
+    if (begin != end && !is_space(*begin)) return begin;
+    if (end - begin >= 2 && !is_space(begin[1])) return begin + 1;
+    for (; end - begin >= 16; begin += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)begin);
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), in_range_sse2(c, '\t', '\r'));
+        unsigned stop = ~_mm_movemask_epi8(space) & 0xFFFF;
+        if (stop) return begin + ZIYUE4D_CTZ(stop);
+    }
+    return skip_whitespace_scalar(begin, end);
+}
+
+static const char* scan_identifier_sse2(const char* begin, const char* end, bool& has_upper) {
+    for (; end - begin >= 16; begin += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)begin);
+        unsigned stop = ~_mm_movemask_epi8(is_identifier_sse2(c)) & 0xFFFF;
+        unsigned upper = _mm_movemask_epi8(in_range_sse2(c, 'A', 'Z'));
+        if (stop) {
+            unsigned length = ZIYUE4D_CTZ(stop);
+            has_upper |= (upper & ((1u << length) - 1)) != 0;
+            return begin + length;
+        }
+        has_upper |= upper != 0;
+    }
+    return scan_identifier_scalar(begin, end, has_upper);
+}
+
+static const char* find_line_end_sse2(const char* begin, const char* end) {
+    for (; end - begin >= 16; begin += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)begin);
+        unsigned stop = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\r'))));
+        if (stop) return begin + ZIYUE4D_CTZ(stop);
+    }
+    return find_line_end_scalar(begin, end);
+}
+
+static const char* find_string_end_sse2(const char* begin, const char* end) {
+    for (; end - begin >= 16; begin += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)begin);
+        unsigned stop = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\"')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\n'))));
+        if (stop) return begin + ZIYUE4D_CTZ(stop);
+    }
+    return find_string_end_scalar(begin, end);
+}
+
+static void fold_case_sse2(const char* source, size_t length, char* destination) {
+    size_t i = 0;
+    for (; length - i >= 16; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(source + i));
+        __m128i folded = _mm_add_epi8(c, _mm_and_si128(in_range_sse2(c, 'A', 'Z'), _mm_set1_epi8('a' - 'A')));
+        _mm_storeu_si128((__m128i*)(destination + i), folded);
+    }
+    fold_case_scalar(source + i, length - i, destination + i);
+}
+
+ZIYUE4D_TARGET_AVX2 static inline __m256i in_range_avx2(__m256i c, char low, char high) {
+    __m256i shifted = _mm256_sub_epi8(c, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(high - low)), shifted);
+}
+
+ZIYUE4D_TARGET_AVX2 static const char* skip_whitespace_avx2(const char* begin, const char* end) {
+    if (begin != end && !is_space(*begin)) return begin;
+    if (end - begin >= 2 && !is_space(begin[1])) return begin + 1;
+    for (; end - begin >= 32; begin += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)begin);
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), in_range_avx2(c, '\t', '\r'));
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(space);
+        if (stop) return begin + ZIYUE4D_CTZ(stop);
+    }
+    return skip_whitespace_sse2(begin, end);
+}
+
+ZIYUE4D_TARGET_AVX2 static const char* scan_identifier_avx2(const char* begin, const char* end, bool& has_upper) {
+    for (; end - begin >= 32; begin += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)begin);
+        __m256i identifier = _mm256_or_si256(in_range_avx2(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z'), in_range_avx2(c, '0', '9'));
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(identifier);
+        unsigned upper = (unsigned)_mm256_movemask_epi8(in_range_avx2(c, 'A', 'Z'));
+        if (stop) {
+            unsigned length = ZIYUE4D_CTZ(stop);
+            has_upper |= (upper & ((1u << length) - 1)) != 0;
+            return begin + length;
+        }
+        has_upper |= upper != 0;
+    }
+    return scan_identifier_sse2(begin, end, has_upper);
+}
+
+ZIYUE4D_TARGET_AVX2 static const char* find_line_end_avx2(const char* begin, const char* end) {
+    for (; end - begin >= 32; begin += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)begin);
+        unsigned stop = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\r'))));
+        if (stop) return begin + ZIYUE4D_CTZ(stop);
+    }
+    return find_line_end_sse2(begin, end);
+}
+
+ZIYUE4D_TARGET_AVX2 static const char* find_string_end_avx2(const char* begin, const char* end) {
+    for (; end - begin >= 32; begin += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)begin);
+        unsigned stop = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\"')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'))));
+        if (stop) return begin + ZIYUE4D_CTZ(stop);
+    }
+    return find_string_end_sse2(begin, end);
+}
+
+ZIYUE4D_TARGET_AVX2 static void fold_case_avx2(const char* source, size_t length, char* destination) {
+    size_t i = 0;
+    for (; length - i >= 32; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(source + i));
+        __m256i folded = _mm256_add_epi8(c, _mm256_and_si256(in_range_avx2(c, 'A', 'Z'), _mm256_set1_epi8('a' - 'A')));
+        _mm256_storeu_si256((__m256i*)(destination + i), folded);
+    }
+    fold_case_sse2(source + i, length - i, destination + i);
+}
+
+static bool cpu_supports_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool avx = (info[2] & (1 << 28)) != 0, osxsave = (info[2] & (1 << 27)) != 0;
+    if (!avx || !osxsave || (_xgetbv(0) & 6) != 6) return false; // the OS must save ymm registers
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static const ScanKernels kernels[] = {
+    { SCAN_KERNEL_SCALAR, skip_whitespace_scalar, scan_identifier_scalar, find_line_end_scalar, find_string_end_scalar, fold_case_scalar },
+#ifdef ZIYUE4D_SCAN_X86
+    { SCAN_KERNEL_SSE2, skip_whitespace_sse2, scan_identifier_sse2, find_line_end_sse2, find_string_end_sse2, fold_case_sse2 },
+    { SCAN_KERNEL_AVX2, skip_whitespace_avx2, scan_identifier_avx2, find_line_end_avx2, find_string_end_avx2, fold_case_avx2 },
+#endif
+};
+
+ScanKernel best_scan_kernel() {
+#ifdef ZIYUE4D_SCAN_X86
+    static const ScanKernel best = cpu_supports_avx2() ? SCAN_KERNEL_AVX2 : SCAN_KERNEL_SSE2; // sse2 is baseline on x86-64
+    return best;
+#else
+    return SCAN_KERNEL_SCALAR;
+#endif
+}
+
+static std::atomic<const ScanKernels*> active_kernels = nullptr;
+
+const ScanKernels& scan_kernels() {
+    const ScanKernels* current = active_kernels.load(std::memory_order_relaxed);
+    if (current == nullptr) {
+        current = &kernels[best_scan_kernel()];
+        active_kernels.store(current, std::memory_order_relaxed);
+    }
+    return *current;
+}
+
+void use_scan_kernel(ScanKernel kernel) {
+    if (kernel > best_scan_kernel()) kernel = best_scan_kernel();
+    active_kernels.store(&kernels[kernel], std::memory_order_relaxed);
+}
+
+const char* scan_kernel_name(ScanKernel kernel) {
+    switch (kernel) {
+    case SCAN_KERNEL_SSE2:
+        return "sse2";
+    case SCAN_KERNEL_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+// character class scanners for Lex, each one returns the first position in [begin, end) where the scan stops
+enum ScanKernel {
+    SCAN_KERNEL_SCALAR,
+    SCAN_KERNEL_SSE2,
+    SCAN_KERNEL_AVX2
+};
+
+struct ScanKernels {
+    ScanKernel kernel;
+    const char* (*skip_whitespace)(const char* begin, const char* end);
+    // identifier characters are [0-9A-Za-z], has_upper is set when any of them is upper case
+    const char* (*scan_identifier)(const char* begin, const char* end, bool& has_upper);
+    // stops at '\n' or '\r'
+    const char* (*find_line_end)(const char* begin, const char* end);
+    // stops at '"' or '\n'
+    const char* (*find_string_end)(const char* begin, const char* end);
+    void (*fold_case)(const char* source, size_t length, char* destination);
+};
+
+// kernels picked by cpu detection on first use, can be overridden (e.g. by benchmarks) with use_scan_kernel
+const ScanKernels& scan_kernels();
+ScanKernel best_scan_kernel();
+void use_scan_kernel(ScanKernel kernel);
+const char* scan_kernel_name(ScanKernel kernel);
\ No newline at end of file
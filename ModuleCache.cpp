@@ -0,0 +1,383 @@
+#include "ModuleCache.h"
+#include <fstream>
+#include <iostream>
+
+// entries written by another version are ignored, bump it whenever the layout below changes
+constexpr uint32_t CACHE_VERSION = 3;
+constexpr char CACHE_MAGIC[4] = { 'Z', 'Y', '4', 'C' };
+constexpr uint8_t NULL_EXPR = 0xFF;
+constexpr uint32_t NO_CALLEE = 0xFFFFFFFF;
+
+// layout, all integers in host byte order:
+//   magic, version
+//   source count, (path, hash)...
+//   symbol count, name...
+//   global count, (symbol, type)...
+//   extern count, (symbol, signature)...
+//   function count, (signature, statement count, expression...)...
+//   content_hash of everything above
+// a signature is name, return type, argument count, (name, type, default value)..., its symbol table.
+// an expression is its kind and resolved type followed by its fields and children in order,
+// a call refers to its callee by the position of the signature among the externs and functions,
+// a block is its statement count followed by the statements
+
+void ModuleCache::Encoder::put_string(std::string_view string)
+{
+    put<uint32_t>(string.size());
+    data.append(string);
+}
+
+void ModuleCache::Encoder::put_symbol(Symbol symbol)
+{
+    auto inserted = indices.try_emplace(symbol, (uint32_t)symbols.size());
+    if (inserted.second) symbols.push_back(symbol);
+    put<uint32_t>(inserted.first->second);
+}
+
+std::string_view ModuleCache::Decoder::get_string()
+{
+    uint32_t size = get<uint32_t>();
+    if ((size_t)(end - cursor) < size) throw cache_exception("truncated cache entry");
+    std::string_view string(cursor, size);
+    cursor += size;
+    return string;
+}
+
+uint32_t ModuleCache::Decoder::get_count()
+{
+    // every element takes at least a byte, a larger count can only come from a damaged entry
+    uint32_t count = get<uint32_t>();
+    if (count > (size_t)(end - cursor)) throw cache_exception("truncated cache entry");
+    return count;
+}
+
+Symbol ModuleCache::Decoder::get_symbol()
+{
+    uint32_t index = get<uint32_t>();
+    if (index >= symbols.size()) throw cache_exception("bad symbol index");
+    return symbols[index];
+}
+
+std::optional<SourceFile> ModuleCache::hash_file(const std::string& path)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(path, false, false);
+    if (!buffer) return std::nullopt;
+    return SourceFile{ std::filesystem::absolute(path).string(), content_hash((*buffer)->getBuffer()) };
+}
+
+std::filesystem::path ModuleCache::entry_path(const std::string& root)
+{
+    std::string key = std::filesystem::absolute(root).string();
+    return directory / (llvm::utohexstr(content_hash(key)) + ".zyc");
+}
+
+std::unique_ptr<AST> ModuleCache::load(const std::string& root)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(entry_path(root).string(), false, false);
+    if (!buffer) return nullptr;
+    llvm::StringRef content = (*buffer)->getBuffer();
+    if (content.size() < sizeof(uint64_t)) return nullptr;
+    content = content.drop_back(sizeof(uint64_t));
+    uint64_t checksum;
+    std::memcpy(&checksum, content.end(), sizeof(checksum));
+    if (content_hash(content) != checksum) {
+        std::cerr << "ignoring damaged cache entry of " << root << '\n';
+        return nullptr;
+    }
+    Decoder decoder = { content.begin(), content.end() };
+    try {
+        for (char c : CACHE_MAGIC) {
+            if (decoder.get<char>() != c) return nullptr;
+        }
+        if (decoder.get<uint32_t>() != CACHE_VERSION) return nullptr;
+        for (uint32_t count = decoder.get_count(); count > 0; count--) {
+            std::string path(decoder.get_string());
+            uint64_t hash = decoder.get<uint64_t>();
+            auto source = hash_file(path);
+            if (!source || source->hash != hash) return nullptr;
+        }
+        for (uint32_t count = decoder.get_count(); count > 0; count--) {
+            decoder.symbols.push_back(intern(decoder.get_string()));
+        }
+
+        auto ast = std::make_unique<AST>(nullptr);
+        read_table(decoder, ast->global_symbols);
+        for (uint32_t count = decoder.get_count(); count > 0; count--) {
+            Symbol name = decoder.get_symbol();
+            auto signature = read_signature(decoder, *ast);
+            decoder.signatures.push_back(signature.get());
+            ast->extern_function_table.emplace(name, std::move(signature));
+        }
+        for (uint32_t count = decoder.get_count(); count > 0; count--) {
+            auto function = std::make_unique<FunctionAST>(read_signature(decoder, *ast));
+            if (function->signature->name != MAIN_SYMBOL) function->order = ++ast->defined_functions;
+            decoder.signatures.push_back(function->signature.get());
+            function->body.resize(decoder.get_count());
+            for (auto& expr : function->body) expr = read_expr(decoder, *ast);
+            ast->function_table.emplace(function->signature->name, std::move(function));
+        }
+        for (auto& call : decoder.calls) {
+            if (call.second == NO_CALLEE) continue;
+            if (call.second >= decoder.signatures.size()) throw cache_exception("bad callee index");
+            call.first->callee = decoder.signatures[call.second];
+        }
+        return ast;
+    }
+    catch (cache_exception& e) {
+        std::cerr << "ignoring cache entry of " << root << ": " << e.what() << '\n';
+        return nullptr;
+    }
+}
+
+void ModuleCache::store(const std::string& root, const SemanticAnalyzer& analyzer, const std::vector<SourceFile>& sources)
+{
+    const AST& ast = *analyzer.ast;
+    Encoder body;
+    for (auto& function : ast.extern_function_table) {
+        body.signatures.emplace(function.second.get(), (uint32_t)body.signatures.size());
+    }
+    for (auto& function : ast.function_table) {
+        body.signatures.emplace(function.second->signature.get(), (uint32_t)body.signatures.size());
+    }
+    write_table(body, ast.global_symbols);
+    body.put<uint32_t>(ast.extern_function_table.size());
+    for (auto& function : ast.extern_function_table) {
+        body.put_symbol(function.first);
+        write_signature(body, *function.second);
+    }
+    body.put<uint32_t>(ast.function_table.size());
+    for (auto& function : ast.function_table) {
+        write_signature(body, *function.second->signature);
+        body.put<uint32_t>(function.second->body.size());
+        for (auto expr : function.second->body) write_expr(body, expr);
+    }
+
+    Encoder header;
+    header.data.append(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.put<uint32_t>(CACHE_VERSION);
+    header.put<uint32_t>(sources.size());
+    for (auto& source : sources) {
+        header.put_string(source.path);
+        header.put<uint64_t>(source.hash);
+    }
+    header.put<uint32_t>(body.symbols.size());
+    for (Symbol symbol : body.symbols) header.put_string(symbol_name(symbol));
+    header.data += body.data;
+    header.put<uint64_t>(content_hash(header.data));
+
+    // written aside and renamed so that a concurrent load never sees half an entry
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    auto path = entry_path(root);
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        file.write(header.data.data(), header.data.size());
+        if (!file) {
+            std::cerr << "failed to write cache entry " << temporary.string() << '\n';
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+}
+
+void ModuleCache::write_expr(Encoder& encoder, const ExprAST* expr)
+{
+    if (expr == nullptr) {
+        encoder.put<uint8_t>(NULL_EXPR);
+        return;
+    }
+    encoder.put<uint8_t>(expr->kind);
+    encoder.put<int32_t>(expr->type);
+    visit_expr(expr, [&](const auto& node) {
+        using Node = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<Node, CallExprAST>) {
+            encoder.put_symbol(node.name);
+            auto callee = encoder.signatures.find(node.callee);
+            encoder.put<uint32_t>(callee != encoder.signatures.end() ? callee->second : NO_CALLEE);
+            encoder.put<uint32_t>(node.arguments.size());
+            for (auto argument : node.arguments) write_expr(encoder, argument);
+        }
+        else if constexpr (std::is_same_v<Node, VariableExprAST>) {
+            encoder.put_symbol(node.name);
+        }
+        else if constexpr (std::is_same_v<Node, IntegerExprAST> || std::is_same_v<Node, FloatExprAST>) {
+            encoder.put(node.value);
+        }
+        else if constexpr (std::is_same_v<Node, StringExprAST>) {
+            encoder.put_string(node.string);
+        }
+        else if constexpr (std::is_same_v<Node, ReturnExprAST>) {
+            write_expr(encoder, node.expr);
+        }
+        else if constexpr (std::is_same_v<Node, UnaryExprAST>) {
+            encoder.put<int32_t>(node.op);
+            write_expr(encoder, node.expr);
+        }
+        else if constexpr (std::is_same_v<Node, BinaryExprAST>) {
+            encoder.put<int32_t>(node.op);
+            write_expr(encoder, node.lhs);
+            write_expr(encoder, node.rhs);
+        }
+        else if constexpr (std::is_same_v<Node, IfExprAST>) {
+            write_expr(encoder, node.condition);
+            write_block(encoder, node.then_body);
+            write_block(encoder, node.else_body);
+        }
+        else if constexpr (std::is_same_v<Node, ForExprAST>) {
+            write_expr(encoder, node.variable);
+            write_expr(encoder, node.start);
+            write_expr(encoder, node.end);
+            write_expr(encoder, node.step);
+            write_block(encoder, node.body);
+        }
+        else if constexpr (std::is_same_v<Node, WhileExprAST>) {
+            write_expr(encoder, node.condition);
+            write_block(encoder, node.body);
+        }
+        else if constexpr (std::is_same_v<Node, RepeatExprAST>) {
+            write_block(encoder, node.body);
+            write_expr(encoder, node.condition);
+        }
+        else {
+            throw cache_exception("unexpected node in a function body");
+        }
+    });
+}
+
+void ModuleCache::write_block(Encoder& encoder, std::span<ExprAST* const> body)
+{
+    encoder.put<uint32_t>(body.size());
+    for (auto statement : body) write_expr(encoder, statement);
+}
+
+void ModuleCache::write_signature(Encoder& encoder, const FunctionSignatureAST& signature)
+{
+    encoder.put_symbol(signature.name);
+    encoder.put<int32_t>(signature.return_value_type);
+    encoder.put<uint32_t>(signature.arguments.size());
+    for (auto arg : signature.arguments) {
+        encoder.put_symbol(arg->name);
+        encoder.put<int32_t>(arg->type);
+        write_expr(encoder, arg->default_value);
+    }
+    write_table(encoder, signature.symbol_table);
+}
+
+void ModuleCache::write_table(Encoder& encoder, const SymbolTable& table)
+{
+    encoder.put<uint32_t>(table.size());
+    for (auto& symbol : table) {
+        encoder.put_symbol(symbol.first);
+        encoder.put<int32_t>(symbol.second);
+    }
+}
+
+ExprAST* ModuleCache::read_expr(Decoder& decoder, AST& ast)
+{
+    uint8_t kind = decoder.get<uint8_t>();
+    if (kind == NULL_EXPR) return nullptr;
+    SymbolType type = (SymbolType)decoder.get<int32_t>();
+    ExprAST* expr = read_node(decoder, ast, kind);
+    expr->type = type;
+    return expr;
+}
+
+ExprAST* ModuleCache::read_node(Decoder& decoder, AST& ast, uint8_t kind)
+{
+    Arena& arena = ast.arena;
+    switch (kind) {
+    case EXPR_CALL:
+    {
+        Symbol name = decoder.get_symbol();
+        uint32_t callee = decoder.get<uint32_t>();
+        uint32_t count = decoder.get_count();
+        std::span<ExprAST*> arguments;
+        if (count > 0) arguments = { (ExprAST**)arena.allocate(count * sizeof(ExprAST*), alignof(ExprAST*)), count };
+        for (auto& argument : arguments) argument = read_expr(decoder, ast);
+        auto call = arena.make<CallExprAST>(name, arguments);
+        decoder.calls.push_back({ call, callee });
+        return call;
+    }
+    case EXPR_VARIABLE:
+        return arena.make<VariableExprAST>(decoder.get_symbol());
+    case EXPR_INTEGER:
+        return arena.make<IntegerExprAST>(decoder.get<int>());
+    case EXPR_FLOAT:
+        return arena.make<FloatExprAST>(decoder.get<float>());
+    case EXPR_STRING:
+        return arena.make<StringExprAST>(arena.copy(decoder.get_string()));
+    case EXPR_RETURN:
+        return arena.make<ReturnExprAST>(read_expr(decoder, ast));
+    case EXPR_UNARY:
+    {
+        int op = decoder.get<int32_t>();
+        return arena.make<UnaryExprAST>(op, read_expr(decoder, ast));
+    }
+    case EXPR_BINARY:
+    {
+        int op = decoder.get<int32_t>();
+        ExprAST* lhs = read_expr(decoder, ast);
+        return arena.make<BinaryExprAST>(op, lhs, read_expr(decoder, ast));
+    }
+    case EXPR_IF:
+    {
+        ExprAST* condition = read_expr(decoder, ast);
+        auto then_body = read_block(decoder, ast);
+        return arena.make<IfExprAST>(condition, then_body, read_block(decoder, ast));
+    }
+    case EXPR_FOR:
+    {
+        ExprAST* variable = read_expr(decoder, ast);
+        ExprAST* start = read_expr(decoder, ast);
+        ExprAST* end = read_expr(decoder, ast);
+        ExprAST* step = read_expr(decoder, ast);
+        if (variable == nullptr || variable->kind != EXPR_VARIABLE) throw cache_exception("bad loop variable");
+        if (step == nullptr || (step->kind != EXPR_INTEGER && step->kind != EXPR_FLOAT)) throw cache_exception("bad loop step");
+        return arena.make<ForExprAST>(static_cast<VariableExprAST*>(variable), start, end, step, read_block(decoder, ast));
+    }
+    case EXPR_WHILE:
+    {
+        ExprAST* condition = read_expr(decoder, ast);
+        return arena.make<WhileExprAST>(condition, read_block(decoder, ast));
+    }
+    case EXPR_REPEAT:
+    {
+        auto body = read_block(decoder, ast);
+        return arena.make<RepeatExprAST>(body, read_expr(decoder, ast));
+    }
+    default:
+        throw cache_exception("bad expression kind");
+    }
+}
+
+std::span<ExprAST*> ModuleCache::read_block(Decoder& decoder, AST& ast)
+{
+    uint32_t count = decoder.get_count();
+    std::span<ExprAST*> body;
+    if (count > 0) body = { (ExprAST**)ast.arena.allocate(count * sizeof(ExprAST*), alignof(ExprAST*)), count };
+    for (auto& statement : body) statement = read_expr(decoder, ast);
+    return body;
+}
+
+std::unique_ptr<FunctionSignatureAST> ModuleCache::read_signature(Decoder& decoder, AST& ast)
+{
+    Symbol name = decoder.get_symbol();
+    auto signature = std::make_unique<FunctionSignatureAST>(name, (SymbolType)decoder.get<int32_t>());
+    for (uint32_t count = decoder.get_count(); count > 0; count--) {
+        Symbol arg_name = decoder.get_symbol();
+        SymbolType type = (SymbolType)decoder.get<int32_t>();
+        signature->arguments.push_back(ast.arena.make<FunctionArgument>(arg_name, type, read_expr(decoder, ast)));
+    }
+    read_table(decoder, signature->symbol_table);
+    return signature;
+}
+
+void ModuleCache::read_table(Decoder& decoder, SymbolTable& table)
+{
+    for (uint32_t count = decoder.get_count(); count > 0; count--) {
+        Symbol name = decoder.get_symbol();
+        table.insert({ name, (SymbolType)decoder.get<int32_t>() });
+    }
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Project.h"
+#include "SemanticAnalyzer.h"
+#include <cstring>
+#include <optional>
+
+// parsed and analyzed programs kept on disk between runs. an entry belongs to a root file and is only used
+// while every file it was built from, includes and the stdlib manifest as well, still has the same content hash
+class ModuleCache {
+public:
+    ModuleCache(std::filesystem::path directory) : directory(std::move(directory)) {}
+
+    // null if there is no usable entry, the AST is analyzed already otherwise
+    std::unique_ptr<AST> load(const std::string& root);
+    void store(const std::string& root, const SemanticAnalyzer& analyzer, const std::vector<SourceFile>& sources);
+    static std::optional<SourceFile> hash_file(const std::string& path);
+
+private:
+    // symbols are written as indices into a table of names stored in front of the entry
+    struct Encoder {
+        std::string data;
+        std::unordered_map<Symbol, uint32_t> indices;
+        std::vector<Symbol> symbols;
+        // callees are written as indices of their signatures, externs first then functions
+        std::unordered_map<const FunctionSignatureAST*, uint32_t> signatures;
+
+        template<typename T>
+        void put(T value) { data.append((const char*)&value, sizeof(T)); }
+        void put_string(std::string_view string);
+        void put_symbol(Symbol symbol);
+    };
+
+    struct Decoder {
+        const char* cursor;
+        const char* end;
+        std::vector<Symbol> symbols;
+        std::vector<FunctionSignatureAST*> signatures;
+        // calls are linked to their callees once every signature has been read
+        std::vector<std::pair<CallExprAST*, uint32_t>> calls;
+
+        template<typename T>
+        T get() {
+            if ((size_t)(end - cursor) < sizeof(T)) throw cache_exception("truncated cache entry");
+            T value;
+            std::memcpy(&value, cursor, sizeof(T));
+            cursor += sizeof(T);
+            return value;
+        }
+        std::string_view get_string();
+        uint32_t get_count();
+        Symbol get_symbol();
+    };
+
+    std::filesystem::path entry_path(const std::string& root);
+    void write_expr(Encoder& encoder, const ExprAST* expr);
+    void write_block(Encoder& encoder, std::span<ExprAST* const> body);
+    void write_signature(Encoder& encoder, const FunctionSignatureAST& signature);
+    void write_table(Encoder& encoder, const SymbolTable& table);
+    ExprAST* read_expr(Decoder& decoder, AST& ast);
+    ExprAST* read_node(Decoder& decoder, AST& ast, uint8_t kind);
+    std::span<ExprAST*> read_block(Decoder& decoder, AST& ast);
+    std::unique_ptr<FunctionSignatureAST> read_signature(Decoder& decoder, AST& ast);
+    void read_table(Decoder& decoder, SymbolTable& table);
+
+    std::filesystem::path directory;
+};
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "ObjectCache.h"
+#include "Project.h"
+#include <llvm/Support/raw_ostream.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// an entry is the object file followed by the content_hash of it
+
+std::filesystem::path JITObjectCache::entry_path(uint64_t key)
+{
+    return directory / (llvm::utohexstr(key) + ".o");
+}
+
+bool JITObjectCache::prepare(const llvm::Module& module, unsigned optimization_level)
+{
+    std::string key_source = target + '\n' + std::to_string(optimization_level) + '\n';
+    llvm::raw_string_ostream stream(key_source);
+    module.print(stream, nullptr);
+    stream.flush();
+    Entry entry = { content_hash(key_source), nullptr };
+
+    auto buffer = llvm::MemoryBuffer::getFile(entry_path(entry.key).string(), false, false);
+    if (buffer) {
+        llvm::StringRef content = (*buffer)->getBuffer();
+        if (content.size() >= sizeof(uint64_t)) {
+            content = content.drop_back(sizeof(uint64_t));
+            uint64_t checksum;
+            std::memcpy(&checksum, content.end(), sizeof(checksum));
+            if (content_hash(content) == checksum) entry.object = llvm::MemoryBuffer::getMemBufferCopy(content, module.getModuleIdentifier());
+        }
+        if (entry.object == nullptr) std::cerr << "ignoring damaged object cache entry " << entry_path(entry.key).string() << '\n';
+    }
+    bool cached = entry.object != nullptr;
+    std::lock_guard lock(mutex);
+    entries[&module] = std::move(entry);
+    return cached;
+}
+
+std::unique_ptr<llvm::MemoryBuffer> JITObjectCache::getObject(const llvm::Module* module)
+{
+    std::lock_guard lock(mutex);
+    auto entry = entries.find(module);
+    // modules that were not prepared are not cached
+    if (entry == entries.end()) return nullptr;
+    if (entry->second.object == nullptr) {
+        miss_count++;
+        return nullptr;
+    }
+    hit_count++;
+    auto object = std::move(entry->second.object);
+    entries.erase(entry);
+    return object;
+}
+
+void JITObjectCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object)
+{
+    uint64_t key;
+    {
+        std::lock_guard lock(mutex);
+        auto entry = entries.find(module);
+        if (entry == entries.end()) return;
+        key = entry->second.key;
+        entries.erase(entry);
+    }
+    uint64_t checksum = content_hash(object.getBuffer());
+
+    // written aside and renamed so that a concurrent run never sees half an object
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    auto path = entry_path(key);
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        file.write(object.getBufferStart(), object.getBufferSize());
+        file.write((const char*)&checksum, sizeof(checksum));
+        if (!file) {
+            std::cerr << "failed to write object cache entry " << temporary.string() << '\n';
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#pragma warning(push)
+#pragma warning(disable: 4146 4996)
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#pragma warning(pop)
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+
+// machine code the JIT compiled, kept on disk between runs. an object is keyed by the IR of its module before it is
+// optimized, the target and the optimization level, so a module that did not change is neither optimized nor compiled
+class JITObjectCache : public llvm::ObjectCache {
+public:
+    // `target` tells the target machines apart: triple, CPU and features
+    JITObjectCache(std::filesystem::path directory, std::string target) : directory(std::move(directory)), target(std::move(target)) {}
+
+    // keys `module` before it is optimized, true if its object is on disk already and it can go to the compiler as it is
+    bool prepare(const llvm::Module& module, unsigned optimization_level);
+    void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override;
+
+    size_t hits() const { return hit_count; }
+    size_t misses() const { return miss_count; }
+
+private:
+    struct Entry {
+        uint64_t key;
+        std::unique_ptr<llvm::MemoryBuffer> object; // loaded by prepare, null on a miss
+    };
+
+    std::filesystem::path entry_path(uint64_t key);
+
+    std::filesystem::path directory;
+    std::string target;
+    std::mutex mutex; // modules may be compiled on several threads
+    std::unordered_map<const llvm::Module*, Entry> entries;
+    std::atomic<size_t> hit_count = 0;
+    std::atomic<size_t> miss_count = 0;
+};
\ No newline at end of file
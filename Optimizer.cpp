@@ -0,0 +1,418 @@
+#include "Optimizer.h"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+
+// longer concatenations are left to the runtime, folding them would copy ever longer strings into the arena
+constexpr size_t MAX_FOLDED_STRING = 4096;
+
+void Optimizer::optimize()
+{
+    // argument default values are left alone, they are generated at every call site of their function
+    for (auto& function : ast.function_table) optimize_function(*function.second);
+}
+
+void Optimizer::optimize_function(FunctionAST& function)
+{
+    this->function = &function;
+    constants.clear();
+    // locals start out zeroed like CodeGen sets them up, arguments are whatever the caller passed
+    auto& signature = *function.signature;
+    for (const auto& symbol : signature.symbol_table) {
+        bool is_argument = std::any_of(signature.arguments.begin(), signature.arguments.end(),
+            [&symbol](const FunctionArgument* arg) { return arg->name == symbol.first; });
+        if (is_argument) continue;
+        switch (symbol.second) {
+        case SYMBOL_TYPE_INT:
+            constants.emplace(symbol.first, make_integer(0));
+            break;
+        case SYMBOL_TYPE_FLOAT:
+            constants.emplace(symbol.first, make_float(0.0f));
+            break;
+        case SYMBOL_TYPE_STRING:
+            constants.emplace(symbol.first, make_string(""));
+            break;
+        default:
+            break;
+        }
+    }
+
+    function.body.resize(fold_block(function.body));
+    this->function = nullptr;
+}
+
+size_t Optimizer::fold_block(std::span<ExprAST*> body)
+{
+    // the constants known after a statement hold for the next one, blocks and loops inside take care of their own
+    size_t kept = 0;
+    for (auto expr : body) {
+        expr = effects(fold(expr));
+        if (expr != nullptr) body[kept++] = expr;
+    }
+    return kept;
+}
+
+ExprAST* Optimizer::fold(ExprAST* expr)
+{
+    switch (expr->kind) {
+    case EXPR_CALL: return fold(static_cast<CallExprAST&>(*expr));
+    case EXPR_VARIABLE: return fold(static_cast<VariableExprAST&>(*expr));
+    case EXPR_UNARY: return fold(static_cast<UnaryExprAST&>(*expr));
+    case EXPR_BINARY: return fold(static_cast<BinaryExprAST&>(*expr));
+    case EXPR_RETURN: return fold(static_cast<ReturnExprAST&>(*expr));
+    case EXPR_IF: return fold(static_cast<IfExprAST&>(*expr));
+    case EXPR_FOR: return fold(static_cast<ForExprAST&>(*expr));
+    case EXPR_WHILE: return fold(static_cast<WhileExprAST&>(*expr));
+    case EXPR_REPEAT: return fold(static_cast<RepeatExprAST&>(*expr));
+    default: return expr;
+    }
+}
+
+ExprAST* Optimizer::fold(CallExprAST& call)
+{
+    for (auto& argument : call.arguments) argument = fold(argument);
+    // the callee may assign globals, only the function's own variables are still known afterwards
+    if (calls_user_code(call)) std::erase_if(constants, [this](const auto& constant) { return !is_local(constant.first); });
+    return &call;
+}
+
+ExprAST* Optimizer::fold(VariableExprAST& var)
+{
+    auto constant = constants.find(var.name);
+    // a string literal allocates a string wherever it stands, so strings are only folded into concatenations
+    if (constant == constants.end() || constant->second->kind == EXPR_STRING) return &var;
+    return constant->second;
+}
+
+ExprAST* Optimizer::fold(UnaryExprAST& unary)
+{
+    unary.expr = fold(unary.expr);
+    ExprAST* operand = constant_of(unary.expr);
+    if (operand == nullptr) return &unary;
+    switch (operand->kind) {
+    case EXPR_INTEGER:
+    {
+        int value = static_cast<IntegerExprAST&>(*operand).value;
+        if (unary.op == '-') return make_integer((int)(0u - (unsigned)value));
+        if (unary.op == TOKEN_LOGIC_NOT) return make_integer(value == 0);
+        break;
+    }
+    case EXPR_FLOAT:
+    {
+        float value = static_cast<FloatExprAST&>(*operand).value;
+        if (unary.op == '-') return make_float(0.0f - value);
+        if (unary.op == TOKEN_LOGIC_NOT) return make_integer(value == 0.0f);
+        break;
+    }
+    default:
+        break;
+    }
+    return &unary;
+}
+
+ExprAST* Optimizer::fold(BinaryExprAST& binary)
+{
+    if (binary.op == '=') return fold_assignment(binary);
+    // the lhs is read before the rhs runs, an assignment in the rhs must not change what it was
+    binary.lhs = fold(binary.lhs);
+    ExprAST* lhs = constant_of(binary.lhs);
+    binary.rhs = fold(binary.rhs);
+    ExprAST* rhs = constant_of(binary.rhs);
+    if (lhs == nullptr || rhs == nullptr) return &binary;
+    if (binary.op != '+' && binary.op != '-' && binary.op != '*' && binary.op != '/') return &binary;
+
+    if (lhs->kind == EXPR_STRING || rhs->kind == EXPR_STRING) {
+        if (binary.op != '+') return &binary;
+        std::string string = to_string(lhs) + to_string(rhs);
+        if (string.size() > MAX_FOLDED_STRING) return &binary;
+        return make_string(string);
+    }
+
+    if (lhs->kind == EXPR_FLOAT || rhs->kind == EXPR_FLOAT) {
+        auto value_of = [](ExprAST* constant) {
+            return constant->kind == EXPR_FLOAT ? static_cast<FloatExprAST&>(*constant).value : (float)static_cast<IntegerExprAST&>(*constant).value;
+        };
+        float a = value_of(lhs), b = value_of(rhs);
+        switch (binary.op) {
+        case '+': return make_float(a + b);
+        case '-': return make_float(a - b);
+        case '*': return make_float(a * b);
+        default: return make_float(a / b);
+        }
+    }
+
+    // wrapping like the generated add, sub and mul
+    int a = static_cast<IntegerExprAST&>(*lhs).value, b = static_cast<IntegerExprAST&>(*rhs).value;
+    switch (binary.op) {
+    case '+': return make_integer((int)((unsigned)a + (unsigned)b));
+    case '-': return make_integer((int)((unsigned)a - (unsigned)b));
+    case '*': return make_integer((int)((unsigned)a * (unsigned)b));
+    default:
+        if (b == 0 || (a == INT_MIN && b == -1)) return &binary; // left to fail at run time
+        return make_integer(a / b);
+    }
+}
+
+ExprAST* Optimizer::fold(ReturnExprAST& ret)
+{
+    if (ret.expr != nullptr) ret.expr = fold(ret.expr);
+    return &ret;
+}
+
+ExprAST* Optimizer::fold(IfExprAST& if_expr)
+{
+    if_expr.condition = fold(if_expr.condition);
+    // afterwards only what both branches agree on is known
+    auto before = constants;
+    if_expr.then_body = if_expr.then_body.first(fold_block(if_expr.then_body));
+    auto after_then = std::move(constants);
+    constants = std::move(before);
+    if_expr.else_body = if_expr.else_body.first(fold_block(if_expr.else_body));
+    std::erase_if(constants, [&after_then](const auto& constant) {
+        auto other = after_then.find(constant.first);
+        return other == after_then.end() || !is_same_constant(other->second, constant.second);
+    });
+    return &if_expr;
+}
+
+ExprAST* Optimizer::fold(ForExprAST& for_expr)
+{
+    // the bounds are evaluated once, before the loop
+    for_expr.start = fold(for_expr.start);
+    for_expr.end = fold(for_expr.end);
+    forget_writes(&for_expr);
+    // the loop may end before the first iteration, when nothing the body tells is known
+    auto before = constants;
+    for_expr.body = for_expr.body.first(fold_block(for_expr.body));
+    constants = std::move(before);
+    return &for_expr;
+}
+
+ExprAST* Optimizer::fold(WhileExprAST& while_expr)
+{
+    forget_writes(&while_expr);
+    while_expr.condition = fold(while_expr.condition);
+    auto before = constants;
+    while_expr.body = while_expr.body.first(fold_block(while_expr.body));
+    constants = std::move(before);
+    return &while_expr;
+}
+
+ExprAST* Optimizer::fold(RepeatExprAST& repeat)
+{
+    // the loop ends right after an iteration, so what is known there holds afterwards
+    forget_writes(&repeat);
+    repeat.body = repeat.body.first(fold_block(repeat.body));
+    if (repeat.condition != nullptr) repeat.condition = fold(repeat.condition);
+    return &repeat;
+}
+
+void Optimizer::forget_writes(const ExprAST* loop)
+{
+    std::unordered_set<Symbol> assigned;
+    bool calls_user = false;
+    collect_writes(loop, assigned, calls_user);
+    std::erase_if(constants, [&](const auto& constant) {
+        return assigned.contains(constant.first) || (calls_user && !is_local(constant.first));
+    });
+}
+
+void Optimizer::collect_writes(const ExprAST* expr, std::unordered_set<Symbol>& assigned, bool& calls_user)
+{
+    auto collect_block = [&](std::span<ExprAST* const> body) {
+        for (auto statement : body) collect_writes(statement, assigned, calls_user);
+    };
+    switch (expr->kind) {
+    case EXPR_CALL:
+    {
+        auto& call = static_cast<const CallExprAST&>(*expr);
+        calls_user |= calls_user_code(call);
+        collect_block(call.arguments);
+        break;
+    }
+    case EXPR_RETURN:
+    {
+        auto& ret = static_cast<const ReturnExprAST&>(*expr);
+        if (ret.expr != nullptr) collect_writes(ret.expr, assigned, calls_user);
+        break;
+    }
+    case EXPR_UNARY:
+        collect_writes(static_cast<const UnaryExprAST&>(*expr).expr, assigned, calls_user);
+        break;
+    case EXPR_BINARY:
+    {
+        auto& binary = static_cast<const BinaryExprAST&>(*expr);
+        if (binary.op == '=' && binary.lhs->kind == EXPR_VARIABLE) assigned.insert(static_cast<const VariableExprAST&>(*binary.lhs).name);
+        collect_writes(binary.lhs, assigned, calls_user);
+        collect_writes(binary.rhs, assigned, calls_user);
+        break;
+    }
+    case EXPR_IF:
+    {
+        auto& if_expr = static_cast<const IfExprAST&>(*expr);
+        collect_writes(if_expr.condition, assigned, calls_user);
+        collect_block(if_expr.then_body);
+        collect_block(if_expr.else_body);
+        break;
+    }
+    case EXPR_FOR:
+    {
+        auto& for_expr = static_cast<const ForExprAST&>(*expr);
+        assigned.insert(for_expr.variable->name);
+        collect_writes(for_expr.start, assigned, calls_user);
+        collect_writes(for_expr.end, assigned, calls_user);
+        collect_block(for_expr.body);
+        break;
+    }
+    case EXPR_WHILE:
+    {
+        auto& while_expr = static_cast<const WhileExprAST&>(*expr);
+        collect_writes(while_expr.condition, assigned, calls_user);
+        collect_block(while_expr.body);
+        break;
+    }
+    case EXPR_REPEAT:
+    {
+        auto& repeat = static_cast<const RepeatExprAST&>(*expr);
+        collect_block(repeat.body);
+        if (repeat.condition != nullptr) collect_writes(repeat.condition, assigned, calls_user);
+        break;
+    }
+    default: // literals and variables write nothing
+        break;
+    }
+}
+
+bool Optimizer::is_same_constant(const ExprAST* a, const ExprAST* b)
+{
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+    case EXPR_INTEGER: return static_cast<const IntegerExprAST&>(*a).value == static_cast<const IntegerExprAST&>(*b).value;
+    case EXPR_FLOAT: return static_cast<const FloatExprAST&>(*a).value == static_cast<const FloatExprAST&>(*b).value;
+    default: return static_cast<const StringExprAST&>(*a).string == static_cast<const StringExprAST&>(*b).string;
+    }
+}
+
+ExprAST* Optimizer::fold_assignment(BinaryExprAST& binary)
+{
+    // the target is written, not read, so it is not replaced
+    binary.rhs = fold(binary.rhs);
+    if (binary.lhs->kind != EXPR_VARIABLE) return &binary;
+    Symbol name = static_cast<VariableExprAST&>(*binary.lhs).name;
+    ExprAST* constant = constant_of(binary.rhs);
+    ExprAST* value = constant != nullptr ? convert_constant(constant, binary.lhs->type) : nullptr;
+    if (value != nullptr) constants.insert_or_assign(name, value);
+    else constants.erase(name);
+    return &binary;
+}
+
+ExprAST* Optimizer::constant_of(ExprAST* expr)
+{
+    switch (expr->kind) {
+    case EXPR_INTEGER:
+    case EXPR_FLOAT:
+    case EXPR_STRING:
+        return expr;
+    case EXPR_VARIABLE:
+    {
+        auto constant = constants.find(static_cast<VariableExprAST&>(*expr).name);
+        return constant != constants.end() ? constant->second : nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+ExprAST* Optimizer::convert_constant(ExprAST* constant, SymbolType type)
+{
+    switch (type) {
+    case SYMBOL_TYPE_INT:
+        if (constant->kind == EXPR_INTEGER) return constant;
+        if (constant->kind == EXPR_FLOAT) {
+            float value = static_cast<FloatExprAST&>(*constant).value;
+            // out of range the generated fptosi gives poison, there is no value to propagate
+            if (!(value >= -2147483648.0f && value < 2147483648.0f)) return nullptr;
+            return make_integer((int)value);
+        }
+        return nullptr;
+    case SYMBOL_TYPE_FLOAT:
+        if (constant->kind == EXPR_FLOAT) return constant;
+        if (constant->kind == EXPR_INTEGER) return make_float((float)static_cast<IntegerExprAST&>(*constant).value);
+        return nullptr;
+    case SYMBOL_TYPE_STRING:
+        return constant->kind == EXPR_STRING ? constant : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+std::string Optimizer::to_string(ExprAST* constant)
+{
+    // the same text int_to_string__ and float_to_string__ produce at run time
+    char number[32];
+    switch (constant->kind) {
+    case EXPR_INTEGER: return std::string(number, std::to_chars(number, std::end(number), static_cast<IntegerExprAST&>(*constant).value).ptr);
+    case EXPR_FLOAT: return std::string(number, std::to_chars(number, std::end(number), static_cast<FloatExprAST&>(*constant).value).ptr);
+    default: return std::string(static_cast<StringExprAST&>(*constant).string);
+    }
+}
+
+ExprAST* Optimizer::make_integer(int value)
+{
+    ExprAST* expr = ast.arena.make<IntegerExprAST>(value);
+    expr->type = SYMBOL_TYPE_INT;
+    return expr;
+}
+
+ExprAST* Optimizer::make_float(float value)
+{
+    ExprAST* expr = ast.arena.make<FloatExprAST>(value);
+    expr->type = SYMBOL_TYPE_FLOAT;
+    return expr;
+}
+
+ExprAST* Optimizer::make_string(std::string_view string)
+{
+    ExprAST* expr = ast.arena.make<StringExprAST>(ast.arena.copy(string));
+    expr->type = SYMBOL_TYPE_STRING;
+    return expr;
+}
+
+bool Optimizer::is_local(Symbol name)
+{
+    return function->signature->symbol_table.contains(name);
+}
+
+bool Optimizer::calls_user_code(const CallExprAST& call)
+{
+    if (call.callee == nullptr) return true;
+    auto range = ast.function_table.equal_range(call.callee->name);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->signature.get() == call.callee) return true;
+    }
+    return false;
+}
+
+ExprAST* Optimizer::effects(ExprAST* expr)
+{
+    switch (expr->kind) {
+    case EXPR_INTEGER:
+    case EXPR_FLOAT:
+    case EXPR_STRING:
+    case EXPR_VARIABLE:
+        return nullptr;
+    case EXPR_UNARY:
+        return effects(static_cast<UnaryExprAST&>(*expr).expr);
+    case EXPR_BINARY:
+    {
+        auto& binary = static_cast<BinaryExprAST&>(*expr);
+        if (binary.op == '=') return expr;
+        ExprAST* lhs = effects(binary.lhs);
+        ExprAST* rhs = effects(binary.rhs);
+        if (lhs != nullptr && rhs != nullptr) return expr;
+        return lhs != nullptr ? lhs : rhs;
+    }
+    default: // calls, returns and blocks
+        return expr;
+    }
+}
\ No newline at end of file
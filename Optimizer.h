@@ -0,0 +1,49 @@
+#pragma once
+
+#include "SemanticAnalyzer.h"
+#include <unordered_set>
+
+// rewrites the analyzed program before CodeGen: folds constant subtrees, replaces reads of variables holding a known
+// constant and drops statements without effect. it relies on the types and callees the analyzer annotated.
+// the rewritten nodes are not meant to be analyzed again, so it is not used on documents
+class Optimizer {
+public:
+    Optimizer(SemanticAnalyzer& semantic) : ast(*semantic.ast) {}
+    void optimize();
+
+private:
+    void optimize_function(FunctionAST& function);
+    // folds the statements of a block and moves the ones that are kept to its front, returns how many there are
+    size_t fold_block(std::span<ExprAST*> body);
+    ExprAST* fold(ExprAST* expr);
+    ExprAST* fold(CallExprAST& call);
+    ExprAST* fold(VariableExprAST& var);
+    ExprAST* fold(UnaryExprAST& unary);
+    ExprAST* fold(BinaryExprAST& binary);
+    ExprAST* fold(ReturnExprAST& ret);
+    ExprAST* fold(IfExprAST& if_expr);
+    ExprAST* fold(ForExprAST& for_expr);
+    ExprAST* fold(WhileExprAST& while_expr);
+    ExprAST* fold(RepeatExprAST& repeat);
+    // a loop may run any number of times, so what it writes is not known where an iteration starts
+    void forget_writes(const ExprAST* loop);
+    void collect_writes(const ExprAST* expr, std::unordered_set<Symbol>& assigned, bool& calls_user);
+    static bool is_same_constant(const ExprAST* a, const ExprAST* b);
+    ExprAST* fold_assignment(BinaryExprAST& binary);
+    // the literal `expr` evaluates to, null if it is not known at compile time
+    ExprAST* constant_of(ExprAST* expr);
+    // the literal a constant becomes when stored into a variable of `type`, null if that cannot be told
+    ExprAST* convert_constant(ExprAST* constant, SymbolType type);
+    static std::string to_string(ExprAST* constant);
+    ExprAST* make_integer(int value);
+    ExprAST* make_float(float value);
+    ExprAST* make_string(std::string_view string);
+    bool is_local(Symbol name);
+    bool calls_user_code(const CallExprAST& call);
+    // the part of a statement that has to run, null if nothing does
+    static ExprAST* effects(ExprAST* expr);
+
+    AST& ast;
+    const FunctionAST* function = nullptr; // being optimized
+    std::unordered_map<Symbol, ExprAST*> constants; // variables whose value is known at this point of the function
+};
\ No newline at end of file
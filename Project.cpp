@@ -0,0 +1,153 @@
+#include "Project.h"
+#include <algorithm>
+
+std::unique_ptr<AST> Project::parse(unsigned threads)
+{
+    File* root_file;
+    {
+        ThreadPool workers(threads);
+        pool = &workers;
+        root_file = &add_file(root);
+        workers.wait();
+        pool = nullptr;
+    }
+    for (auto& file : files) {
+        if (!file.second->error.empty()) {
+            std::string message = file.second->path.string() + ": " + file.second->error;
+            throw ast_exception(message.c_str());
+        }
+    }
+
+    auto program = std::make_unique<AST>(nullptr);
+    auto main = program->create_main();
+    merge(*program, *main, *root_file);
+    program->function_table.emplace(MAIN_SYMBOL, std::move(main));
+    resolve_globals(*program);
+    parsed_sources.clear();
+    for (auto& file : files) {
+        parsed_sources.push_back({ std::filesystem::absolute(file.second->path).string(), file.second->hash });
+    }
+    files.clear();
+    return program;
+}
+
+Project::File& Project::add_file(const std::filesystem::path& path)
+{
+    std::lock_guard lock(mutex);
+    auto key = std::filesystem::weakly_canonical(path);
+    auto& file = files[key];
+    if (file == nullptr) {
+        file = std::make_unique<File>();
+        file->path = path;
+        pool->submit([this, &file = *file] { parse_file(file); });
+    }
+    return *file;
+}
+
+// runs on a worker, every file gets its own lexer, tables and arena
+void Project::parse_file(File& file)
+{
+    try {
+        auto buffer = llvm::MemoryBuffer::getFile(file.path.string(), false, false);
+        if (!buffer) throw std::exception("Failed to open source file");
+        file.hash = content_hash((*buffer)->getBuffer());
+        file.ast = std::make_unique<AST>(std::make_unique<Lex>(std::move(*buffer)));
+        file.ast->parse();
+        file.ast->lex = nullptr;
+    }
+    catch (std::exception& e) {
+        file.error = e.what();
+        return;
+    }
+    for (auto& include : file.ast->includes) {
+        add_file(file.path.parent_path() / include.path);
+    }
+}
+
+// the included statements are spliced in where their Include stands. the functions of a file see the globals of the
+// others only once resolve_globals has run
+void Project::merge(AST& program, FunctionAST& main, File& file)
+{
+    file.merged = true;
+    AST& ast = *file.ast;
+    auto file_main = ast.function_table.find(MAIN_SYMBOL);
+    auto& body = file_main->second->body;
+    size_t next = 0;
+    for (auto& include : ast.includes) {
+        main.body.insert(main.body.end(), body.begin() + next, body.begin() + include.position);
+        next = include.position;
+        File& included = *files.at(std::filesystem::weakly_canonical(file.path.parent_path() / include.path));
+        if (!included.merged) merge(program, main, included);
+    }
+    main.body.insert(main.body.end(), body.begin() + next, body.end());
+    ast.function_table.erase(file_main);
+
+    auto fail = [&](std::string message, Symbol name) {
+        message = file.path.string() + ": " + message + ' ' + std::string(symbol_name(name));
+        throw ast_exception(message.c_str());
+    };
+    for (auto& symbol : ast.global_symbols) {
+        if (symbol.first == MAIN_SYMBOL) continue;
+        if (!is_variable_type(symbol.second)) {
+            program.global_symbols.insert(symbol);
+            continue;
+        }
+        file.globals.push_back(symbol.first);
+        auto range = program.global_symbols.equal_range(symbol.first);
+        auto defined = std::find_if(range.first, range.second, [](auto& it) { return is_variable_type(it.second); });
+        if (defined == range.second) program.global_symbols.insert(symbol);
+        else if (defined->second != symbol.second) fail("conflicting types for global variable", symbol.first);
+    }
+    // numbered again in merge order, so the functions of an included file come before those of the file including it
+    std::vector<FunctionAST*> defined;
+    for (auto& function : ast.function_table) defined.push_back(function.second.get());
+    std::sort(defined.begin(), defined.end(), [](FunctionAST* a, FunctionAST* b) { return a->order < b->order; });
+    for (auto function : defined) function->order = ++program.defined_functions;
+    file.functions = std::move(defined);
+    for (auto& function : ast.function_table) {
+        try {
+            program.check_duplicate_signature(*function.second->signature);
+        }
+        catch (ast_exception&) {
+            fail("duplicate function signature of", function.first);
+        }
+        program.function_table.emplace(function.first, std::move(function.second));
+    }
+    for (auto& function : ast.extern_function_table) {
+        program.extern_function_table.emplace(function.first, std::move(function.second));
+    }
+    program.arena.merge(std::move(ast.arena));
+    file.ast = nullptr;
+}
+
+// a file is parsed without the globals of the other files, so a function assigning one of them took it for a local of
+// its own. it is that global, as if the file declaring it had been included ahead of the function
+void Project::resolve_globals(AST& program)
+{
+    std::unordered_map<Symbol, size_t> declaring_files;
+    for (auto& file : files) {
+        for (auto name : file.second->globals) declaring_files[name]++;
+    }
+    for (auto& file : files) {
+        for (auto function : file.second->functions) {
+            auto& signature = *function->signature;
+            for (auto local = signature.symbol_table.begin(); local != signature.symbol_table.end();) {
+                Symbol name = local->first;
+                auto declared = declaring_files.find(name);
+                bool own = std::find(file.second->globals.begin(), file.second->globals.end(), name) != file.second->globals.end();
+                bool argument = std::any_of(signature.arguments.begin(), signature.arguments.end(), [name](FunctionArgument* argument) { return argument->name == name; });
+                if (!is_variable_type(local->second) || argument || declared == declaring_files.end() || declared->second == size_t(own)) {
+                    ++local;
+                    continue;
+                }
+                auto range = program.global_symbols.equal_range(name);
+                auto global = std::find_if(range.first, range.second, [](auto& it) { return is_variable_type(it.second); });
+                if (global->second != local->second) {
+                    std::string message = file.second->path.string() + ": mismatched type of global variable " + std::string(symbol_name(name));
+                    throw ast_exception(message.c_str());
+                }
+                local = signature.symbol_table.erase(local);
+            }
+        }
+    }
+}
\ No newline at end of file
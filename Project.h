@@ -0,0 +1,52 @@
+#pragma once
+
+#include "AST.h"
+#include "ThreadPool.h"
+#include <filesystem>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/xxhash.h>
+#include <map>
+
+inline uint64_t content_hash(llvm::StringRef content) {
+    return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(content));
+}
+
+struct SourceFile {
+    std::string path; // absolute
+    uint64_t hash; // content_hash of what was parsed
+};
+
+// a program spread over several files: the root file and everything it includes.
+// each file is lexed and parsed on a worker thread into its own AST, the ASTs are merged into one afterwards
+class Project {
+public:
+    Project(std::string root) : root(std::move(root)) {}
+
+    std::unique_ptr<AST> parse(unsigned threads = std::thread::hardware_concurrency());
+    // every file the last parse read
+    const std::vector<SourceFile>& sources() const { return parsed_sources; }
+
+private:
+    struct File {
+        std::filesystem::path path;
+        std::unique_ptr<AST> ast;
+        std::string error;
+        uint64_t hash = 0;
+        bool merged = false;
+        // what the file defines, kept after merging
+        std::vector<FunctionAST*> functions;
+        std::vector<Symbol> globals; // variables only
+    };
+
+    File& add_file(const std::filesystem::path& path);
+    void parse_file(File& file);
+    void merge(AST& program, FunctionAST& main, File& file);
+    void resolve_globals(AST& program);
+
+    std::string root;
+    ThreadPool* pool = nullptr;
+    std::mutex mutex;
+    // keyed by canonical path, a file included several times is parsed and merged once
+    std::map<std::filesystem::path, std::unique_ptr<File>> files;
+    std::vector<SourceFile> parsed_sources;
+};
\ No newline at end of file
@@ -1,33 +1,109 @@
 #include "SemanticAnalyzer.h"
+#include "ThreadPool.h"
 #include <iostream>
 #include <algorithm>
+#include <fstream>
+#include <tuple>
 
-void SemanticAnalyzer::analyze()
+bool SemanticAnalyzer::analyze(unsigned threads)
 {
+    // long functions, which the top-level code usually is, are split so that one of them does not keep a single worker busy
+    constexpr size_t STATEMENTS_PER_TASK = 1024;
+    struct Task {
+        const FunctionAST* function;
+        size_t first;
+        size_t last;
+        bool success = true;
+        std::string diagnostics;
+    };
+
+    index_overloads();
+    std::vector<Task> tasks;
     for (auto& function : ast->function_table) {
-        for (auto& arg : function.second->signature->arguments) {
-            try {
-                if (arg->default_value != nullptr && !can_convert_to(get_type(arg->default_value), arg->type)) {
-                    std::cerr << "mismatch argument default value at " << function.second->signature->name << ": " << arg->name << " is " << arg->type << '\n';
-                }
-            }
-            catch (semantic_exception e) {
-                std::cerr << "invalid syntax at " << readable_function_signature(function.second) << " signature: " << e.what() << '\n';
-            }
+        size_t size = function.second->body.size();
+        for (size_t first = 0; first == 0 || first < size; first += STATEMENTS_PER_TASK) {
+            tasks.push_back({ function.second.get(), first, std::min(first + STATEMENTS_PER_TASK, size) });
         }
-        scope = &function.second->signature;
-        for (auto& expr : function.second->body) {
-            try {
-                get_type(expr);
-            }
-            catch (semantic_exception e) {
-                std::cerr << "invalid syntax at " << readable_function_signature(function.second) << " definition: " << e.what() << '\n';
+    }
+    std::sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) {
+        return std::tie(a.function->order, a.first) < std::tie(b.function->order, b.first);
+    });
+    auto run = [this](Task& task) {
+        AnalysisContext context = { *task.function };
+        if (task.first == 0) task.success &= check_signature(context);
+        for (size_t i = task.first; i < task.last; i++) {
+            task.success &= check_statement(context, task.function->body[i]);
+        }
+        task.diagnostics = context.diagnostics.str();
+    };
+    if (threads <= 1 || tasks.size() == 1) {
+        for (auto& task : tasks) run(task);
+    }
+    else {
+        ThreadPool pool(std::min<size_t>(threads, tasks.size()));
+        for (auto& task : tasks) pool.submit([&run, &task] { run(task); });
+        pool.wait();
+    }
+
+    bool success = true;
+    for (auto& task : tasks) {
+        std::cerr << task.diagnostics;
+        success &= task.success;
+    }
+    return success;
+}
+
+bool SemanticAnalyzer::analyze_function(FunctionAST& function)
+{
+    AnalysisContext context = { function };
+    bool success = check_signature(context);
+    for (auto expr : function.body) {
+        success &= check_statement(context, expr);
+    }
+    std::cerr << context.diagnostics.str();
+    return success;
+}
+
+bool SemanticAnalyzer::analyze_statement(FunctionAST& function, ExprAST* expr)
+{
+    AnalysisContext context = { function };
+    bool success = check_statement(context, expr);
+    std::cerr << context.diagnostics.str();
+    return success;
+}
+
+bool SemanticAnalyzer::check_signature(AnalysisContext& context)
+{
+    bool success = true;
+    auto& signature = context.function.signature;
+    for (auto& arg : signature->arguments) {
+        try {
+            if (arg->default_value != nullptr && !can_convert_to(get_type(arg->default_value, context), arg->type, context)) {
+                context.diagnostics << "mismatch argument default value at " << symbol_name(signature->name) << ": " << symbol_name(arg->name) << " is " << arg->type << '\n';
+                success = false;
             }
         }
+        catch (semantic_exception e) {
+            context.diagnostics << "invalid syntax at " << readable_function_signature(signature) << " signature: " << e.what() << '\n';
+            success = false;
+        }
+    }
+    return success;
+}
+
+bool SemanticAnalyzer::check_statement(AnalysisContext& context, const ExprAST* expr)
+{
+    try {
+        get_type(expr, context);
+        return true;
+    }
+    catch (semantic_exception e) {
+        context.diagnostics << "invalid syntax at " << readable_function_signature(context.function.signature) << " definition: " << e.what() << '\n';
+        return false;
     }
 }
 
-bool SemanticAnalyzer::can_convert_to(SymbolType old_type, SymbolType new_type) {
+bool SemanticAnalyzer::can_convert_to(SymbolType old_type, SymbolType new_type, AnalysisContext& context) {
     if (old_type == new_type) return true;
     switch (old_type) {
     case SYMBOL_TYPE_VOID:
@@ -38,7 +114,7 @@ bool SemanticAnalyzer::can_convert_to(SymbolType old_type, SymbolType new_type)
         return new_type == SYMBOL_TYPE_FLOAT || new_type == SYMBOL_TYPE_STRING;
     case SYMBOL_TYPE_FLOAT:
         if (new_type == SYMBOL_TYPE_INT) {
-            std::cerr << "unsafe conversion: float to int may cause precision loss\n";
+            context.diagnostics << "unsafe conversion: float to int may cause precision loss\n";
         }
         return new_type == SYMBOL_TYPE_STRING;
     default:
@@ -46,145 +122,288 @@ bool SemanticAnalyzer::can_convert_to(SymbolType old_type, SymbolType new_type)
     }
 }
 
-const std::unique_ptr<FunctionSignatureAST>& SemanticAnalyzer::seek_best_match_function(const CallExprAST& expr) {
-    auto candidates = ast->function_table.equal_range(expr.name);
-    std::unique_ptr<FunctionSignatureAST>* current_candidate = nullptr;
-    int current_mandatory = -1;
-    for (auto& it = candidates.first; it != candidates.second; ++it) {
-        int mandatory_args = std::count_if(it->second->signature->arguments.begin(),
-            it->second->signature->arguments.end(),
-            [](const std::unique_ptr<FunctionArgument>& arg) {
-                return arg->default_value == nullptr;
-            });
-        int optional_args = it->second->signature->arguments.size() - mandatory_args;
-        if (expr.arguments.size() >= mandatory_args && mandatory_args > current_mandatory) {
-            current_candidate = &it->second->signature;
-            current_mandatory = mandatory_args;
-        }
-        if (expr.arguments.size() == mandatory_args + optional_args) return it->second->signature; // best match
+void SemanticAnalyzer::index_overloads()
+{
+    overloads.clear();
+    // overloads of a name are adjacent in the table, so they are appended in equal_range order
+    for (auto& function : ast->function_table) {
+        overloads[function.first].functions.push_back(make_overload(*function.second->signature));
     }
-    if (current_candidate == nullptr && ast->extern_function_table.contains(expr.name)) {
-        auto& candidate = ast->extern_function_table.at(expr.name);
-        if (candidate->arguments.size() == expr.arguments.size()) return candidate;
+    for (auto& function : ast->extern_function_table) {
+        overloads[function.first].extern_function = function.second.get();
     }
-    return *current_candidate;
 }
 
-SymbolType SemanticAnalyzer::get_type(const std::unique_ptr<ExprAST>& expr)
+void SemanticAnalyzer::index_overloads(Symbol name)
 {
-    if (typeid(*expr) == typeid(FloatExprAST)) {
-        return SYMBOL_TYPE_FLOAT;
-    }
-    if (typeid(*expr) == typeid(IntegerExprAST)) {
-        return SYMBOL_TYPE_INT;
-    }
-    if (typeid(*expr) == typeid(StringExprAST)) {
-        return SYMBOL_TYPE_STRING;
+    OverloadSet set;
+    auto range = ast->function_table.equal_range(name);
+    for (auto it = range.first; it != range.second; ++it) {
+        set.functions.push_back(make_overload(*it->second->signature));
     }
-    if (typeid(*expr) == typeid(CallExprAST)) {
-        auto& call = dynamic_cast<CallExprAST&>(*expr);
-        auto& candidate = seek_best_match_function(call);
-        if (candidate != nullptr) return candidate->return_value_type;
-        throw semantic_exception("no function that matches the requirement");
-    }
-    if (typeid(*expr) == typeid(UnaryExprAST)) {
-        auto& call = dynamic_cast<UnaryExprAST&>(*expr);
-        switch (call.op) {
-        case '-':
-        case TOKEN_LOGIC_NOT:
-        {
-            SymbolType type = get_type(call.expr);
-            if (type == SYMBOL_TYPE_STRING) {
-                throw semantic_exception("unary operator cannot apply to the expression");
-            }
-            return call.op == TOKEN_LOGIC_NOT ? SYMBOL_TYPE_INT : type;
+    auto extern_function = ast->extern_function_table.find(name);
+    if (extern_function != ast->extern_function_table.end()) set.extern_function = extern_function->second.get();
+    if (set.functions.empty() && set.extern_function == nullptr) overloads.erase(name);
+    else overloads.insert_or_assign(name, std::move(set));
+}
+
+SemanticAnalyzer::Overload SemanticAnalyzer::make_overload(const FunctionSignatureAST& signature)
+{
+    size_t mandatory = std::count_if(signature.arguments.begin(),
+        signature.arguments.end(),
+        [](const FunctionArgument* arg) {
+            return arg->default_value == nullptr;
+        });
+    return { &signature, mandatory, signature.arguments.size() };
+}
+
+const FunctionSignatureAST* SemanticAnalyzer::seek_best_match_function(const CallExprAST& expr) {
+    auto found = overloads.find(expr.name);
+    if (found == overloads.end()) return nullptr;
+    size_t count = expr.arguments.size();
+    const Overload* current_candidate = nullptr;
+    for (auto& overload : found->second.functions) {
+        if (count == overload.total) return overload.signature; // best match
+        if (count >= overload.mandatory && (current_candidate == nullptr || overload.mandatory > current_candidate->mandatory)) {
+            current_candidate = &overload;
         }
-        default:
-            throw semantic_exception("invalid unary operator");
+    }
+    if (current_candidate != nullptr) return current_candidate->signature;
+    auto extern_function = found->second.extern_function;
+    if (extern_function != nullptr && extern_function->arguments.size() == count) return extern_function;
+    return nullptr;
+}
+
+SymbolType SemanticAnalyzer::get_type(const ExprAST* expr, AnalysisContext& context)
+{
+    // recomputed on every pass, Document re-analyzes statements whose callees may have changed
+    expr->type = visit_expr(expr, [this, &context](const auto& node) { return type_of(node, context); });
+    return expr->type;
+}
+
+SymbolType SemanticAnalyzer::type_of(const FloatExprAST& expr, AnalysisContext& context)
+{
+    return SYMBOL_TYPE_FLOAT;
+}
+
+SymbolType SemanticAnalyzer::type_of(const IntegerExprAST& expr, AnalysisContext& context)
+{
+    return SYMBOL_TYPE_INT;
+}
+
+SymbolType SemanticAnalyzer::type_of(const StringExprAST& expr, AnalysisContext& context)
+{
+    return SYMBOL_TYPE_STRING;
+}
+
+SymbolType SemanticAnalyzer::type_of(const CallExprAST& call, AnalysisContext& context)
+{
+    for (auto argument : call.arguments) get_type(argument, context);
+    call.callee = seek_best_match_function(call);
+    if (call.callee != nullptr) return call.callee->return_value_type;
+    throw semantic_exception("no function that matches the requirement");
+}
+
+SymbolType SemanticAnalyzer::type_of(const UnaryExprAST& call, AnalysisContext& context)
+{
+    switch (call.op) {
+    case '-':
+    case TOKEN_LOGIC_NOT:
+    {
+        SymbolType type = get_type(call.expr, context);
+        if (type == SYMBOL_TYPE_STRING) {
+            throw semantic_exception("unary operator cannot apply to the expression");
         }
+        return call.op == TOKEN_LOGIC_NOT ? SYMBOL_TYPE_INT : type;
     }
-    if (typeid(*expr) == typeid(BinaryExprAST)) {
-        auto& biexpr = dynamic_cast<BinaryExprAST&>(*expr);
-        SymbolType lhs_type = get_type(biexpr.lhs);
-        SymbolType rhs_type = get_type(biexpr.rhs);
-        if (biexpr.op == '=') {
-            if (rhs_type != SYMBOL_TYPE_VOID) {
-                switch (lhs_type)
-                {
-                case SYMBOL_TYPE_INT:
-                    if (rhs_type == SYMBOL_TYPE_POINTER) {
-                        std::cerr << "deprecated: assigning pointer to a integer variable, please use * for pointer type instead.";
-                        return SYMBOL_TYPE_POINTER;
-                    }
-                    if (rhs_type == SYMBOL_TYPE_FLOAT) {
-                        std::cerr << "unsafe conversion: float to int may cause precision loss\n";
-                    }
-                case SYMBOL_TYPE_FLOAT:
-                    if (rhs_type != SYMBOL_TYPE_STRING) return lhs_type;
-                    break;
-                case SYMBOL_TYPE_STRING:
-                    if (rhs_type == SYMBOL_TYPE_POINTER) {
-                        std::cerr << "undefined behavior: assigning a pointer to a string variable, please use * for pointer type instead.";
-                    }
+    default:
+        throw semantic_exception("invalid unary operator");
+    }
+}
+
+SymbolType SemanticAnalyzer::type_of(const BinaryExprAST& biexpr, AnalysisContext& context)
+{
+    SymbolType lhs_type = get_type(biexpr.lhs, context);
+    SymbolType rhs_type = get_type(biexpr.rhs, context);
+    if (biexpr.op == '=') {
+        if (rhs_type != SYMBOL_TYPE_VOID) {
+            switch (lhs_type)
+            {
+            case SYMBOL_TYPE_INT:
+                if (rhs_type == SYMBOL_TYPE_POINTER) {
+                    context.diagnostics << "deprecated: assigning pointer to a integer variable, please use * for pointer type instead.";
+                    return SYMBOL_TYPE_POINTER;
+                }
+                if (rhs_type == SYMBOL_TYPE_FLOAT) {
+                    context.diagnostics << "unsafe conversion: float to int may cause precision loss\n";
+                }
+            case SYMBOL_TYPE_FLOAT:
+                if (rhs_type != SYMBOL_TYPE_STRING) return lhs_type;
+                break;
+            case SYMBOL_TYPE_STRING:
+                if (rhs_type == SYMBOL_TYPE_POINTER) {
+                    context.diagnostics << "undefined behavior: assigning a pointer to a string variable, please use * for pointer type instead.";
+                }
+                return lhs_type;
+            case SYMBOL_TYPE_POINTER:
+                if (rhs_type == SYMBOL_TYPE_POINTER || rhs_type == SYMBOL_TYPE_STRING) {
+                    if (rhs_type == SYMBOL_TYPE_STRING) context.diagnostics << "undefined behavior: assigning a string to a pointer variable. lifecycle of string is managed by ZiYue4D, the pointer may be a wild pointer.";
                     return lhs_type;
-                case SYMBOL_TYPE_POINTER:
-                    if (rhs_type == SYMBOL_TYPE_POINTER || rhs_type == SYMBOL_TYPE_STRING) {
-                        if (rhs_type == SYMBOL_TYPE_STRING) std::cerr << "undefined behavior: assigning a string to a pointer variable. lifecycle of string is managed by ZiYue4D, the pointer may be a wild pointer.";
-                        return lhs_type;
-                    }
                 }
             }
-            throw semantic_exception("bad conversion");
         }
-        if (lhs_type == SYMBOL_TYPE_STRING || rhs_type == SYMBOL_TYPE_STRING) return SYMBOL_TYPE_STRING;
-        if (lhs_type == SYMBOL_TYPE_FLOAT || rhs_type == SYMBOL_TYPE_FLOAT) return SYMBOL_TYPE_FLOAT;
+        throw semantic_exception("bad conversion");
+    }
+    switch (biexpr.op) {
+    case TOKEN_EQUAL:
+    case TOKEN_NOT_EQUAL:
+    case '<':
+    case '>':
+    case TOKEN_LESS_EQUAL:
+    case TOKEN_GREATER_EQUAL:
+        // strings compare with strings, numbers with numbers
+        if ((lhs_type == SYMBOL_TYPE_STRING) != (rhs_type == SYMBOL_TYPE_STRING)) throw semantic_exception("cannot compare a string with a number");
+        return SYMBOL_TYPE_INT;
+    case TOKEN_AND:
+    case TOKEN_OR:
+        if (lhs_type == SYMBOL_TYPE_STRING || rhs_type == SYMBOL_TYPE_STRING) throw semantic_exception("logical operator cannot apply to a string");
         return SYMBOL_TYPE_INT;
     }
-    if (typeid(*expr) == typeid(VariableExprAST)) {
-        auto& var = dynamic_cast<VariableExprAST&>(*expr);
-        if ((*scope)->symbol_table.contains(var.name)) {
-            auto range = (*scope)->symbol_table.equal_range(var.name);
-            for (auto it = range.first; it != range.second; ++it) {
-                if (is_variable_type(it->second)) return it->second;
-            }
-        }
-        if (!ast->global_symbols.contains(var.name)) {
-            throw semantic_exception("unknown variable");
-        }
-        auto range = ast->global_symbols.equal_range(var.name);
+    if (lhs_type == SYMBOL_TYPE_STRING || rhs_type == SYMBOL_TYPE_STRING) return SYMBOL_TYPE_STRING;
+    if (lhs_type == SYMBOL_TYPE_FLOAT || rhs_type == SYMBOL_TYPE_FLOAT) return SYMBOL_TYPE_FLOAT;
+    return SYMBOL_TYPE_INT;
+}
+
+SymbolType SemanticAnalyzer::type_of(const VariableExprAST& var, AnalysisContext& context)
+{
+    auto& symbol_table = context.function.signature->symbol_table;
+    if (symbol_table.contains(var.name)) {
+        auto range = symbol_table.equal_range(var.name);
         for (auto it = range.first; it != range.second; ++it) {
             if (is_variable_type(it->second)) return it->second;
         }
     }
-    if (typeid(*expr) == typeid(ReturnExprAST)) {
-        auto& ret = dynamic_cast<ReturnExprAST&>(*expr);
-        SymbolType type = get_type(ret.expr);
-        if (!can_convert_to(type, (*scope)->return_value_type)) throw semantic_exception("mismatched return value type");
-        return type;
+    if (!ast->global_symbols.contains(var.name)) {
+        throw semantic_exception("unknown variable");
+    }
+    auto range = ast->global_symbols.equal_range(var.name);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (is_variable_type(it->second)) return it->second;
+    }
+    throw semantic_exception("unknown expression");
+}
+
+SymbolType SemanticAnalyzer::type_of(const ReturnExprAST& ret, AnalysisContext& context)
+{
+    if (ret.expr == nullptr) return context.function.signature->return_value_type; // a bare Return gives back the default value
+    SymbolType type = get_type(ret.expr, context);
+    if (!can_convert_to(type, context.function.signature->return_value_type, context)) throw semantic_exception("mismatched return value type");
+    return type;
+}
+
+SymbolType SemanticAnalyzer::type_of(const IfExprAST& if_expr, AnalysisContext& context)
+{
+    check_condition(if_expr.condition, context);
+    check_block(if_expr.then_body, context);
+    check_block(if_expr.else_body, context);
+    return SYMBOL_TYPE_VOID;
+}
+
+SymbolType SemanticAnalyzer::type_of(const ForExprAST& for_expr, AnalysisContext& context)
+{
+    SymbolType type = get_type(for_expr.variable, context);
+    if (type != SYMBOL_TYPE_INT && type != SYMBOL_TYPE_FLOAT) throw semantic_exception("loop variable must be a number");
+    for (const ExprAST* bound : { for_expr.start, for_expr.end }) {
+        SymbolType bound_type = get_type(bound, context);
+        if (bound_type != SYMBOL_TYPE_INT && bound_type != SYMBOL_TYPE_FLOAT) throw semantic_exception("loop bounds must be numbers");
+        if (type == SYMBOL_TYPE_INT && bound_type == SYMBOL_TYPE_FLOAT) context.diagnostics << "unsafe conversion: float to int may cause precision loss\n";
     }
+    if (type == SYMBOL_TYPE_INT && get_type(for_expr.step, context) == SYMBOL_TYPE_FLOAT) throw semantic_exception("step of an int loop must be an int");
+    check_block(for_expr.body, context);
+    return SYMBOL_TYPE_VOID;
+}
+
+SymbolType SemanticAnalyzer::type_of(const WhileExprAST& while_expr, AnalysisContext& context)
+{
+    check_condition(while_expr.condition, context);
+    check_block(while_expr.body, context);
+    return SYMBOL_TYPE_VOID;
+}
+
+SymbolType SemanticAnalyzer::type_of(const RepeatExprAST& repeat, AnalysisContext& context)
+{
+    check_block(repeat.body, context);
+    if (repeat.condition != nullptr) check_condition(repeat.condition, context);
+    return SYMBOL_TYPE_VOID;
+}
+
+void SemanticAnalyzer::check_condition(const ExprAST* condition, AnalysisContext& context)
+{
+    SymbolType type = get_type(condition, context);
+    if (type != SYMBOL_TYPE_INT && type != SYMBOL_TYPE_FLOAT) throw semantic_exception("condition must be a number");
+}
+
+void SemanticAnalyzer::check_block(std::span<ExprAST* const> body, AnalysisContext& context)
+{
+    // the first error stops the whole statement the block belongs to
+    for (auto statement : body) get_type(statement, context);
+}
+
+SymbolType SemanticAnalyzer::type_of(const ExprAST& expr, AnalysisContext& context)
+{
     throw semantic_exception("unknown expression");
 }
 
-SymbolType SemanticAnalyzer::llvm_type_to_symbol_type(llvm::Type* type)
+static SymbolType manifest_type(char code)
 {
-    switch (type->getTypeID())
+    switch (code)
     {
-    case llvm::Type::IntegerTyID:
+    case 'i':
         return SYMBOL_TYPE_INT;
-    case llvm::Type::FloatTyID:
+    case 'f':
         return SYMBOL_TYPE_FLOAT;
-    case llvm::Type::VoidTyID:
+    case 's':
+        return SYMBOL_TYPE_STRING;
+    case 'v':
         return SYMBOL_TYPE_VOID;
     default:
         return SYMBOL_TYPE_POINTER;
     }
 }
 
+void SemanticAnalyzer::load_stdlib_manifest(const std::string& path)
+{
+    std::ifstream manifest(path);
+    std::string line;
+    if (!std::getline(manifest, line)) throw semantic_exception("cannot read the stdlib manifest, build the stdlib target");
+    if (line != "ziyue4d stdlib manifest 1") throw semantic_exception("outdated stdlib manifest, rebuild the stdlib target");
+    while (std::getline(manifest, line)) {
+        // <return type> <name> <type>:<argument name>...
+        std::string_view rest = line;
+        auto next_field = [&rest]() {
+            size_t end = std::min(rest.find(' '), rest.size());
+            std::string_view field = rest.substr(0, end);
+            rest.remove_prefix(std::min(end + 1, rest.size()));
+            return field;
+        };
+        std::string_view return_type = next_field();
+        std::string_view name = next_field();
+        if (return_type.empty() || !name.starts_with("_ziyue4d_")) continue;
+        auto signature = std::make_unique<FunctionSignatureAST>(intern(name), manifest_type(return_type[0]));
+        while (!rest.empty()) {
+            std::string_view arg = next_field();
+            if (arg.size() < 2 || arg[1] != ':') continue;
+            signature->arguments.push_back(ast->arena.make<FunctionArgument>(intern(arg.substr(2)), manifest_type(arg[0]), nullptr));
+        }
+        ast->extern_function_table.insert({ intern(name.substr(9)), std::move(signature) });
+    }
+}
+
 std::string SemanticAnalyzer::readable_function_signature(const std::unique_ptr<FunctionSignatureAST>& signature)
 {
-    std::string result = signature->name + '(';
+    std::string result = std::string(symbol_name(signature->name)) + '(';
     for (auto& arg : signature->arguments) {
-        result += arg->name;
+        result += symbol_name(arg->name);
         switch (arg->type)
         {
         case SYMBOL_TYPE_INT:result += '%'; break;
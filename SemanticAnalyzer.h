@@ -1,63 +1,75 @@
 #pragma once
 
 #include "AST.h"
-#include <llvm/IR/IRBuilder.h>
-#include <llvm/Bitcode/BitcodeReader.h>
-#include <llvm/Support/MemoryBuffer.h>
 #include <set>
+#include <sstream>
+#include <thread>
+
+// what checking the statements of one function needs. it is passed down instead of kept in members,
+// so that functions can be checked on several threads
+struct AnalysisContext {
+    const FunctionAST& function;
+    std::ostringstream diagnostics; // printed once the function is done, in definition order
+};
 
 class SemanticAnalyzer {
 public:
     SemanticAnalyzer(std::unique_ptr<AST> ast) : ast(std::move(ast)) {
-        llvm::LLVMContext dummy_context{};
-        auto stdlibBuffer = llvm::MemoryBuffer::getFile("stdlib.bc");
-        auto module = llvm::parseBitcodeFile(**stdlibBuffer, dummy_context);
-        llvm::GlobalVariable* annotations = module->get()->getGlobalVariable("llvm.global.annotations");
-        std::set<std::string> return_string_functions = {};
-        llvm::ConstantArray* anootation_array = llvm::dyn_cast<llvm::ConstantArray>(annotations->getInitializer());
-        for (unsigned i = 0; i < anootation_array->getNumOperands(); ++i) {
-            llvm::ConstantStruct* constant = dyn_cast<llvm::ConstantStruct>(anootation_array->getOperand(i));
-            if (!constant) continue;
-            llvm::Value* annotated_entity = constant->getOperand(0)->stripPointerCasts();
-            llvm::GlobalVariable* annotation_variable = dyn_cast<llvm::GlobalVariable>(constant->getOperand(1)->stripPointerCasts());
-            if (!annotation_variable) continue;
-            llvm::ConstantDataArray* annotation_data_array = dyn_cast<llvm::ConstantDataArray>(annotation_variable->getInitializer());
-            if (!annotation_data_array || !annotation_data_array->isString()) continue;
-
-            llvm::StringRef annotation_string = annotation_data_array->getAsString();
-            if (annotation_string == "ziyue4d_string") return_string_functions.insert(anootation_array->getName().str());
-        }
-
-        auto& functions = module.get()->getFunctionList();
-        for (const auto& func : functions) {
-            if (!func.getName().starts_with("_ziyue4d_")) continue;
-            auto signature = std::make_unique<FunctionSignatureAST>(
-                func.getName().str(),
-                return_string_functions.contains(func.getName().str()) ? SYMBOL_TYPE_STRING : llvm_type_to_symbol_type(func.getReturnType())
-            );
-            for (size_t i = 0; i < func.arg_size(); i++)
-            {
-                signature->arguments.push_back(std::move(std::make_unique<FunctionArgument>(
-                    func.getArg(i)->getName().str(),
-                    llvm_type_to_symbol_type(func.getArg(i)->getType()),
-                    nullptr
-                )));
-            }
-            this->ast->extern_function_table.insert({ func.getName().substr(9).str(), std::move(signature) });
-        }
+        load_stdlib_manifest("stdlib.manifest");
     }
-    void analyze();
+    // false if any diagnostic was reported
+    bool analyze(unsigned threads = std::thread::hardware_concurrency());
+    bool analyze_function(FunctionAST& function);
+    bool analyze_statement(FunctionAST& function, ExprAST* expr);
+    // analyze() indexes every function, whoever adds or removes signatures afterwards re-indexes their names
+    void index_overloads(Symbol name);
 
 private:
-    bool can_convert_to(SymbolType old_type, SymbolType new_type);
-    const std::unique_ptr<FunctionSignatureAST>& seek_best_match_function(const CallExprAST& expr);
-    SymbolType get_type(const std::unique_ptr<ExprAST>& expr);
-    SymbolType llvm_type_to_symbol_type(llvm::Type* value);
+    // a function with its argument counts, counted once when indexed instead of on every call
+    struct Overload {
+        const FunctionSignatureAST* signature;
+        size_t mandatory;
+        size_t total;
+    };
+    // overloads in function_table order, the extern of the same name is only tried if none of them fits
+    struct OverloadSet {
+        std::vector<Overload> functions;
+        const FunctionSignatureAST* extern_function = nullptr;
+    };
+
+    bool check_signature(AnalysisContext& context);
+    bool check_statement(AnalysisContext& context, const ExprAST* expr);
+    bool can_convert_to(SymbolType old_type, SymbolType new_type, AnalysisContext& context);
+    void index_overloads();
+    static Overload make_overload(const FunctionSignatureAST& signature);
+    const FunctionSignatureAST* seek_best_match_function(const CallExprAST& expr);
+    SymbolType get_type(const ExprAST* expr, AnalysisContext& context);
+    SymbolType type_of(const FloatExprAST& expr, AnalysisContext& context);
+    SymbolType type_of(const IntegerExprAST& expr, AnalysisContext& context);
+    SymbolType type_of(const StringExprAST& expr, AnalysisContext& context);
+    SymbolType type_of(const CallExprAST& call, AnalysisContext& context);
+    SymbolType type_of(const UnaryExprAST& call, AnalysisContext& context);
+    SymbolType type_of(const BinaryExprAST& biexpr, AnalysisContext& context);
+    SymbolType type_of(const VariableExprAST& var, AnalysisContext& context);
+    SymbolType type_of(const ReturnExprAST& ret, AnalysisContext& context);
+    SymbolType type_of(const IfExprAST& if_expr, AnalysisContext& context);
+    SymbolType type_of(const ForExprAST& for_expr, AnalysisContext& context);
+    SymbolType type_of(const WhileExprAST& while_expr, AnalysisContext& context);
+    SymbolType type_of(const RepeatExprAST& repeat, AnalysisContext& context);
+    void check_condition(const ExprAST* condition, AnalysisContext& context);
+    void check_block(std::span<ExprAST* const> body, AnalysisContext& context);
+    SymbolType type_of(const ExprAST& expr, AnalysisContext& context);
+    // the stdlib signatures as written by stdlib/tools/manifest.cpp next to stdlib.bc
+    void load_stdlib_manifest(const std::string& path);
     std::string readable_function_signature(const std::unique_ptr<FunctionSignatureAST>& signature);
     std::string readable_function_signature(const std::unique_ptr<FunctionAST>& signature);
 
     std::unique_ptr<AST> ast;
-    std::unique_ptr<FunctionSignatureAST>* scope = nullptr;
+    std::unordered_map<Symbol, OverloadSet> overloads;
 
     friend class CodeGen;
+    friend class Document;
+    friend class ModuleCache;
+    friend class Optimizer;
+    friend class BytecodeCompiler;
 };
\ No newline at end of file
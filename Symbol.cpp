@@ -0,0 +1,37 @@
+#include "Symbol.h"
+#include <mutex>
+
+SymbolInterner::SymbolInterner()
+{
+    for (const auto& keyword : keywords) intern(keyword.first);
+    intern("__main");
+}
+
+Symbol SymbolInterner::intern(std::string_view name)
+{
+    {
+        std::shared_lock lock(mutex);
+        auto it = symbols.find(name);
+        if (it != symbols.end()) return it->second;
+    }
+    std::unique_lock lock(mutex);
+    auto it = symbols.find(name);
+    if (it != symbols.end()) return it->second;
+    std::string_view stored = storage.emplace_back(name);
+    Symbol symbol = Symbol(names.size());
+    names.push_back(stored);
+    symbols.emplace(stored, symbol);
+    return symbol;
+}
+
+std::string_view SymbolInterner::name(Symbol symbol) const
+{
+    std::shared_lock lock(mutex);
+    return names.at((uint32_t)symbol);
+}
+
+SymbolInterner& symbol_interner()
+{
+    static SymbolInterner interner;
+    return interner;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Token.h"
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// interned identifier, equal names share one id for the lifetime of the process
+enum class Symbol : uint32_t {};
+
+// keywords are interned before anything else, so a keyword's id is its index in `keywords`
+constexpr Symbol MAIN_SYMBOL = Symbol(std::size(keywords));
+
+class SymbolInterner {
+public:
+    SymbolInterner();
+
+    Symbol intern(std::string_view name);
+    std::string_view name(Symbol symbol) const;
+
+private:
+    std::deque<std::string> storage;
+    std::vector<std::string_view> names;
+    std::unordered_map<std::string_view, Symbol> symbols;
+    mutable std::shared_mutex mutex;
+};
+
+SymbolInterner& symbol_interner();
+
+inline Symbol intern(std::string_view name) {
+    return symbol_interner().intern(name);
+}
+
+inline std::string_view symbol_name(Symbol symbol) {
+    return symbol_interner().name(symbol);
+}
+
+// TOKEN_IDENTIFIER for anything but a keyword
+constexpr Token keyword_token(Symbol symbol) {
+    return (uint32_t)symbol < std::size(keywords) ? keywords[(uint32_t)symbol].second : TOKEN_IDENTIFIER;
+}
\ No newline at end of file
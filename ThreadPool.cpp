@@ -0,0 +1,50 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; i++) workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    job_added.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard lock(mutex);
+        jobs.push_back(std::move(job));
+        unfinished++;
+    }
+    job_added.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock lock(mutex);
+    jobs_done.wait(lock, [this] { return unfinished == 0; });
+}
+
+void ThreadPool::work()
+{
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex);
+            job_added.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+        std::lock_guard lock(mutex);
+        if (--unfinished == 0) jobs_done.notify_all();
+    }
+}
\ No newline at end of file
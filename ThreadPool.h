@@ -0,0 +1,31 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads running jobs in submission order, jobs must not throw
+class ThreadPool {
+public:
+    ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    void submit(std::function<void()> job);
+    // blocks until every job submitted so far has finished, including jobs submitted by jobs
+    void wait();
+    size_t size() const { return workers.size(); }
+
+private:
+    void work();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable job_added;
+    std::condition_variable jobs_done;
+    size_t unfinished = 0;
+    bool stopping = false;
+};
\ No newline at end of file
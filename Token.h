@@ -2,9 +2,10 @@
 
 #include <unordered_map>
 #include <string>
+#include <utility>
 
 enum Token {
-    TOKEN_EOF = -20,
+    TOKEN_EOF = -40, // tokens stay negative, single characters are returned as themselves
     TOKEN_END_OF_STMT,
     TOKEN_IDENTIFIER,
     TOKEN_FUNCTION,
@@ -17,7 +18,28 @@ enum Token {
     TOKEN_RETURN,
     TOKEN_TYPE_INT,
     TOKEN_TYPE_FLOAT,
-    TOKEN_TYPE_STRING
+    TOKEN_TYPE_STRING,
+    TOKEN_INCLUDE,
+    TOKEN_IF,
+    TOKEN_THEN,
+    TOKEN_ELSE,
+    TOKEN_ELSEIF,
+    TOKEN_ENDIF,
+    TOKEN_FOR,
+    TOKEN_TO,
+    TOKEN_STEP,
+    TOKEN_NEXT,
+    TOKEN_WHILE,
+    TOKEN_WEND,
+    TOKEN_REPEAT,
+    TOKEN_UNTIL,
+    TOKEN_FOREVER,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_LESS_EQUAL,
+    TOKEN_GREATER_EQUAL,
+    TOKEN_NOT_EQUAL,
+    TOKEN_EQUAL // '=' in a condition, the lexer never returns it
 };
 
 enum SymbolType {
@@ -27,13 +49,31 @@ enum SymbolType {
     SYMBOL_TYPE_FUNCTION,
     SYMBOL_TYPE_STRUCT,
     SYMBOL_TYPE_VOID,
-    SYMBOL_TYPE_POINTER
+    SYMBOL_TYPE_POINTER,
+    SYMBOL_TYPE_UNRESOLVED // an expression the semantic analyzer has not typed (yet)
 };
 
-const std::unordered_map<std::string, Token> tokens = {
+constexpr std::pair<const char*, Token> keywords[] = {
     {"function", TOKEN_FUNCTION},
     {"not", TOKEN_LOGIC_NOT},
     {"end", TOKEN_END},
     {"extern", TOKEN_EXTERN},
-    {"return", TOKEN_RETURN}
+    {"return", TOKEN_RETURN},
+    {"include", TOKEN_INCLUDE},
+    {"if", TOKEN_IF},
+    {"then", TOKEN_THEN},
+    {"else", TOKEN_ELSE},
+    {"elseif", TOKEN_ELSEIF},
+    {"endif", TOKEN_ENDIF},
+    {"for", TOKEN_FOR},
+    {"to", TOKEN_TO},
+    {"step", TOKEN_STEP},
+    {"next", TOKEN_NEXT},
+    {"while", TOKEN_WHILE},
+    {"wend", TOKEN_WEND},
+    {"repeat", TOKEN_REPEAT},
+    {"until", TOKEN_UNTIL},
+    {"forever", TOKEN_FOREVER},
+    {"and", TOKEN_AND},
+    {"or", TOKEN_OR}
 };
\ No newline at end of file
@@ -20,4 +20,9 @@ public:
 class codegen_exception : public std::exception {
 public:
     codegen_exception(char const* const str) : std::exception(str) {}
+};
+
+class cache_exception : public std::exception {
+public:
+    cache_exception(char const* const str) : std::exception(str) {}
 };
\ No newline at end of file
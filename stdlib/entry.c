@@ -0,0 +1,7 @@
+// entry point of executables compiled ahead of time, __main is the main function of the program
+int __main(void);
+
+int main(void)
+{
+    return __main();
+}
\ No newline at end of file
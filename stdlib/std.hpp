@@ -1,10 +1,18 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 #define _STDLIB(x) _ziyue4d_##x
+#if defined(_WIN32) && defined(_STDLIB_SHARED)
+// the native library the interpreter loads, whose functions have to be exported to be found
+#define _STDLIB_BEGIN extern "C" { _Pragma("clang attribute push(__declspec(dllexport), apply_to = function)")
+#define _STDLIB_END _Pragma("clang attribute pop") }
+#else
 #define _STDLIB_BEGIN extern "C" {
 #define _STDLIB_END }
+#endif
 #define _CONSTRUCTOR __attribute__((constructor))
 #define _RETURN_STRING __attribute__((annotate("ziyue4d_string")))
 
@@ -14,4 +22,35 @@
 #define INT int32_t
 #endif
 
-using ZStr = const std::string*;
+// the references of a literal, which is never changed nor freed
+constexpr uint32_t ZSTRING_LITERAL = 0;
+
+// a string of the runtime. its characters follow it inline and end with a nul, so that a string is a single
+// allocation, which has room for a few more characters than asked for. it is shared by counting its references and
+// appended to in place while it has only one. the literals of a program are laid out like this by CodeGen and the
+// Interpreter, which have to be changed along with it
+struct ZString {
+    uint32_t size;
+    uint32_t capacity; // characters that fit, without the nul
+    uint32_t references;
+    char data[1];
+
+    const char* c_str() const { return data; }
+    std::string_view view() const { return { data, size }; }
+};
+
+using ZStr = const ZString*;
+
+// the kinds of the pieces a string is built from, one byte each
+enum : uint8_t {
+    ZPIECE_STRING,
+    ZPIECE_INT,
+    ZPIECE_FLOAT
+};
+
+// a piece a string is built from, like a value of the generated code. CodeGen and the Interpreter pass them like this
+union ZValue {
+    ZStr string;
+    int32_t integer;
+    float real;
+};
@@ -1,26 +1,216 @@
 #include "std.hpp"
 
-_STDLIB_BEGIN
+#include <algorithm>
+#ifdef _STDLIB_COUNT_ALLOCATIONS
+#include <atomic>
+#endif
+#include <charconv>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+// allocations are rounded up to this, the characters get what is left over
+constexpr size_t STRING_GRANULE = 16;
+constexpr size_t MINIMUM_STRING_ALLOCATION = 32;
+
+// the most characters a number takes, written by std::to_chars as the shortest text that reads back as it. an int
+// takes a sign and 10 digits. a float takes at most 9 significant digits, and std::to_chars writes it in scientific
+// notation when fixed would be longer: a sign, the digits, a point and an exponent of "e-45" at most, like
+// -1.00000075e-36
+constexpr size_t MAX_INT_CHARACTERS = 11;
+constexpr size_t MAX_FLOAT_CHARACTERS = 15;
+static_assert(MAX_INT_CHARACTERS == 1 + std::numeric_limits<int32_t>::digits10 + 1);
+static_assert(MAX_FLOAT_CHARACTERS == 1 + std::numeric_limits<float>::max_digits10 + 1 + 4);
+
+#ifdef _STDLIB_COUNT_ALLOCATIONS
+// strings allocated or grown so far, and those not freed yet. only the native stdlib built for --bench-strings and
+// --check-strings counts them, the one scripts call has no such functions
+static std::atomic<int> allocations = 0;
+static std::atomic<int> live = 0;
+static std::atomic<int> peak = 0;
+static void count_string() {
+    int now = live.fetch_add(1, std::memory_order_relaxed) + 1;
+    int most = peak.load(std::memory_order_relaxed);
+    while (now > most && !peak.compare_exchange_weak(most, now, std::memory_order_relaxed)) {}
+}
+#define COUNT_ALLOCATION() allocations.fetch_add(1, std::memory_order_relaxed)
+#define COUNT_STRING() count_string()
+#define COUNT_FREE() live.fetch_sub(1, std::memory_order_relaxed)
+#else
+#define COUNT_ALLOCATION()
+#define COUNT_STRING()
+#define COUNT_FREE()
+#endif
+
+static size_t allocation_size(size_t capacity) {
+    size_t size = std::max(offsetof(ZString, data) + capacity + 1, MINIMUM_STRING_ALLOCATION);
+    return (size + STRING_GRANULE - 1) / STRING_GRANULE * STRING_GRANULE;
+}
+
+// a string of `size` characters to be written yet, with room for `capacity`. freed by release_string__
+static ZString* allocate_string(size_t size, size_t capacity) {
+    size_t bytes = allocation_size(capacity);
+    auto string = static_cast<ZString*>(malloc(bytes));
+    COUNT_ALLOCATION();
+    COUNT_STRING();
+    string->size = uint32_t(size);
+    string->capacity = uint32_t(bytes - offsetof(ZString, data) - 1);
+    string->references = 1;
+    string->data[size] = '\0';
+    return string;
+}
 
-ZStr _RETURN_STRING _STDLIB(create_string__)(const char* raw) {
-    return new std::string(raw);
+// room for the characters of `count` pieces, numbers are given as much as they could take
+static size_t pieces_size(const uint8_t* kinds, const ZValue* values, int count) {
+    size_t size = 0;
+    for (int i = 0; i < count; i++) {
+        switch (kinds[i]) {
+        case ZPIECE_STRING: size += values[i].string->size; break;
+        case ZPIECE_INT: size += MAX_INT_CHARACTERS; break;
+        default: size += MAX_FLOAT_CHARACTERS; break;
+        }
+    }
+    return size;
 }
 
+// writes the pieces after the characters of `string`, which has room for them. pieces that were `itself` before it
+// moved are the characters it had
+static void write_pieces(ZString* string, const uint8_t* kinds, const ZValue* values, int count, ZStr itself = nullptr) {
+    size_t size = string->size;
+    char* out = string->data + size;
+    for (int i = 0; i < count; i++) {
+        switch (kinds[i]) {
+        case ZPIECE_STRING:
+            if (values[i].string == itself) {
+                memcpy(out, string->data, size);
+                out += size;
+            }
+            else {
+                memcpy(out, values[i].string->data, values[i].string->size);
+                out += values[i].string->size;
+            }
+            break;
+        case ZPIECE_INT: out = std::to_chars(out, out + MAX_INT_CHARACTERS, values[i].integer).ptr; break;
+        default: out = std::to_chars(out, out + MAX_FLOAT_CHARACTERS, values[i].real).ptr; break;
+        }
+    }
+    *out = '\0';
+    string->size = uint32_t(out - string->data);
+}
+
+static ZStr number_string(uint8_t kind, ZValue value) {
+    ZString* string = allocate_string(0, pieces_size(&kind, &value, 1));
+    write_pieces(string, &kind, &value, 1);
+    return string;
+}
+
+// the text of a number a string starts with after blanks, from_chars takes no plus sign
+static std::string_view number_text(ZStr string) {
+    std::string_view text = string->view();
+    size_t start = text.find_first_not_of(" \t");
+    if (start == std::string_view::npos) return {};
+    text.remove_prefix(start);
+    if (text.size() > 1 && text[0] == '+' && text[1] != '-') text.remove_prefix(1);
+    return text;
+}
+
+_STDLIB_BEGIN
+
 ZStr _RETURN_STRING _STDLIB(int_to_string__)(int raw) {
-    return new std::string(std::to_string(raw));
+    return number_string(ZPIECE_INT, { .integer = raw });
 }
 
 ZStr _RETURN_STRING _STDLIB(float_to_string__)(float raw) {
-    return new std::string(std::to_string(raw));
+    return number_string(ZPIECE_FLOAT, { .real = raw });
+}
+
+// the int a string starts with, 0 if it does not start with one or it is out of range
+int _STDLIB(int)(ZStr string) {
+    std::string_view text = number_text(string);
+    int value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+// the float a string starts with, 0 if it does not start with one or it is out of range
+float _STDLIB(float)(ZStr string) {
+    std::string_view text = number_text(string);
+    float value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
 }
 
 ZStr _RETURN_STRING _STDLIB(concat)(ZStr a, ZStr b) {
-    return new std::string(*a + *b);
+    ZString* string = allocate_string(size_t(a->size) + b->size, size_t(a->size) + b->size);
+    memcpy(string->data, a->data, a->size);
+    memcpy(string->data + a->size, b->data, b->size);
+    return string;
+}
+
+// the string for one more owner, who releases it too
+ZStr _RETURN_STRING _STDLIB(retain_string__)(ZStr a) {
+    if (a->references != ZSTRING_LITERAL) const_cast<ZString*>(a)->references++;
+    return a;
 }
 
 void _STDLIB(release_string__)(ZStr a) {
-    // danger! do not imitate
-    delete const_cast<std::string*>(a);
+    if (a->references == ZSTRING_LITERAL) return;
+    if (--const_cast<ZString*>(a)->references == 0) {
+        COUNT_FREE();
+        free(const_cast<ZString*>(a));
+    }
+}
+
+// the pieces concatenated, in a single allocation
+ZStr _RETURN_STRING _STDLIB(build_string__)(const uint8_t* kinds, const ZValue* values, int count) {
+    ZString* string = allocate_string(0, pieces_size(kinds, values, count));
+    write_pieces(string, kinds, values, count);
+    return string;
+}
+
+// target with the pieces appended, where the caller gives up its reference to target. a target nobody else references
+// is appended to in place, it grows geometrically so that appending in a loop copies each character a few times at most
+ZStr _RETURN_STRING _STDLIB(append__)(ZStr target, const uint8_t* kinds, const ZValue* values, int count) {
+    size_t size = size_t(target->size) + pieces_size(kinds, values, count);
+    if (target->references != 1) {
+        ZString* string = allocate_string(target->size, std::max(size, size_t(target->size) * 2));
+        memcpy(string->data, target->data, target->size);
+        write_pieces(string, kinds, values, count);
+        _STDLIB(release_string__)(target);
+        return string;
+    }
+    auto string = const_cast<ZString*>(target);
+    if (size > string->capacity) {
+        size_t bytes = allocation_size(std::max(size, size_t(string->capacity) * 2));
+        string = static_cast<ZString*>(realloc(string, bytes));
+        COUNT_ALLOCATION();
+        string->capacity = uint32_t(bytes - offsetof(ZString, data) - 1);
+    }
+    // a piece may be the target itself, which may have moved
+    write_pieces(string, kinds, values, count, target);
+    return string;
+}
+
+// negative, zero or positive like std::string::compare
+int _STDLIB(compare_strings__)(ZStr a, ZStr b) {
+    int result = a->view().compare(b->view());
+    return (result > 0) - (result < 0);
+}
+
+#ifdef _STDLIB_COUNT_ALLOCATIONS
+int _STDLIB(string_allocations__)() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+int _STDLIB(live_strings__)() {
+    return live.load(std::memory_order_relaxed);
+}
+
+// the most strings live at once since the last call
+int _STDLIB(peak_live_strings__)() {
+    return peak.exchange(live.load(std::memory_order_relaxed), std::memory_order_relaxed);
 }
+#endif
 
 _STDLIB_END
\ No newline at end of file
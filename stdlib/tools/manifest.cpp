@@ -0,0 +1,87 @@
+// writes the _ziyue4d_ functions of stdlib.bc as the manifest SemanticAnalyzer reads instead of the bitcode
+// usage: stdlib_manifest <stdlib.bc> <stdlib.manifest>
+//
+// the first line is the format version, then one function per line:
+//   <return type> <name> <type>:<argument name>...
+// types are i (int), f (float), s (string), v (void) and p (any other pointer)
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <set>
+#include <string>
+
+// keep in sync with SemanticAnalyzer::load_stdlib_manifest
+constexpr const char* MANIFEST_HEADER = "ziyue4d stdlib manifest 1";
+
+static char type_code(llvm::Type* type)
+{
+    switch (type->getTypeID())
+    {
+    case llvm::Type::IntegerTyID:
+        return 'i';
+    case llvm::Type::FloatTyID:
+        return 'f';
+    case llvm::Type::VoidTyID:
+        return 'v';
+    default:
+        return 'p';
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        llvm::errs() << "usage: stdlib_manifest <stdlib.bc> <stdlib.manifest>\n";
+        return 1;
+    }
+    auto buffer = llvm::MemoryBuffer::getFile(argv[1]);
+    if (!buffer) {
+        llvm::errs() << "cannot read " << argv[1] << ": " << buffer.getError().message() << '\n';
+        return 1;
+    }
+    llvm::LLVMContext context;
+    auto module = llvm::parseBitcodeFile(**buffer, context);
+    if (!module) {
+        llvm::errs() << argv[1] << ": " << llvm::toString(module.takeError()) << '\n';
+        return 1;
+    }
+
+    // strings are plain pointers in the bitcode, functions returning one are marked with _RETURN_STRING
+    std::set<std::string> return_string_functions = {};
+    if (llvm::GlobalVariable* annotations = module->get()->getGlobalVariable("llvm.global.annotations")) {
+        llvm::ConstantArray* annotation_array = llvm::dyn_cast<llvm::ConstantArray>(annotations->getInitializer());
+        for (unsigned i = 0; annotation_array != nullptr && i < annotation_array->getNumOperands(); ++i) {
+            llvm::ConstantStruct* constant = llvm::dyn_cast<llvm::ConstantStruct>(annotation_array->getOperand(i));
+            if (!constant) continue;
+            llvm::Value* annotated_entity = constant->getOperand(0)->stripPointerCasts();
+            llvm::GlobalVariable* annotation_variable = llvm::dyn_cast<llvm::GlobalVariable>(constant->getOperand(1)->stripPointerCasts());
+            if (!annotation_variable) continue;
+            llvm::ConstantDataArray* annotation_data_array = llvm::dyn_cast<llvm::ConstantDataArray>(annotation_variable->getInitializer());
+            if (!annotation_data_array || !annotation_data_array->isString()) continue;
+
+            // getAsString keeps the terminating zero of the C string
+            llvm::StringRef annotation_string = annotation_data_array->getAsCString();
+            if (annotation_string == "ziyue4d_string") return_string_functions.insert(annotated_entity->getName().str());
+        }
+    }
+
+    std::error_code error;
+    llvm::raw_fd_ostream manifest(argv[2], error);
+    if (error) {
+        llvm::errs() << "cannot write " << argv[2] << ": " << error.message() << '\n';
+        return 1;
+    }
+    manifest << MANIFEST_HEADER << '\n';
+    for (const auto& func : module->get()->functions()) {
+        if (!func.getName().starts_with("_ziyue4d_")) continue;
+        manifest << (return_string_functions.contains(func.getName().str()) ? 's' : type_code(func.getReturnType())) << ' ' << func.getName();
+        for (const auto& arg : func.args()) {
+            manifest << ' ' << type_code(arg.getType()) << ':' << arg.getName();
+        }
+        manifest << '\n';
+    }
+    return 0;
+}
\ No newline at end of file
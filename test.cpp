@@ -1,19 +1,214 @@
 
 #include "CodeGen.h"
+#include "Interpreter.h"
+#include "Benchmark.h"
+#include "ModuleCache.h"
+#include "Optimizer.h"
+#include <algorithm>
 #include <iostream>
 
-int main() {
-    std::cout << "Compiling...\n";
-    AST ast(std::make_unique<Lex>("E:\\ZiYue4D\\example.sb"));
-    ast.parse();
-    std::cout << "Analyzing...\n";
-    SemanticAnalyzer analyzer(std::make_unique<AST>(std::move(ast)));
-    analyzer.analyze();
+// benchmarks the driver runs instead of a program, at the given size or the default one
+struct BenchmarkFlag {
+    std::string_view flag;
+    void (*run)(size_t);
+    size_t default_size;
+};
+
+const BenchmarkFlag benchmarks[] = {
+    { "--bench-lex", benchmark_lex, 1000000 },
+    { "--bench-incremental", benchmark_incremental, 100000 },
+    { "--bench-parse", benchmark_parse, 1000000 },
+    { "--bench-nodes", benchmark_nodes, 1000000 },
+    { "--bench-chain", benchmark_chain, 8000 },
+    { "--bench-calls", benchmark_calls, 200000 },
+    { "--bench-analysis", benchmark_analysis, 1000000 },
+    { "--bench-optimizer", benchmark_optimizer, 100000 },
+    { "--bench-jit", benchmark_jit, 2000 },
+    { "--bench-object-cache", benchmark_object_cache, 2000 },
+    { "--bench-lazy", benchmark_lazy, 2000 },
+    { "--bench-partitions", benchmark_partitions, 4000 },
+    { "--bench-loops", benchmark_loops, 1000000 },
+    { "--bench-project", benchmark_project, 64 },
+    { "--bench-cache", benchmark_cache, 1000000 },
+    { "--bench-aot", benchmark_aot, 20 },
+    { "--bench-interpreter", benchmark_interpreter, 1000000 },
+    { "--bench-literals", benchmark_literals, 10000000 },
+    { "--bench-strings", benchmark_strings, 1000000 },
+    { "--bench-numbers", benchmark_numbers, 1000000 },
+    { "--bench-inline-stdlib", benchmark_inline_stdlib, 10000000 },
+    { "--bench-startup", benchmark_startup, 1000 },
+};
+
+// checks the driver runs instead of a program, it exits with 1 if one fails
+struct CheckFlag {
+    std::string_view flag;
+    bool (*run)();
+};
+
+const CheckFlag checks[] = {
+    { "--check-strings", check_strings },
+    { "--check-incremental", check_incremental },
+};
+
+int main(int argc, char** argv) {
+    std::string source = "E:\\ZiYue4D\\example.sb";
+    bool use_cache = true;
+    unsigned optimization_level = 2;
+    bool lazy = false;
+    bool inline_stdlib = false; // link the stdlib into the program so that it is optimized along with it
+    bool interpret = false; // start in the interpreter, hot functions move to the JIT
+    unsigned tier_up_threshold = 1000;
+    unsigned threads = 1; // of code generation and the JIT
+    std::filesystem::path cache_directory = std::filesystem::temp_directory_path() / "ziyue4d_cache";
+    std::filesystem::path object_output, executable_output; // compile ahead of time instead of running the program
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto benchmark = std::find_if(std::begin(benchmarks), std::end(benchmarks), [&arg](const BenchmarkFlag& benchmark) { return benchmark.flag == arg; });
+        if (benchmark != std::end(benchmarks)) {
+            benchmark->run(i + 1 < argc ? std::stoul(argv[i + 1]) : benchmark->default_size);
+            return 0;
+        }
+        auto check = std::find_if(std::begin(checks), std::end(checks), [&arg](const CheckFlag& check) { return check.flag == arg; });
+        if (check != std::end(checks)) return check->run() ? 0 : 1;
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+            continue;
+        }
+        if (arg == "--lazy") {
+            lazy = true;
+            continue;
+        }
+        if (arg == "--inline-stdlib") {
+            inline_stdlib = true;
+            continue;
+        }
+        if (arg == "--interpret") {
+            interpret = true;
+            continue;
+        }
+        if (arg == "--tier-up" && i + 1 < argc) {
+            tier_up_threshold = std::stoul(argv[++i]);
+            continue;
+        }
+        if (arg == "--no-cache") {
+            use_cache = false;
+            continue;
+        }
+        if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3') {
+            optimization_level = arg[2] - '0';
+            continue;
+        }
+        if (arg == "--emit-object" && i + 1 < argc) {
+            object_output = argv[++i];
+            continue;
+        }
+        if (arg == "--emit-executable" && i + 1 < argc) {
+            executable_output = argv[++i];
+            continue;
+        }
+        if (arg == "--cache-dir" && i + 1 < argc) {
+            cache_directory = argv[++i];
+            continue;
+        }
+        source = arg;
+    }
+    // the stdlib is linked into the program's one module, there is none when it is split up or compiled a function at a time
+    if (inline_stdlib && (lazy || threads > 1)) {
+        std::cout << "Cannot inline the stdlib into a program compiled lazily or on several threads";
+        return 1;
+    }
+
+    ModuleCache cache(cache_directory);
+    std::unique_ptr<SemanticAnalyzer> analyzer;
+    auto ast = use_cache ? cache.load(source) : nullptr;
+    if (ast != nullptr) {
+        std::cout << "Loaded from cache...\n";
+        analyzer = std::make_unique<SemanticAnalyzer>(std::move(ast));
+    }
+    else {
+        std::cout << "Compiling...\n";
+        Project project(source);
+        analyzer = std::make_unique<SemanticAnalyzer>(project.parse());
+        std::cout << "Analyzing...\n";
+        // the diagnostics are printed already. calls it could not resolve have no callee to generate
+        if (!analyzer->analyze()) return 1;
+        if (use_cache) {
+            auto sources = project.sources();
+            if (auto stdlib = ModuleCache::hash_file("stdlib.manifest")) sources.push_back(*stdlib);
+            cache.store(source, *analyzer, sources);
+        }
+    }
     std::cout << "Generating...\n";
-    JIT codegen(std::make_unique<SemanticAnalyzer>(std::move(analyzer)));
+    // -O0 leaves the program as written, for looking at the IR
+    if (optimization_level > 0) Optimizer(*analyzer).optimize();
+    if (!object_output.empty() || !executable_output.empty()) {
+        AOT codegen(std::move(analyzer));
+        codegen.optimization_level = optimization_level;
+        codegen.generate_functions();
+        // an executable is linked from an object next to it, which is removed again unless it was asked for too
+        auto object = object_output.empty() ? std::filesystem::path(executable_output).replace_extension(".o") : object_output;
+        std::cout << "Writing " << object.string() << "...\n";
+        codegen.emit_object(object);
+        if (!executable_output.empty()) {
+            std::cout << "Linking " << executable_output.string() << "...\n";
+            try {
+                AOT::link_executable(object, executable_output);
+            }
+            catch (const std::runtime_error& error) {
+                std::cout << "Cannot link: " << error.what();
+                return 1;
+            }
+            if (object_output.empty()) std::filesystem::remove(object);
+        }
+        return 0;
+    }
+    std::shared_ptr<SemanticAnalyzer> semantic = std::move(analyzer);
+    if (interpret) {
+        std::unique_ptr<Interpreter> interpreter;
+        try {
+            interpreter = std::make_unique<Interpreter>(semantic);
+        }
+        catch (const codegen_exception& error) {
+            std::cout << "Cannot interpret: " << error.what() << ", compiling instead\n";
+        }
+        if (interpreter != nullptr) {
+            interpreter->tier_up_threshold = tier_up_threshold;
+            interpreter->optimization_level = optimization_level;
+            if (use_cache) interpreter->object_cache_directory = cache_directory / "objects";
+            std::cout << "Executing...\n";
+            int result = 0;
+            try {
+                result = interpreter->run();
+            }
+            catch (const std::runtime_error& error) {
+                std::cout << "\nCannot interpret: " << error.what();
+                return 1;
+            }
+            std::cout << result;
+            std::cout << "\nCalls: " << interpreter->interpreted_calls() << " interpreted, " << interpreter->native_calls() << " native";
+            return 0;
+        }
+    }
+    JIT codegen(semantic);
+    codegen.optimization_level = optimization_level;
+    codegen.lazy = lazy;
+    codegen.inline_stdlib = inline_stdlib;
+    codegen.partition_count = threads;
+    codegen.compile_threads = threads > 1 ? threads : 0;
+    if (use_cache) codegen.object_cache_directory = cache_directory / "objects";
     codegen.generate_functions();
     codegen.init();
     std::cout << "Executing...\n";
-    std::cout << codegen.run();
+    int result = 0;
+    try {
+        result = codegen.run();
+    }
+    catch (const codegen_exception& error) {
+        std::cout << "Cannot compile: " << error.what();
+        return 1;
+    }
+    std::cout << result;
+    // after running, a lazy JIT compiles while the program runs
+    if (auto objects = codegen.object_cache()) std::cout << "\nObject cache: " << objects->hits() << " hits, " << objects->misses() << " misses";
     return 0;
 }
\ No newline at end of file
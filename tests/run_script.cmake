@@ -0,0 +1,41 @@
+# runs SCRIPT with DRIVER in the JIT, unoptimized and optimized, and in the interpreter, with and without tiering up.
+# every run has to print what SCRIPT's .expected file holds: the output of the program followed by what it returns
+#   cmake -DDRIVER=<ZiYue4D> -DSCRIPT=<name.sb> -P run_script.cmake
+get_filename_component(SCRIPT_DIRECTORY ${SCRIPT} DIRECTORY)
+get_filename_component(SCRIPT_NAME ${SCRIPT} NAME_WE)
+file(READ ${SCRIPT_DIRECTORY}/${SCRIPT_NAME}.expected EXPECTED)
+string(STRIP "${EXPECTED}" EXPECTED)
+# a script saying it tiers up calls a function often enough that its calls have to end up native
+file(STRINGS ${SCRIPT} TIERS_UP REGEX "^; tiers up")
+
+foreach(MODE "-O0" "-O2" "--interpret --tier-up 0" "--interpret --tier-up 1")
+    separate_arguments(ARGUMENTS UNIX_COMMAND "--no-cache ${MODE}")
+    execute_process(COMMAND ${DRIVER} ${ARGUMENTS} ${SCRIPT}
+        OUTPUT_VARIABLE OUTPUT ERROR_VARIABLE ERROR RESULT_VARIABLE RESULT)
+    if(NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "${MODE}: exited with ${RESULT}\n${OUTPUT}${ERROR}")
+    endif()
+    string(FIND "${OUTPUT}" "Executing...\n" START)
+    if(START EQUAL -1)
+        message(FATAL_ERROR "${MODE}: the program did not run\n${OUTPUT}${ERROR}")
+    endif()
+    math(EXPR START "${START} + 13")
+    string(SUBSTRING "${OUTPUT}" ${START} -1 OUTPUT)
+
+    # the interpreter counts its calls after the result, a program it cannot run is compiled instead and has no count
+    if(MODE MATCHES "--interpret")
+        if(NOT OUTPUT MATCHES "\nCalls: ([0-9]+) interpreted, ([0-9]+) native$")
+            message(FATAL_ERROR "${MODE}: the interpreter did not run the program\n${OUTPUT}")
+        endif()
+        set(INTERPRETED_CALLS ${CMAKE_MATCH_1})
+        set(NATIVE_CALLS ${CMAKE_MATCH_2})
+        if(MODE MATCHES "--tier-up 1" AND TIERS_UP AND NATIVE_CALLS EQUAL 0)
+            message(FATAL_ERROR "${MODE}: no call was native, ${INTERPRETED_CALLS} interpreted")
+        endif()
+        string(REGEX REPLACE "\nCalls: [0-9]+ interpreted, [0-9]+ native$" "" OUTPUT "${OUTPUT}")
+    endif()
+    string(STRIP "${OUTPUT}" OUTPUT)
+    if(NOT OUTPUT STREQUAL EXPECTED)
+        message(FATAL_ERROR "${MODE}: printed\n${OUTPUT}\ninstead of\n${EXPECTED}")
+    endif()
+endforeach()